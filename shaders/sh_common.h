@@ -1,4 +1,13 @@
 #define PI 3.1415926538f
+#define SH_MAX_LMAX 4 // highest band a kernel may be specialized for
+#define SH_MAX_COEFFS ((SH_MAX_LMAX + 1) * (SH_MAX_LMAX + 1))
+
+// Highest band, set per pipeline so loops over the bands have constant trip counts
+#ifndef SH_LMAX_CONSTANT_ID
+#define SH_LMAX_CONSTANT_ID 0
+#endif
+layout(constant_id = SH_LMAX_CONSTANT_ID) const int SH_LMAX = SH_MAX_LMAX;
+#define SH_COEFFS ((SH_LMAX + 1) * (SH_LMAX + 1))
 
 float calcNormalizationConst(const float h, const float w)
 {
@@ -21,204 +30,47 @@ float y2theta(const int y, const int h)
     return PI * (float(y) + 0.5f) / float(h);
 }
 
-// took from https://github.com/google/spherical-harmonics/blob/master/sh/spherical_harmonics.cc
-
-float HardcodedSH00(const vec3 d)
-{
-    return 0.282095;
-}
+// Same real basis and signs as https://github.com/google/spherical-harmonics
+// sqrt((2l + 1) / 4pi * (l - m)! / (l + m)!), times sqrt(2) for m > 0, at l * (l + 1) / 2 + m
+const float SH_K[] = float[](
+        0.282095f,
+        0.488603f, 0.488603f,
+        0.630783f, 0.364183f, 0.182091f,
+        0.746353f, 0.304697f, 0.096354f, 0.039336f,
+        0.846284f, 0.267619f, 0.063078f, 0.016858f, 0.005960f
+        );
 
-float HardcodedSH1n1(const vec3 d)
+// Every basis function up to SH_LMAX for a unit direction, at l * (l + 1) + m. One pass over
+// the associated Legendre recurrence in z, with (x + iy)^m carrying the azimuthal part.
+void evalSH(const vec3 d, out float basis[SH_MAX_COEFFS])
 {
-    return -0.488603 * d.y;
-}
-
-float HardcodedSH10(const vec3 d)
-{
-    return 0.488603 * d.z;
-}
-
-float HardcodedSH1p1(const vec3 d)
-{
-    return -0.488603 * d.x;
-}
-
-float HardcodedSH2n2(const vec3 d)
-{
-    return 1.092548 * d.x * d.y;
-}
-
-float HardcodedSH2n1(const vec3 d)
-{
-    return -1.092548 * d.y * d.z;
-}
-
-float HardcodedSH20(const vec3 d)
-{
-    return 0.315392 * (-d.x * d.x - d.y * d.y + 2.0 * d.z * d.z);
-}
-
-float HardcodedSH2p1(const vec3 d)
-{
-    return -1.092548 * d.x * d.z;
-}
-
-float HardcodedSH2p2(const vec3 d)
-{
-    return 0.546274 * (d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH3n3(const vec3 d)
-{
-    return -0.590044 * d.y * (3.0 * d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH3n2(const vec3 d)
-{
-    return 2.890611 * d.x * d.y * d.z;
-}
-
-float HardcodedSH3n1(const vec3 d)
-{
-    return -0.457046 * d.y * (4.0 * d.z * d.z - d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH30(const vec3 d)
-{
-    return 0.373176 * d.z * (2.0 * d.z * d.z - 3.0 * d.x * d.x - 3.0 * d.y * d.y);
-}
-
-float HardcodedSH3p1(const vec3 d)
-{
-    return -0.457046 * d.x * (4.0 * d.z * d.z - d.x * d.x - d.y * d.y);
-}
+    vec2  xym = vec2(1.0f, 0.0f); // (x + iy)^m
+    float pmm = 1.0f;             // P_m^m / sin^m(theta)
 
-float HardcodedSH3p2(const vec3 d)
-{
-    return 1.445306 * d.z * (d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH3p3(const vec3 d)
-{
-    return -0.590044 * d.x * (d.x * d.x - 3.0 * d.y * d.y);
-}
-
-float HardcodedSH4n4(const vec3 d)
-{
-    return 2.503343 * d.x * d.y * (d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH4n3(const vec3 d)
-{
-    return -1.770131 * d.y * d.z * (3.0 * d.x * d.x - d.y * d.y);
-}
-
-float HardcodedSH4n2(const vec3 d)
-{
-    return 0.946175 * d.x * d.y * (7.0 * d.z * d.z - 1.0);
-}
-
-float HardcodedSH4n1(const vec3 d)
-{
-    return -0.669047 * d.y * d.z * (7.0 * d.z * d.z - 3.0);
-}
-
-float HardcodedSH40(const vec3 d)
-{
-    float z2 = d.z * d.z;
-    return 0.105786 * (35.0 * z2 * z2 - 30.0 * z2 + 3.0);
-}
-
-float HardcodedSH4p1(const vec3 d)
-{
-    return -0.669047 * d.x * d.z * (7.0 * d.z * d.z - 3.0);
-}
-
-float HardcodedSH4p2(const vec3 d)
-{
-    return 0.473087 * (d.x * d.x - d.y * d.y) * (7.0 * d.z * d.z - 1.0);
-}
-
-float HardcodedSH4p3(const vec3 d)
-{
-    return -1.770131 * d.x * d.z * (d.x * d.x - 3.0 * d.y * d.y);
-}
-
-float HardcodedSH4p4(const vec3 d)
-{
-    float x2 = d.x * d.x;
-    float y2 = d.y * d.y;
-    return 0.625836 * (x2 * (x2 - 3.0 * y2) - y2 * (3.0 * x2 - y2));
-}
-
-float SH(int l, int m, const vec3 dir)
-{
-    switch (l)
+    for (int m = 0; m <= SH_LMAX; m++)
     {
-        case 0:
-            return HardcodedSH00(dir);
-        case 1:
-            switch (m) {
-                case -1:
-                    return HardcodedSH1n1(dir);
-                case 0:
-                    return HardcodedSH10(dir);
-                case 1:
-                    return HardcodedSH1p1(dir);
-            }
-        case 2:
-            switch (m) {
-                case -2:
-                    return HardcodedSH2n2(dir);
-                case -1:
-                    return HardcodedSH2n1(dir);
-                case 0:
-                    return HardcodedSH20(dir);
-                case 1:
-                    return HardcodedSH2p1(dir);
-                case 2:
-                    return HardcodedSH2p2(dir);
+        float prev = 0.0f;
+        float p    = pmm;
+
+        for (int l = m; l <= SH_LMAX; l++)
+        {
+            const float k = SH_K[l * (l + 1) / 2 + m] * p;
+            if (m == 0)
+            {
+                basis[l * (l + 1)] = k;
             }
-        case 3:
-            switch (m) {
-                case -3:
-                    return HardcodedSH3n3(dir);
-                case -2:
-                    return HardcodedSH3n2(dir);
-                case -1:
-                    return HardcodedSH3n1(dir);
-                case 0:
-                    return HardcodedSH30(dir);
-                case 1:
-                    return HardcodedSH3p1(dir);
-                case 2:
-                    return HardcodedSH3p2(dir);
-                case 3:
-                    return HardcodedSH3p3(dir);
+            else
+            {
+                basis[l * (l + 1) + m] = k * xym.x;
+                basis[l * (l + 1) - m] = k * xym.y;
             }
-        case 4:
-            switch (m) {
-                case -4:
-                    return HardcodedSH4n4(dir);
-                case -3:
-                    return HardcodedSH4n3(dir);
-                case -2:
-                    return HardcodedSH4n2(dir);
-                case -1:
-                    return HardcodedSH4n1(dir);
-                case 0:
-                    return HardcodedSH40(dir);
-                case 1:
-                    return HardcodedSH4p1(dir);
-                case 2:
-                    return HardcodedSH4p2(dir);
-                case 3:
-                    return HardcodedSH4p3(dir);
-                case 4:
-                    return HardcodedSH4p4(dir);
-            }
-    }
 
-    return 0.0;
-}
+            const float next = (float(2 * l + 1) * d.z * p - float(l + m) * prev) / float(l + 1 - m);
+            prev = p;
+            p    = next;
+        }
 
+        pmm *= -float(2 * m + 1);
+        xym  = vec2(xym.x * d.x - xym.y * d.y, xym.x * d.y + xym.y * d.x);
+    }
+}
@@ -0,0 +1,29 @@
+// Fixed-order workgroup reduction used by the SH projection kernels.
+// Every invocation of the workgroup has to reach workgroupReduce(), so kernels
+// must not return early before calling it.
+
+#ifndef REDUCE_SIZE
+#define REDUCE_SIZE (WORKGROUP_SIZE * WORKGROUP_SIZE)
+#endif
+
+shared vec3 reduceScratch[REDUCE_SIZE];
+
+vec3 workgroupReduce(const vec3 value)
+{
+    const uint i = gl_LocalInvocationIndex;
+
+    barrier(); // previous result may still be read
+    reduceScratch[i] = value;
+    barrier();
+
+    for (uint stride = REDUCE_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (i < stride)
+        {
+            reduceScratch[i] += reduceScratch[i + stride];
+        }
+        barrier();
+    }
+
+    return reduceScratch[0];
+}
@@ -0,0 +1,161 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace vlb {
+
+    void Animation::addChannel(uint32_t node, Path path, Interpolation interpolation, std::span<const float> times, std::span<const glm::vec4> values)
+    {
+        const size_t stride = interpolation == Interpolation::eCubicSpline ? 3 : 1;
+        if (times.empty() || values.size() != times.size() * stride)
+        {
+            throw std::runtime_error("animation channel has mismatching key times and values");
+        }
+
+        if (this->firstKeys.empty())
+        {
+            this->firstKeys.push_back(0);
+            this->firstValues.push_back(0);
+            this->start    = times.front();
+            this->duration = 0.0f;
+        }
+
+        const float end = std::max(this->start + this->duration, times.back());
+        this->start     = std::min(this->start, times.front());
+        this->duration  = end - this->start;
+
+        this->nodes.push_back(node);
+        this->paths.push_back(path);
+        this->interpolations.push_back(interpolation);
+        this->cursors.push_back(this->firstKeys.back());
+
+        const size_t firstValue = this->values.size();
+        this->times.insert(this->times.end(), times.begin(), times.end());
+        this->values.insert(this->values.end(), values.begin(), values.end());
+        this->firstKeys.push_back(static_cast<uint32_t>(this->times.size()));
+        this->firstValues.push_back(static_cast<uint32_t>(this->values.size()));
+
+        // keep neighbouring rotations in one hemisphere, so blending them takes the short way
+        if (path == Path::eRotation && interpolation == Interpolation::eLinear)
+        {
+            for (size_t v = firstValue + 1; v < this->values.size(); ++v)
+            {
+                if (glm::dot(this->values[v - 1], this->values[v]) < 0.0f)
+                {
+                    this->values[v] = -this->values[v];
+                }
+            }
+        }
+
+        this->sources.resize(this->nodes.size());
+        this->weights.resize(this->nodes.size());
+        this->results.resize(this->nodes.size());
+    }
+
+    uint32_t Animation::getChannelCount()
+    {
+        return static_cast<uint32_t>(this->nodes.size());
+    }
+
+    float Animation::getDuration()
+    {
+        return this->duration;
+    }
+
+    uint32_t Animation::findKey(uint32_t channel, float time)
+    {
+        const uint32_t first = this->firstKeys[channel];
+        const uint32_t last  = this->firstKeys[channel + 1] - 1;
+
+        if (first == last || time <= this->times[first]) return first;
+        if (time >= this->times[last]) return last - 1;
+
+        uint32_t& key = this->cursors[channel];
+        if (this->times[key] <= time)
+        {
+            while (this->times[key + 1] <= time) ++key;
+            return key;
+        }
+
+        // time went back, e.g. the animation looped
+        key = static_cast<uint32_t>(std::upper_bound(this->times.begin() + first, this->times.begin() + last, time) - this->times.begin()) - 1;
+        return key;
+    }
+
+    void Animation::apply(float time, SceneGraph& graph)
+    {
+        const uint32_t count = getChannelCount();
+        if (!count) return;
+
+        const float local = this->duration > 0.0f ? this->start + std::fmod(std::max(time, 0.0f), this->duration) : this->start;
+
+        // Every interpolation becomes four weighted values
+        for (uint32_t c = 0; c < count; ++c)
+        {
+            const uint32_t key    = findKey(c, local);
+            const uint32_t stride = this->interpolations[c] == Interpolation::eCubicSpline ? 3 : 1;
+            const uint32_t value  = this->firstValues[c] + (key - this->firstKeys[c]) * stride;
+
+            if (key + 1 == this->firstKeys[c + 1])
+            {
+                const uint32_t only = value + stride / 2;
+                this->sources[c] = glm::uvec4(only);
+                this->weights[c] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+                continue;
+            }
+
+            const float dt = this->times[key + 1] - this->times[key];
+            const float t  = std::clamp((local - this->times[key]) / dt, 0.0f, 1.0f);
+
+            switch (this->interpolations[c])
+            {
+                case Interpolation::eStep:
+                    this->sources[c] = glm::uvec4(t < 1.0f ? value : value + 1);
+                    this->weights[c] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+                    break;
+                case Interpolation::eLinear:
+                    this->sources[c] = glm::uvec4(value, value + 1, value, value);
+                    this->weights[c] = glm::vec4(1.0f - t, t, 0.0f, 0.0f);
+                    break;
+                case Interpolation::eCubicSpline:
+                {
+                    // Hermite: values of both keys, out tangent of this key, in tangent of the next
+                    const float t2 = t * t;
+                    const float t3 = t2 * t;
+                    this->sources[c] = glm::uvec4(value + 1, value + 4, value + 2, value + 3);
+                    this->weights[c] = glm::vec4(2.0f * t3 - 3.0f * t2 + 1.0f, -2.0f * t3 + 3.0f * t2, (t3 - 2.0f * t2 + t) * dt, (t3 - t2) * dt);
+                    break;
+                }
+            }
+        }
+
+        for (uint32_t c = 0; c < count; ++c)
+        {
+            const glm::uvec4& s = this->sources[c];
+            const glm::vec4&  w = this->weights[c];
+            this->results[c] = w.x * this->values[s.x] + w.y * this->values[s.y] + w.z * this->values[s.z] + w.w * this->values[s.w];
+        }
+
+        for (uint32_t c = 0; c < count; ++c)
+        {
+            const glm::vec4& r = this->results[c];
+            switch (this->paths[c])
+            {
+                case Path::eTranslation:
+                    graph.setTranslation(this->nodes[c], glm::vec3(r));
+                    break;
+                case Path::eRotation:
+                    graph.setRotation(this->nodes[c], glm::normalize(glm::quat(r.w, r.x, r.y, r.z)));
+                    break;
+                case Path::eScale:
+                    graph.setScale(this->nodes[c], glm::vec3(r));
+                    break;
+            }
+        }
+    }
+}
+
@@ -0,0 +1,73 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef ANIMATION_HPP
+#define ANIMATION_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "scene_graph.hpp"
+
+namespace vlb {
+
+    // TRS channels of one glTF animation. Keys of all channels live back to back in
+    // flat arrays; apply() first finds the key pair and blend weights of every
+    // channel, then blends all channels in one branch-free loop and writes the
+    // results into the SceneGraph, so only animated nodes get dirty.
+    class Animation
+    {
+        public:
+            enum class Path
+            {
+                eTranslation,
+                eRotation,
+                eScale
+            };
+
+            enum class Interpolation
+            {
+                eStep,
+                eLinear,
+                eCubicSpline
+            };
+
+        private:
+            // per channel
+            std::vector<uint32_t>      nodes;
+            std::vector<Path>          paths;
+            std::vector<Interpolation> interpolations;
+            std::vector<uint32_t>      firstKeys; // channel c owns keys [firstKeys[c], firstKeys[c + 1])
+            std::vector<uint32_t>      cursors;   // key used last time, playback mostly moves forward
+
+            // per key; cubic splines keep (in tangent, value, out tangent) triples in values
+            std::vector<float>     times;
+            std::vector<glm::vec4> values;
+            std::vector<uint32_t>  firstValues; // per channel, like firstKeys
+
+            // apply() scratch, per channel
+            std::vector<glm::uvec4> sources;
+            std::vector<glm::vec4>  weights;
+            std::vector<glm::vec4>  results;
+
+            float start    = 0.0f;
+            float duration = 0.0f;
+
+            uint32_t findKey(uint32_t channel, float time);
+
+        public:
+            // values holds one vec4 per key, three for cubic splines; vec3 paths leave w unused
+            void addChannel(uint32_t node, Path path, Interpolation interpolation, std::span<const float> times, std::span<const glm::vec4> values);
+
+            uint32_t getChannelCount();
+            float    getDuration();
+
+            // Samples every channel at time, looping over the animation's time range
+            void apply(float time, SceneGraph& graph);
+    };
+}
+
+#endif // ifndef ANIMATION_HPP
+
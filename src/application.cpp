@@ -4,11 +4,17 @@
 
 #include <fstream>
 #include <limits>
+#include <map>
 
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 namespace vlb {
 
+    namespace {
+        std::mutex                    queueRegistryMutex;
+        std::map<VkQueue, std::mutex> queueMutexes; // see Application::lockQueue()
+    }
+
     PFN_vkCreateDebugUtilsMessengerEXT  pfnVkCreateDebugUtilsMessengerEXT;
     PFN_vkDestroyDebugUtilsMessengerEXT pfnVkDestroyDebugUtilsMessengerEXT;
 
@@ -96,6 +102,17 @@ namespace vlb {
         this->physicalDevice = devices[physicalDeviceIdx];
         this->physicalDeviceMemoryProperties = this->physicalDevice.getMemoryProperties();
 
+        // optional, lets MemoryAllocator::getReport() put the driver's numbers next to its own
+        auto availableExtensions = this->physicalDevice.enumerateDeviceExtensionProperties();
+        auto hasMemoryBudget = [](const vk::ExtensionProperties& extension)
+        {
+            return std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        };
+        if (std::any_of(availableExtensions.begin(), availableExtensions.end(), hasMemoryBudget))
+        {
+            this->deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
         setQueueFamilyIndices();
         float queuePriorities = 1.f;
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos(3);
@@ -211,30 +228,24 @@ namespace vlb {
         return result;
     }
 
-    vk::CommandBuffer Application::recordGraphicsCommandBuffer(vk::CommandBufferAllocateInfo info)
+    vk::CommandBuffer Application::recordGraphicsCommandBuffer()
     {
-        return recordCommandBuffer(this->device.get(), this->commandPool.graphics.get(), info);
+        return recordCommandBuffer(this->device.get(), this->commandPool.graphics.get());
     }
 
-    vk::CommandBuffer Application::recordTransferCommandBuffer(vk::CommandBufferAllocateInfo info)
+    vk::CommandBuffer Application::recordTransferCommandBuffer()
     {
-        return recordCommandBuffer(this->device.get(), this->commandPool.transfer.get(), info);
+        return recordCommandBuffer(this->device.get(), this->commandPool.transfer.get());
     }
 
-    vk::CommandBuffer Application::recordComputeCommandBuffer(vk::CommandBufferAllocateInfo info)
+    vk::CommandBuffer Application::recordComputeCommandBuffer()
     {
-        return recordCommandBuffer(this->device.get(), this->commandPool.compute.get(), info);
+        return recordCommandBuffer(this->device.get(), this->commandPool.compute.get());
     }
 
-    vk::CommandBuffer Application::recordCommandBuffer(vk::Device device, vk::CommandPool commandPool, vk::CommandBufferAllocateInfo info)
+    vk::CommandBuffer Application::recordCommandBuffer(vk::Device device, vk::CommandPool commandPool)
     {
-        auto passed = info == vk::CommandBufferAllocateInfo{};
-        info = passed ? vk::CommandBufferAllocateInfo(commandPool, vk::CommandBufferLevel::ePrimary, 1) : info;
-
-        vk::CommandBuffer cmdBuffer = device.allocateCommandBuffers(info).front();
-        cmdBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
-        return cmdBuffer;
+        return SubmissionQueue::begin(device, commandPool);
     }
 
     void Application::flushGraphicsCommandBuffer(vk::CommandBuffer& cmdBuffer)
@@ -252,28 +263,32 @@ namespace vlb {
         flushCommandBuffer(this->device.get(), this->commandPool.compute.get(), cmdBuffer, this->queue.compute);
     }
 
-    void Application::flushCommandBuffer(vk::Device& device, vk::CommandPool& commandPool, vk::CommandBuffer& cmdBuffer, vk::Queue queue)
+    std::unique_lock<std::mutex> Application::lockQueue(vk::Queue queue)
     {
-        cmdBuffer.end();
-        vk::SubmitInfo submitInfo{};
-        submitInfo
-            .setCommandBufferCount(1)
-            .setPCommandBuffers(&cmdBuffer);
-
-        vk::Fence fence = device.createFence(vk::FenceCreateInfo());
-        queue.submit(submitInfo, fence);
-        try {
-            auto timeout = std::numeric_limits<uint64_t>::max();
-            auto r = device.waitForFences(fence, false, timeout);
-            if (r != vk::Result::eSuccess) std::cout << "flushing failed with result code: " << r << "\n";
-        }
-        catch (std::exception const &e)
+        std::unique_lock<std::mutex> registryLock{queueRegistryMutex};
+        std::mutex& mutex = queueMutexes[static_cast<VkQueue>(queue)];
+        registryLock.unlock();
+
+        return std::unique_lock<std::mutex>{mutex};
+    }
+
+    void Application::waitIdle(vk::Device device)
+    {
+        std::lock_guard<std::mutex> registryLock{queueRegistryMutex};
+
+        // always in map order, so two callers cannot deadlock
+        std::vector<std::unique_lock<std::mutex>> locks{};
+        for (auto& [queue, mutex] : queueMutexes)
         {
-            std::cout << e.what() << "\n";
+            locks.emplace_back(mutex);
         }
 
-        device.destroy(fence);
-        device.freeCommandBuffers(commandPool, 1, &cmdBuffer);
+        device.waitIdle();
+    }
+
+    void Application::flushCommandBuffer(vk::Device& device, vk::CommandPool& commandPool, vk::CommandBuffer& cmdBuffer, vk::Queue queue)
+    {
+        SubmissionQueue::get(device, queue).submit(commandPool, cmdBuffer).wait();
     }
 
     void Application::setImageLayout(
@@ -376,13 +391,14 @@ namespace vlb {
                 .setPCode(reinterpret_cast<const uint32_t*>(code.data())) );
     }
 
-    Application::Buffer Application::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data)
+    Application::Buffer Application::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data,
+            MemoryAllocator::Tag tag)
     {
-        return createBuffer(this->device.get(), this->physicalDevice, size, usage, memoryProperty, data);
+        return createBuffer(this->device.get(), this->physicalDevice, size, usage, memoryProperty, data, std::move(tag));
     }
 
     Application::Buffer Application::createBuffer(vk::Device& device, vk::PhysicalDevice& physicalDevice, vk::DeviceSize size,
-            vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data)
+            vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data, MemoryAllocator::Tag tag)
     {
         std::array<uint32_t, 3> queueFamilyIndices = {0, 1, 2}; // TODO: this might fail but ok for now
         Buffer buffer{};
@@ -394,28 +410,13 @@ namespace vlb {
                 .setQueueFamilyIndices(queueFamilyIndices)
                 );
 
-        auto memoryRequirements = device.getBufferMemoryRequirements(buffer.handle.get());
-        vk::MemoryAllocateFlagsInfo memoryFlagsInfo{};
-        if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        {
-            memoryFlagsInfo.flags = vk::MemoryAllocateFlagBits::eDeviceAddress;
-        }
-
-        buffer.memory = device.allocateMemoryUnique(
-                vk::MemoryAllocateInfo{}
-                .setAllocationSize(memoryRequirements.size)
-                .setMemoryTypeIndex(getMemoryType(physicalDevice, memoryRequirements, memoryProperty))
-                .setPNext(&memoryFlagsInfo)
-                );
-        device.bindBufferMemory(buffer.handle.get(), buffer.memory.get(), 0);
+        buffer.memory = MemoryAllocator::get(device, physicalDevice).allocate(buffer.handle.get(), memoryProperty, std::move(tag));
 
         if (data)
         {
             if (memoryProperty & vk::MemoryPropertyFlagBits::eHostVisible)
             {
-                void* dataPtr = device.mapMemory(buffer.memory.get(), 0, size);
-                memcpy(dataPtr, data, static_cast<size_t>(size));
-                device.unmapMemory(buffer.memory.get());
+                memcpy(buffer.memory.map(), data, static_cast<size_t>(size));
             }
             else assert(0);
         }
@@ -430,13 +431,15 @@ namespace vlb {
         return buffer;
     }
 
-    Application::Image Application::createImage(vk::Format imageFormat, vk::Extent3D imageExtent)
+    Application::Image Application::createImage(vk::Format imageFormat, vk::Extent3D imageExtent, uint32_t arrayLayers, vk::ImageViewType viewType,
+            MemoryAllocator::Tag tag)
     {
-        return createImage(this->device.get(), this->physicalDevice, imageFormat, imageExtent, this->commandPool.transfer.get(), this->queue.transfer);
+        return createImage(this->device.get(), this->physicalDevice, imageFormat, imageExtent, this->commandPool.transfer.get(), this->queue.transfer,
+                arrayLayers, viewType, std::move(tag));
     }
 
     Application::Image Application::createImage(vk::Device& device, vk::PhysicalDevice& physicalDevice, vk::Format imageFormat, vk::Extent3D imageExtent,
-            vk::CommandPool transferPool, vk::Queue transferQueue)
+            vk::CommandPool transferPool, vk::Queue transferQueue, uint32_t arrayLayers, vk::ImageViewType viewType, MemoryAllocator::Tag tag)
     {
         std::array<uint32_t, 3> queueFamilyIndices = {0, 1, 2}; // TODO: this might fail but ok for now
         Image image{};
@@ -446,7 +449,7 @@ namespace vlb {
                 .setFormat(imageFormat)
                 .setExtent(imageExtent)
                 .setMipLevels(1)
-                .setArrayLayers(1)
+                .setArrayLayers(arrayLayers)
                 .setSamples(vk::SampleCountFlagBits::e1)
                 .setTiling(vk::ImageTiling::eOptimal)
                 .setUsage(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eStorage)
@@ -455,19 +458,12 @@ namespace vlb {
                 .setQueueFamilyIndices(queueFamilyIndices)
                 );
 
-        auto memoryRequirements = device.getImageMemoryRequirements(image.handle.get());
-        vk::MemoryPropertyFlags memoryProperty = vk::MemoryPropertyFlagBits::eDeviceLocal;
-
-        image.memory = device.allocateMemoryUnique(
-                vk::MemoryAllocateInfo{}
-                .setAllocationSize(memoryRequirements.size)
-                .setMemoryTypeIndex(getMemoryType(physicalDevice, memoryRequirements, memoryProperty))
-                );
-        device.bindImageMemory(image.handle.get(), image.memory.get(), 0);
+        image.memory = MemoryAllocator::get(device, physicalDevice).allocate(image.handle.get(), vk::MemoryPropertyFlagBits::eDeviceLocal,
+                vk::ImageTiling::eOptimal, std::move(tag));
 
         image.imageView = device.createImageViewUnique(
                 vk::ImageViewCreateInfo{}
-                .setViewType(vk::ImageViewType::e2D)
+                .setViewType(viewType)
                 .setFormat(imageFormat)
                 .setSubresourceRange(
                     vk::ImageSubresourceRange{}
@@ -475,14 +471,14 @@ namespace vlb {
                     .setBaseMipLevel(0)
                     .setLevelCount(1)
                     .setBaseArrayLayer(0)
-                    .setLayerCount(1)
+                    .setLayerCount(arrayLayers)
                     )
                 .setImage(image.handle.get())
                 );
 
         vk::CommandBuffer cmd = recordCommandBuffer(device, transferPool);
         setImageLayout(cmd, image.handle.get(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
-                { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+                { vk::ImageAspectFlagBits::eColor, 0, 1, 0, arrayLayers });
         flushCommandBuffer(device, transferPool, cmd, transferQueue);
 
         return image;
@@ -535,6 +531,10 @@ namespace vlb {
         this->queue.graphics = this->device.get().getQueue(this->queueFamilyIndex.graphics, 0);
         this->queue.transfer = this->device.get().getQueue(this->queueFamilyIndex.transfer, 0);
         this->queue.compute  = this->device.get().getQueue(this->queueFamilyIndex.compute, 0);
+
+        Profiler::attach(this->device.get(), this->physicalDevice, this->queue.graphics, this->queueFamilyIndex.graphics, "graphics");
+        Profiler::attach(this->device.get(), this->physicalDevice, this->queue.transfer, this->queueFamilyIndex.transfer, "transfer");
+        Profiler::attach(this->device.get(), this->physicalDevice, this->queue.compute, this->queueFamilyIndex.compute, "compute");
     }
 
     Application::Application(bool isGraphical)
@@ -555,6 +555,15 @@ namespace vlb {
         getQueues();
     }
 
+    Application::~Application()
+    {
+        // blocks still referenced by leaked allocations outlive this, everything else goes with the device
+        PipelineCache::release(this->device.get());
+        Profiler::release(this->device.get());
+        SubmissionQueue::release(this->device.get());
+        MemoryAllocator::release(this->device.get());
+    }
+
     void Application::createInstance()
     {
         // https://github.com/KhronosGroup/Vulkan-Hpp#extensions--per-device-function-pointers
@@ -576,12 +585,13 @@ namespace vlb {
 #endif
     }
 
-    Application::ShaderBindingTable Application::createShaderBindingTable(vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount)
+    Application::ShaderBindingTable Application::createShaderBindingTable(vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount, std::string owner)
     {
-        return createShaderBindingTable(this->device.get(), this->physicalDevice, pipeline, missCount, hitCount);
+        return createShaderBindingTable(this->device.get(), this->physicalDevice, pipeline, missCount, hitCount, std::move(owner));
     }
 
-    Application::ShaderBindingTable Application::createShaderBindingTable(vk::Device& device, vk::PhysicalDevice& physicalDevice, vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount)
+    Application::ShaderBindingTable Application::createShaderBindingTable(vk::Device& device, vk::PhysicalDevice& physicalDevice, vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount,
+            std::string owner)
     {
         Application::ShaderBindingTable sbt{};
 
@@ -614,7 +624,7 @@ namespace vlb {
             | vk::MemoryPropertyFlagBits::eHostCoherent;
         const vk::DeviceSize          size = baseAlignment(groupSize) + baseAlignment(missCount * groupSize) + baseAlignment(hitCount * groupSize);
 
-        sbt.buffer = createBuffer(device, physicalDevice, size, usg, mem);
+        sbt.buffer = createBuffer(device, physicalDevice, size, usg, mem, nullptr, { MemoryAllocator::Category::eShaderBindingTable, std::move(owner) });
 
         sbt.strides.push_back(vk::StridedDeviceAddressRegionKHR{}
                 .setDeviceAddress(sbt.buffer.deviceAddress)
@@ -632,7 +642,7 @@ namespace vlb {
                 .setSize(baseAlignment(hitCount * groupSize))
                 );
 
-        uint8_t* dataPtr = reinterpret_cast<uint8_t*>(device.mapMemory(sbt.buffer.memory.get(), 0, groupCount * groupSize));
+        uint8_t* dataPtr = reinterpret_cast<uint8_t*>(sbt.buffer.memory.map());
         {
             const uint32_t handleSize = RTPipelineProperties.shaderGroupHandleSize;
             uint8_t* ptr{nullptr};
@@ -660,14 +670,15 @@ namespace vlb {
                 ptr += sbt.strides[2].stride;
             }
         }
-        device.unmapMemory(sbt.buffer.memory.get());
 
         return std::move(sbt);
     }
 
-    Application::Texture Application::bufferToImage(const Application::Buffer& buffer, const Application::Sampler& sampler, vk::Extent3D extent, uint32_t mipLevels)
+    Application::Texture Application::bufferToImage(const Application::Buffer& buffer, const Application::Sampler& sampler, vk::Extent3D extent, uint32_t mipLevels,
+            MemoryAllocator::Tag tag)
     {
-        return bufferToImage(this->device.get(), this->physicalDevice, this->commandPool.graphics.get(), this->queue.graphics, buffer, sampler, extent, mipLevels);
+        return bufferToImage(this->device.get(), this->physicalDevice, this->commandPool.graphics.get(), this->queue.graphics, buffer, sampler, extent, mipLevels,
+                std::move(tag));
     }
 
     Application::Texture Application::bufferToImage(
@@ -678,9 +689,28 @@ namespace vlb {
             const Application::Buffer& buffer,
             const Application::Sampler& sampler,
             vk::Extent3D extent,
-            uint32_t mipLevels)
+            uint32_t mipLevels,
+            MemoryAllocator::Tag tag)
+    {
+        Application::Texture texture = createTexture(device, physicalDevice, sampler, extent, mipLevels, std::move(tag));
+
+        auto blittingCmdBuffer = Application::recordCommandBuffer(device, graphicsCommandPool);
+        recordTextureUpload(blittingCmdBuffer, texture, buffer.handle.get(), 0, extent, mipLevels);
+        Application::flushCommandBuffer(device, graphicsCommandPool, blittingCmdBuffer, graphicsQueue);
+
+        return texture;
+    }
+
+    Application::Texture Application::createTexture(
+            vk::Device& device,
+            vk::PhysicalDevice& physicalDevice,
+            const Application::Sampler& sampler,
+            vk::Extent3D extent,
+            uint32_t mipLevels,
+            MemoryAllocator::Tag tag)
     {
         Application::Texture texture;
+        texture.mipLevels = mipLevels;
 
         std::array<uint32_t, 3> queueFamilyIndices = {0, 1, 2}; // TODO: this might fail but ok for now
 
@@ -700,32 +730,68 @@ namespace vlb {
                 .setExtent(extent)
                 );
 
-        auto memoryRequirements = device.getImageMemoryRequirements(texture.image.handle.get());
-        vk::MemoryPropertyFlags memoryProperty = vk::MemoryPropertyFlagBits::eDeviceLocal;
+        texture.image.memory = MemoryAllocator::get(device, physicalDevice).allocate(texture.image.handle.get(), vk::MemoryPropertyFlagBits::eDeviceLocal,
+                vk::ImageTiling::eOptimal, std::move(tag));
 
-        texture.image.memory = device.allocateMemoryUnique(
-                vk::MemoryAllocateInfo{}
-                .setAllocationSize(memoryRequirements.size)
-                .setMemoryTypeIndex(Application::getMemoryType(physicalDevice, memoryRequirements, memoryProperty))
+        texture.sampler = device.createSamplerUnique(
+                vk::SamplerCreateInfo{}
+                .setMagFilter(sampler.magFilter)
+                .setMinFilter(sampler.minFilter)
+                .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+                .setAddressModeU(sampler.addressModeU)
+                .setAddressModeV(sampler.addressModeV)
+                .setAddressModeW(sampler.addressModeW)
+                .setCompareOp(vk::CompareOp::eNever)
+                .setBorderColor(vk::BorderColor::eFloatOpaqueWhite)
+                .setMaxAnisotropy(1.0)
+                .setAnisotropyEnable(VK_FALSE)
+                .setMaxLod(static_cast<float>(mipLevels))
+                .setMaxAnisotropy(8.0f)
+                .setAnisotropyEnable(VK_TRUE));
+
+        texture.image.imageView = device.createImageViewUnique(
+                vk::ImageViewCreateInfo{}
+                .setImage(texture.image.handle.get())
+                .setViewType(vk::ImageViewType::e2D)
+                .setFormat(vk::Format::eB8G8R8A8Unorm)
+                .setComponents({ vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eA })
+                .setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 })
                 );
 
-        device.bindImageMemory(texture.image.handle.get(), texture.image.memory.get(), 0);
+        texture.image.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal; // TODO: change layout on go as member
 
-        auto blittingCmdBuffer = Application::recordCommandBuffer(device, graphicsCommandPool);
+        texture.descriptor
+            .setSampler(texture.sampler.get())
+            .setImageView(texture.image.imageView.get())
+            .setImageLayout(texture.image.imageLayout);
+
+        return texture;
+    }
+
+    void Application::recordTextureUpload(
+            vk::CommandBuffer cmd,
+            const Application::Texture& texture,
+            vk::Buffer buffer,
+            vk::DeviceSize bufferOffset,
+            vk::Extent3D extent,
+            uint32_t mipLevels)
+    {
+        vk::Image image = texture.image.handle.get();
 
-        Application::setImageLayout(blittingCmdBuffer, texture.image.handle.get(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+        Application::setImageLayout(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
                 { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
 
-        blittingCmdBuffer.copyBufferToImage(
-                buffer.handle.get(),
-                texture.image.handle.get(),
+        cmd.copyBufferToImage(
+                buffer,
+                image,
                 vk::ImageLayout::eTransferDstOptimal,
                 vk::BufferImageCopy{}
+                .setBufferOffset(bufferOffset)
                 .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 })
                 .setImageExtent(extent)
                 );
 
-        Application::setImageLayout(blittingCmdBuffer, texture.image.handle.get(), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
+        Application::setImageLayout(cmd, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
                 { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
 
         for (uint32_t lvl = 1; lvl < mipLevels; ++lvl)
@@ -742,53 +808,17 @@ namespace vlb {
                 .setSrcOffsets({ vk::Offset3D{}, getMipLevelOffset(lvl - 1) })
                 .setDstOffsets({ vk::Offset3D{}, getMipLevelOffset(lvl    ) });
 
-            Application::setImageLayout(blittingCmdBuffer, texture.image.handle.get(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+            Application::setImageLayout(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
                     { vk::ImageAspectFlagBits::eColor, lvl, 1, 0, 1 });
 
-            blittingCmdBuffer.blitImage(texture.image.handle.get(), vk::ImageLayout::eTransferSrcOptimal, texture.image.handle.get(), vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
+            cmd.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, 1, &imageBlit, vk::Filter::eLinear);
 
-            Application::setImageLayout(blittingCmdBuffer, texture.image.handle.get(), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
+            Application::setImageLayout(cmd, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal,
                     { vk::ImageAspectFlagBits::eColor, lvl, 1, 0, 1 });
         }
 
-        Application::setImageLayout(blittingCmdBuffer, texture.image.handle.get(), vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+        Application::setImageLayout(cmd, image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
                 { vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 });
-
-        Application::flushCommandBuffer(device, graphicsCommandPool, blittingCmdBuffer, graphicsQueue);
-
-        texture.sampler = device.createSamplerUnique(
-                vk::SamplerCreateInfo{}
-                .setMagFilter(sampler.magFilter)
-                .setMinFilter(sampler.minFilter)
-                .setMipmapMode(vk::SamplerMipmapMode::eLinear)
-                .setAddressModeU(sampler.addressModeU)
-                .setAddressModeV(sampler.addressModeV)
-                .setAddressModeW(sampler.addressModeW)
-                .setCompareOp(vk::CompareOp::eNever)
-                .setBorderColor(vk::BorderColor::eFloatOpaqueWhite)
-                .setMaxAnisotropy(1.0)
-                .setAnisotropyEnable(VK_FALSE)
-                .setMaxLod(static_cast<float>(mipLevels))
-                .setMaxAnisotropy(8.0f)
-                .setAnisotropyEnable(VK_TRUE));
-
-        texture.image.imageView = device.createImageViewUnique(
-                vk::ImageViewCreateInfo{}
-                .setImage(texture.image.handle.get())
-                .setViewType(vk::ImageViewType::e2D)
-                .setFormat(vk::Format::eB8G8R8A8Unorm)
-                .setComponents({ vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eA })
-                .setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 })
-                );
-
-        texture.image.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal; // TODO: change layout on go as member
-
-        texture.descriptor
-            .setSampler(texture.sampler.get())
-            .setImageView(texture.image.imageView.get())
-            .setImageLayout(texture.image.imageLayout);
-
-        return texture;
     }
 }
 
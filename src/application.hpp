@@ -11,11 +11,17 @@
 #define VULKAN_HPP_NO_NODISCARD_WARNINGS
 #include <vulkan/vulkan.hpp>
 
+#include "memory_allocator.hpp"
+#include "submission_queue.hpp"
+#include "pipeline_cache.hpp"
+#include "profiler.hpp"
+
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <memory>
 #include <cassert>
+#include <mutex>
 
 #define DEBUG
 
@@ -27,19 +33,19 @@ namespace vlb {
 
             struct Buffer
             {
-                vk::UniqueBuffer         handle;
-                vk::UniqueDeviceMemory   memory;
-                vk::DeviceAddress        deviceAddress;
-                vk::DeviceSize           size;
+                vk::UniqueBuffer            handle;
+                MemoryAllocator::Allocation memory; // bound at memory.getOffset()
+                vk::DeviceAddress           deviceAddress;
+                vk::DeviceSize              size;
             };
 
             struct Image
             {
-                vk::UniqueImage        handle;
-                vk::UniqueDeviceMemory memory;
-                vk::UniqueImageView    imageView;
+                vk::UniqueImage             handle;
+                MemoryAllocator::Allocation memory;
+                vk::UniqueImageView         imageView;
                 // TODO: make fully use of new member
-                vk::ImageLayout        imageLayout;
+                vk::ImageLayout             imageLayout;
             };
 
             struct Sampler
@@ -104,19 +110,22 @@ namespace vlb {
             vk::PhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
             uint32_t getMemoryType(const vk::MemoryRequirements& memoryRequirements, const vk::MemoryPropertyFlags& memoryProperties);
 
-            vk::CommandBuffer recordGraphicsCommandBuffer(vk::CommandBufferAllocateInfo info = {});
+            vk::CommandBuffer recordGraphicsCommandBuffer();
             void flushGraphicsCommandBuffer(vk::CommandBuffer& cmdBuffer);
-            vk::CommandBuffer recordTransferCommandBuffer(vk::CommandBufferAllocateInfo info = {});
+            vk::CommandBuffer recordTransferCommandBuffer();
             void flushTransferCommandBuffer(vk::CommandBuffer& cmdBuffer);
-            vk::CommandBuffer recordComputeCommandBuffer(vk::CommandBufferAllocateInfo info = {});
+            vk::CommandBuffer recordComputeCommandBuffer();
             void flushComputeCommandBuffer(vk::CommandBuffer& cmdBuffer);
 
-            Buffer                 createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data = nullptr);
-            Image                  createImage(vk::Format imageFormat, vk::Extent3D imageExtent);
+            Buffer                 createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProperty, const void* data = nullptr,
+                    MemoryAllocator::Tag tag = {});
+            Image                  createImage(vk::Format imageFormat, vk::Extent3D imageExtent, uint32_t arrayLayers = 1,
+                    vk::ImageViewType viewType = vk::ImageViewType::e2D, MemoryAllocator::Tag tag = {});
             vk::UniqueShaderModule createShaderModule(const std::string& filename);
-            ShaderBindingTable     createShaderBindingTable(vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount);
+            ShaderBindingTable     createShaderBindingTable(vk::Pipeline& pipeline, unsigned missCount, unsigned hitCount, std::string owner = {});
 
-            Application::Texture bufferToImage(const Application::Buffer& buffer, const Application::Sampler& sampler, vk::Extent3D extent, uint32_t mipLevels);
+            Application::Texture bufferToImage(const Application::Buffer& buffer, const Application::Sampler& sampler, vk::Extent3D extent, uint32_t mipLevels,
+                    MemoryAllocator::Tag tag = { MemoryAllocator::Category::eTexture });
 
         private:
 
@@ -143,7 +152,14 @@ namespace vlb {
                     vk::PipelineStageFlags srcStageMask = vk::PipelineStageFlagBits::eAllCommands,
                     vk::PipelineStageFlags dstStageMask = vk::PipelineStageFlagBits::eAllCommands);
 
-            static vk::CommandBuffer recordCommandBuffer(vk::Device device, vk::CommandPool commandPool, vk::CommandBufferAllocateInfo info = {});
+            // Queue submits and presents must not overlap, scenes load on worker threads.
+            // waitIdle() is device.waitIdle() with every queue locked.
+            static std::unique_lock<std::mutex> lockQueue(vk::Queue queue);
+            static void waitIdle(vk::Device device);
+
+            // Both go through SubmissionQueue: command buffers are recycled per pool and
+            // flushing waits on the queue's timeline instead of a fresh fence
+            static vk::CommandBuffer recordCommandBuffer(vk::Device device, vk::CommandPool commandPool);
             static void flushCommandBuffer(vk::Device& device, vk::CommandPool& commandPool, vk::CommandBuffer& cmdBuffer, vk::Queue queue);
 
             static Buffer createBuffer(
@@ -152,7 +168,8 @@ namespace vlb {
                     vk::DeviceSize size,
                     vk::BufferUsageFlags usage,
                     vk::MemoryPropertyFlags memoryProperty,
-                    const void* data = nullptr);
+                    const void* data = nullptr,
+                    MemoryAllocator::Tag tag = {}); // accounting, see MemoryAllocator::getReport()
 
             static Image createImage(
                     vk::Device& device,
@@ -160,7 +177,10 @@ namespace vlb {
                     vk::Format imageFormat,
                     vk::Extent3D imageExtent,
                     vk::CommandPool transferPool,
-                    vk::Queue transferQueue);
+                    vk::Queue transferQueue,
+                    uint32_t arrayLayers = 1,
+                    vk::ImageViewType viewType = vk::ImageViewType::e2D,
+                    MemoryAllocator::Tag tag = {});
 
             static vk::UniqueShaderModule createShaderModule(
                     vk::Device& device,
@@ -174,6 +194,26 @@ namespace vlb {
                     const Application::Buffer& buffer,
                     const Application::Sampler& sampler,
                     vk::Extent3D extent,
+                    uint32_t mipLevels,
+                    MemoryAllocator::Tag tag = { MemoryAllocator::Category::eTexture });
+
+            // bufferToImage() in two steps, so many textures can share one submission:
+            // createTexture() makes the image, view and sampler, recordTextureUpload() copies
+            // the texels at bufferOffset, blits the mip chain and leaves the image shader readable
+            static Application::Texture createTexture(
+                    vk::Device& device,
+                    vk::PhysicalDevice& physicalDevice,
+                    const Application::Sampler& sampler,
+                    vk::Extent3D extent,
+                    uint32_t mipLevels,
+                    MemoryAllocator::Tag tag = { MemoryAllocator::Category::eTexture });
+
+            static void recordTextureUpload(
+                    vk::CommandBuffer cmd,
+                    const Application::Texture& texture,
+                    vk::Buffer buffer,
+                    vk::DeviceSize bufferOffset,
+                    vk::Extent3D extent,
                     uint32_t mipLevels);
 
             static ShaderBindingTable createShaderBindingTable(
@@ -181,10 +221,12 @@ namespace vlb {
                     vk::PhysicalDevice& physicalDevice,
                     vk::Pipeline& pipeline,
                     unsigned missCount,
-                    unsigned hitCount);
+                    unsigned hitCount,
+                    std::string owner = {});
 
             Application(bool isGraphical = true);
             Application(const Application& other) = delete;
+            ~Application();
     };
 
 }
@@ -0,0 +1,31 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef BAKING_BACKEND_HPP
+#define BAKING_BACKEND_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vlb {
+
+    // Where LightBaker gets its coefficients from. The backend loads the asset in its
+    // constructor, LightBaker fits the probe grid to getBounds() and serializes the result.
+    class BakingBackend
+    {
+        public:
+            virtual ~BakingBackend() = default;
+
+            virtual const char*              getName() = 0;
+            virtual std::array<glm::vec3, 2> getBounds() = 0; // scene bounds, unused for image input
+            virtual void                     setProbePositions(const std::vector<glm::vec3>& positions) = 0;
+
+            // (lmax + 1)^2 RGB float coefficients per probe, probe after probe: the .vlbprobe data layout
+            virtual std::vector<uint8_t> bake() = 0;
+    };
+}
+
+#endif // BAKING_BACKEND_HPP
+
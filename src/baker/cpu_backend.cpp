@@ -0,0 +1,282 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "cpu_backend.hpp"
+#include "light_baker.hpp"
+#include "probe_integrator.hpp"
+#include "probe_volume.hpp"
+#include "sh_projector.hpp"
+#include "tqdm/tqdm.h"
+
+#include <cstring>
+#include <mutex>
+
+namespace vlb {
+
+    namespace {
+
+        constexpr float     PI       = 3.1415926538f; // sh_common.h
+        constexpr glm::vec3 lightPos = glm::vec3(1.0f, 10.0f, 1.0f); // env_map.rchit
+
+        // https://www.pcg-random.org, same hash and jitter as probe_sh.rgen
+        uint32_t pcg(uint32_t v)
+        {
+            uint32_t state = v * 747796405u + 2891336453u;
+            uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        glm::vec2 jitter(uint32_t probe, uint32_t stratum)
+        {
+            const uint32_t h = pcg(probe * 0x9e3779b9u ^ pcg(stratum));
+            return glm::vec2(float(h & 0xffffu), float(h >> 16u)) / 65536.0f;
+        }
+
+        float sRGB(float linear)
+        {
+            return linear < 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        }
+
+        int wrap(int i, int size, vk::SamplerAddressMode mode)
+        {
+            switch (mode)
+            {
+                case vk::SamplerAddressMode::eClampToEdge:
+                    return std::clamp(i, 0, size - 1);
+                case vk::SamplerAddressMode::eMirroredRepeat:
+                    {
+                        int period = 2 * size;
+                        int m      = ((i % period) + period) % period;
+                        return m < size ? m : period - 1 - m;
+                    }
+                default:
+                    return ((i % size) + size) % size;
+            }
+        }
+    }
+
+    CpuBackend::CpuBackend(CreateInfo& ci)
+        : assetName(ci.assetName)
+        , imageInput(!LightBaker::isScene(ci.assetName))
+        , lmax(ci.lmax)
+        , coeffCount(ProbeVolume::getCoeffsPerProbe(ci.lmax))
+        , strata((std::max(ci.strata, 1u) + STRATA_PER_INVOCATION - 1) / STRATA_PER_INVOCATION * STRATA_PER_INVOCATION)
+        , pool(ci.threadCount)
+    {
+        if (this->imageInput) return;
+
+        // headless: geometry and materials stay in host memory, no device is created
+        Profiler::Scope scope{"loadScene"};
+        this->scene = Scene{new Scene_t(this->assetName)};
+        this->scene
+            ->loadSamplers()
+            ->loadMaterials()
+            ->loadNodes()
+            ->buildBVH(this->pool.getThreadCount());
+    }
+
+    const char* CpuBackend::getName()
+    {
+        return "cpu";
+    }
+
+    std::array<glm::vec3, 2> CpuBackend::getBounds()
+    {
+        return this->imageInput ? std::array<glm::vec3, 2>{} : this->scene->getBounds();
+    }
+
+    void CpuBackend::setProbePositions(const std::vector<glm::vec3>& positions)
+    {
+        this->probePositions = positions;
+    }
+
+    glm::vec4 CpuBackend::sampleTexture(int texture, glm::vec2 uv)
+    {
+        const tinygltf::Image&     image   = this->scene->getTextureImage(texture);
+        const Application::Sampler sampler = this->scene->getTextureSampler(texture);
+
+        const int width  = image.width;
+        const int height = image.height;
+        if (image.image.empty() || width <= 0 || height <= 0) return glm::vec4(1.0f);
+
+        auto texel = [&](int x, int y) -> glm::vec4
+        {
+            x = wrap(x, width, sampler.addressModeU);
+            y = wrap(y, height, sampler.addressModeV);
+            const unsigned char* p = &image.image[(size_t(y) * width + x) * image.component];
+
+            glm::vec4 c(0.0f, 0.0f, 0.0f, 1.0f);
+            for (int i = 0; i < std::min(image.component, 4); ++i)
+            {
+                c[i] = p[i] / 255.0f;
+            }
+
+            // textures are uploaded as eB8G8R8A8Unorm, so shaders read red and blue swapped
+            return glm::vec4(c.b, c.g, c.r, c.a);
+        };
+
+        // hit shaders sample level 0
+        if (sampler.magFilter == vk::Filter::eNearest)
+        {
+            return texel(int(std::floor(uv.x * width)), int(std::floor(uv.y * height)));
+        }
+
+        const glm::vec2 st = uv * glm::vec2(width, height) - 0.5f;
+        const glm::vec2 f  = st - glm::floor(st);
+        const int x = int(std::floor(st.x));
+        const int y = int(std::floor(st.y));
+
+        return glm::mix(
+                glm::mix(texel(x, y),     texel(x + 1, y),     f.x),
+                glm::mix(texel(x, y + 1), texel(x + 1, y + 1), f.x),
+                f.y);
+    }
+
+    glm::vec4 CpuBackend::getBaseColor(const shader::Material& material, glm::vec2 uv)
+    {
+        glm::vec4 baseColor = glm::vec4(1.0f);
+        int textureIdx = int(material.textures.baseColor.index);
+        if (textureIdx != -1)
+        {
+            baseColor = sampleTexture(textureIdx, uv);
+        }
+        else if (material.factors.baseColor != glm::vec4(0.0f))
+        {
+            baseColor = material.factors.baseColor;
+        }
+        return baseColor;
+    }
+
+    // env_map.rchit on a hit; a miss is black, the baker binds no skybox for main.rmiss
+    glm::vec3 CpuBackend::trace(const Ray& ray)
+    {
+        const SceneBVH& bvh = this->scene->getBVH();
+
+        const Hit hit = bvh.closestHit(ray);
+        if (!hit.valid()) return glm::vec3(0.0f);
+
+        const Scene_t::CpuInstance& instance = this->scene->getCpuInstance(hit.instance);
+        const shader::Vertex& v0 = (*instance.vertices)[(*instance.indices)[3 * hit.primitive + 0]];
+        const shader::Vertex& v1 = (*instance.vertices)[(*instance.indices)[3 * hit.primitive + 1]];
+        const shader::Vertex& v2 = (*instance.vertices)[(*instance.indices)[3 * hit.primitive + 2]];
+
+        const glm::vec3 bc  = glm::vec3(1.0f - hit.barycentrics.x - hit.barycentrics.y, hit.barycentrics.x, hit.barycentrics.y);
+        const glm::vec3 nrm = v0.normal * bc.x + v1.normal * bc.y + v2.normal * bc.z;
+        const glm::vec2 uv  = v0.uv0 * bc.x + v1.uv0 * bc.y + v2.uv0 * bc.z;
+
+        const glm::vec3 hitPosition = ray.origin + ray.direction * hit.t;
+        const glm::vec3 hitNormal   = glm::normalize(instance.normalMatrix * nrm);
+
+        const glm::vec4 baseColor = getBaseColor(*instance.material, uv);
+
+        const glm::vec3 shadowRay = lightPos - hitPosition;
+        const glm::vec3 toLight   = glm::normalize(shadowRay);
+
+        float diffuse  = 0.0f;
+        float specular = 0.0f;
+
+        const float sDotN = std::max(glm::dot(toLight, hitNormal), 0.0f);
+
+        const float shadowBias = 0.005f;
+        bool inShadow = true;
+        if (sDotN != 0.0f)
+        {
+            inShadow = bvh.anyHit(Ray{ hitPosition + shadowBias * hitNormal, 0.0f, toLight, glm::length(shadowRay) });
+        }
+
+        if (!inShadow)
+        {
+            const float Cdiffuse = 0.5f;
+            diffuse = Cdiffuse * sDotN;
+
+            const float     Cspecular  = 0.5f;
+            const float     glossyness = 16.0f;
+            const glm::vec3 reflected  = glm::reflect(toLight, hitNormal);
+            specular = Cspecular * std::pow(std::max(glm::dot(reflected, ray.direction), 0.0f), glossyness);
+        }
+
+        const glm::vec4 color = baseColor * (diffuse + specular);
+        return glm::vec3(sRGB(color.r), sRGB(color.g), sRGB(color.b));
+    }
+
+    // probe_sh.rgen: jittered strata on the uniform sphere, traced along dir.xzy, projected on dir
+    void CpuBackend::bakeProbe(uint32_t probe, float* coeffs)
+    {
+        Profiler::Scope scope{"probe trace"};
+
+        const glm::vec3 origin = this->probePositions[probe];
+        const float     tmin   = 0.001f;
+        const float     tmax   = 10000.0f;
+        const float     weight = 4.0f * PI / float(this->strata * this->strata);
+
+        std::vector<double> sh(size_t(this->coeffCount) * 3, 0.0);
+        std::vector<float>  basis(this->coeffCount);
+
+        for (uint32_t y = 0; y < this->strata; ++y)
+        {
+            for (uint32_t x = 0; x < this->strata; ++x)
+            {
+                const glm::vec2 uv = (glm::vec2(x, y) + jitter(probe, y * this->strata + x)) / float(this->strata);
+
+                const float     theta = std::acos(1.0f - 2.0f * uv.y);
+                const float     phi   = 2.0f * PI * uv.x;
+                const float     r     = std::sin(theta);
+                const glm::vec3 dir   = glm::normalize(glm::vec3(r * std::cos(phi), r * std::sin(phi), std::cos(theta)));
+
+                const glm::vec3 color = trace(Ray{ origin, tmin, glm::vec3(dir.x, dir.z, dir.y), tmax });
+
+                SHProjector::evaluate(this->lmax, dir.x, dir.y, dir.z, basis.data());
+                for (uint32_t i = 0; i < this->coeffCount; ++i)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        sh[i * 3 + c] += double(basis[i]) * color[c] * weight;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < sh.size(); ++i)
+        {
+            coeffs[i] = float(sh[i]);
+        }
+    }
+
+    std::vector<uint8_t> CpuBackend::bake()
+    {
+        std::vector<float> coeffs{};
+
+        if (this->imageInput)
+        {
+            Profiler::Scope scope{"projection"};
+            SHProjector projector{SHProjector::CreateInfo{ this->lmax, this->pool.getThreadCount() }};
+            coeffs = projector.project(this->assetName);
+        }
+        else
+        {
+            const uint32_t probeCount = static_cast<uint32_t>(this->probePositions.size());
+            coeffs = std::vector<float>(size_t(probeCount) * this->coeffCount * 3);
+
+            tqdm bar;
+            bar.set_theme_circle();
+            bar.set_label("probes");
+
+            // every probe is summed by one worker in a fixed order, so scheduling never changes the result
+            std::mutex progressMutex;
+            uint32_t   finished = 0;
+            this->pool.parallelFor(probeCount, [&](uint32_t probe, uint32_t)
+            {
+                bakeProbe(probe, coeffs.data() + size_t(probe) * this->coeffCount * 3);
+
+                std::lock_guard<std::mutex> lock{progressMutex};
+                bar.progress(++finished, probeCount);
+            });
+
+            bar.finish();
+        }
+
+        std::vector<uint8_t> bytes(coeffs.size() * sizeof(float));
+        memcpy(bytes.data(), coeffs.data(), bytes.size());
+        return bytes;
+    }
+}
+
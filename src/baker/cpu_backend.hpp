@@ -0,0 +1,53 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef CPU_BACKEND_HPP
+#define CPU_BACKEND_HPP
+
+#include "scene_manager.hpp"
+#include "baking_backend.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace vlb {
+
+    // Bakes without a Vulkan device. Probes trace the same stratified directions as
+    // probe_sh.rgen against the scene BVH and shade hits like env_map.rchit; probes
+    // are spread over every core by a work-stealing pool. Image input is projected
+    // with SHProjector.
+    class CpuBackend : public BakingBackend
+    {
+        public:
+            struct CreateInfo
+            {
+                std::string assetName;
+                uint32_t    lmax        = 3u;
+                uint32_t    strata      = 64u; // rounded up like ProbeIntegrator::setStrata()
+                uint32_t    threadCount = 0u;  // 0 uses every hardware thread
+            };
+
+        private:
+            std::string            assetName;
+            bool                   imageInput;
+            uint32_t               lmax;
+            uint32_t               coeffCount;
+            uint32_t               strata;
+            Scene                  scene;
+            WorkStealingPool       pool;
+            std::vector<glm::vec3> probePositions;
+
+            glm::vec3 trace(const Ray& ray);
+            glm::vec4 getBaseColor(const shader::Material& material, glm::vec2 uv);
+            glm::vec4 sampleTexture(int texture, glm::vec2 uv);
+            void      bakeProbe(uint32_t probe, float* coeffs);
+
+        public:
+            CpuBackend(CreateInfo& ci);
+
+            const char*              getName() override;
+            std::array<glm::vec3, 2> getBounds() override;
+            void                     setProbePositions(const std::vector<glm::vec3>& positions) override;
+            std::vector<uint8_t>     bake() override;
+    };
+}
+
+#endif // CPU_BACKEND_HPP
+
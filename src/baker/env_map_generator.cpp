@@ -27,6 +27,35 @@ namespace vlb {
         this->envMapExtent = vk::Extent3D{static_cast<uint32_t>(pi * static_cast<float>(radius) * 2.f), radius * 2, 1};
     }
 
+    void EnvMapGenerator::setBatchSize(uint32_t batchSize)
+    {
+        this->batchSize = std::max(batchSize, 1u);
+    }
+
+    uint32_t EnvMapGenerator::getBatchSize()
+    {
+        return this->batchSize;
+    }
+
+    void EnvMapGenerator::setProbePositions(const std::vector<glm::vec3>& positions)
+    {
+        // std430 pads vec3 array elements to 16 bytes
+        std::vector<glm::vec4> padded(positions.size());
+        for (size_t i{}; i < positions.size(); ++i)
+        {
+            padded[i] = glm::vec4(positions[i], 1.0f);
+        }
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        vk::BufferUsageFlags    usg{ eStorageBuffer };
+        vk::MemoryPropertyFlags mem{ eHostVisible | eHostCoherent };
+
+        this->probePositions = Application::createBuffer(this->device, this->physicalDevice, padded.size() * sizeof(glm::vec4), usg, mem, padded.data(),
+                { MemoryAllocator::Category::eOther, "baker" });
+        updateProbesDescriptorSet();
+    }
+
     void EnvMapGenerator::passVulkanResources(VulkanResources& info)
     {
         this->device               = info.device;
@@ -70,7 +99,7 @@ namespace vlb {
         return this->envMapExtent;
     }
 
-    void EnvMapGenerator::saveImage(const std::string& imageName)
+    void EnvMapGenerator::saveImage(const std::string& imageName, uint32_t layer)
     {
         using enum vk::BufferUsageFlagBits;
         using enum vk::MemoryPropertyFlagBits;
@@ -78,18 +107,19 @@ namespace vlb {
         vk::MemoryPropertyFlags mem  = eHostVisible | eHostCoherent;
         vk::DeviceSize          size = static_cast<vk::DeviceSize>(this->envMapExtent.width * this->envMapExtent.height * 4);
 
-        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem);
+        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, nullptr,
+                { MemoryAllocator::Category::eStaging, "baker" });
 
         auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.transfer);
 
         Application::setImageLayout(cmd, this->envMap.handle.get(), vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal,
-                { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+                { vk::ImageAspectFlagBits::eColor, 0, 1, layer, 1 });
 
         vk::ImageSubresourceLayers layers{};
         layers
             .setAspectMask(vk::ImageAspectFlagBits::eColor)
             .setMipLevel(0)
-            .setBaseArrayLayer(0)
+            .setBaseArrayLayer(layer)
             .setLayerCount(1);
 
         vk::BufferImageCopy region{};
@@ -102,19 +132,39 @@ namespace vlb {
         cmd.copyImageToBuffer(this->envMap.handle.get(), vk::ImageLayout::eTransferSrcOptimal, staging.handle.get(), 1, &region);
 
         Application::setImageLayout(cmd, this->envMap.handle.get(), vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral,
-                { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+                { vk::ImageAspectFlagBits::eColor, 0, 1, layer, 1 });
 
         Application::flushCommandBuffer(this->device, this->commandPool.transfer, cmd, this->queue.transfer);
 
-        void* dataPtr = this->device.mapMemory(staging.memory.get(), 0, size);
+        void* dataPtr = staging.memory.map();
         stbi_write_png(imageName.c_str(), this->envMapExtent.width, this->envMapExtent.height, 4, (void*)dataPtr, this->envMapExtent.width * 4);
-        device.unmapMemory(staging.memory.get());
+    }
+
+    void EnvMapGenerator::recordCopy(vk::CommandBuffer cmd, uint32_t layer, vk::Buffer dst)
+    {
+        vk::ImageSubresourceLayers layers{};
+        layers
+            .setAspectMask(vk::ImageAspectFlagBits::eColor)
+            .setMipLevel(0)
+            .setBaseArrayLayer(layer)
+            .setLayerCount(1);
+
+        vk::BufferImageCopy region{};
+        region
+            .setBufferOffset(0)
+            .setImageOffset(vk::Offset3D{})
+            .setImageExtent(this->envMapExtent)
+            .setImageSubresource(layers);
+
+        // the map stays in eGeneral, which is a valid copy source
+        cmd.copyImageToBuffer(this->envMap.handle.get(), vk::ImageLayout::eGeneral, dst, 1, &region);
     }
 
     Application::Image& EnvMapGenerator::createImage()
     {
         this->envMap = Application::createImage(this->device, this->physicalDevice, this->envMapFormat, envMapExtent,
-                this->commandPool.transfer, this->queue.transfer);
+                this->commandPool.transfer, this->queue.transfer, this->batchSize, vk::ImageViewType::e2DArray,
+                { MemoryAllocator::Category::eTexture, "baker" });
         updateImageDescriptorSet();
         return this->envMap;
     }
@@ -124,8 +174,10 @@ namespace vlb {
         unsigned char* texels = nullptr;
         loadDebugMapFromPNG(filename, &texels);
 
+        this->batchSize = 1u;
         this->envMap = Application::createImage(this->device, this->physicalDevice, this->envMapFormat, this->envMapExtent,
-                this->commandPool.transfer, this->queue.transfer);
+                this->commandPool.transfer, this->queue.transfer, this->batchSize, vk::ImageViewType::e2DArray,
+                { MemoryAllocator::Category::eTexture, "baker" });
 
         using enum vk::BufferUsageFlagBits;
         using enum vk::MemoryPropertyFlagBits;
@@ -133,7 +185,8 @@ namespace vlb {
         vk::MemoryPropertyFlags mem  = eHostVisible | eHostCoherent;
         vk::DeviceSize          size = static_cast<vk::DeviceSize>(this->envMapExtent.width * this->envMapExtent.height * 4);
 
-        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, texels);
+        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, texels,
+                { MemoryAllocator::Category::eStaging, "baker" });
 
         auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.transfer);
 
@@ -173,7 +226,7 @@ namespace vlb {
             {vk::DescriptorType::eAccelerationStructureKHR, 1},
             {vk::DescriptorType::eStorageImage, 1},
             {vk::DescriptorType::eUniformBuffer, 1},
-            {vk::DescriptorType::eStorageBuffer, 2},
+            {vk::DescriptorType::eStorageBuffer, 4},
             {vk::DescriptorType::eCombinedImageSampler, 1000}
         };
 
@@ -186,16 +239,22 @@ namespace vlb {
                 );
 
         // LAYOUT
-        vk::DescriptorSetLayoutBinding resultImageLayoutBinding{};
-        resultImageLayoutBinding
+        std::vector<vk::DescriptorSetLayoutBinding> imageLayoutBindings{
+            vk::DescriptorSetLayoutBinding{}
             .setBinding(0)
-            .setDescriptorType(vk::DescriptorType::eStorageImage)
-            .setDescriptorCount(1)
-            .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR),
+                vk::DescriptorSetLayoutBinding{}
+            .setBinding(1)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR)
+        };
 
         this->imageLayout = this->device.createDescriptorSetLayoutUnique(
                 vk::DescriptorSetLayoutCreateInfo{}
-                .setBindings(resultImageLayoutBinding)
+                .setBindings(imageLayoutBindings)
                 );
         auto sceneLayout = this->scene->getDescriptorSetLayout();
 
@@ -213,7 +272,7 @@ namespace vlb {
 
         // PIPELINE LAYOUT
         const std::vector<vk::PushConstantRange> pushConstants{
-            { vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(glm::vec3) }
+            { vk::ShaderStageFlagBits::eRaygenKHR, 0, 2 * sizeof(uint32_t) }
         };
         const std::array<vk::DescriptorSetLayout, 2> layouts { sceneLayout, imageLayout.get()};
 
@@ -281,7 +340,7 @@ namespace vlb {
                 .setClosestHitShader(StageIndices::eClosestHit)
                 );
 
-        auto[result, p] = this->device.createRayTracingPipelineKHRUnique(nullptr, nullptr,
+        auto[result, p] = this->device.createRayTracingPipelineKHRUnique(nullptr, PipelineCache::get(this->device, this->physicalDevice),
                 vk::RayTracingPipelineCreateInfoKHR{}
                 .setStages(shaderStages)
                 .setGroups(shaderGroups)
@@ -314,17 +373,32 @@ namespace vlb {
                 nullptr);
     }
 
+    void EnvMapGenerator::updateProbesDescriptorSet()
+    {
+        this->device.updateDescriptorSets(
+                vk::WriteDescriptorSet{}
+                .setDstSet(this->imageDS.get())
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDstBinding(1)
+                .setBufferInfo(
+                    vk::DescriptorBufferInfo{}
+                    .setBuffer(this->probePositions.handle.get())
+                    .setRange(VK_WHOLE_SIZE)
+                    ),
+                nullptr);
+    }
+
     void EnvMapGenerator::setupVukanRaytracing()
     {
         createRayTracingPipeline();
         this->scene->updateSceneDescriptorSets(this->sceneDS.get());
 
-        this->sbt = Application::createShaderBindingTable(this->device, this->physicalDevice, this->pipeline.get(), 2u, 1u);
+        this->sbt = Application::createShaderBindingTable(this->device, this->physicalDevice, this->pipeline.get(), 2u, 1u, "baker");
     }
 
-    void EnvMapGenerator::getMap(glm::vec3 position)
+    void EnvMapGenerator::recordMaps(vk::CommandBuffer cmd, uint32_t firstProbe, uint32_t count, uint32_t firstLayer)
     {
-        auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.graphics);
+        assert(firstLayer + count <= this->batchSize);
 
         cmd.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, this->pipeline.get());
 
@@ -340,22 +414,28 @@ namespace vlb {
                 nullptr
                 );
 
+        std::array<uint32_t, 2> offsets{ firstProbe, firstLayer };
         cmd.pushConstants(
                 this->pipelineLayout.get(),
                 vk::ShaderStageFlagBits::eRaygenKHR,
-                0, sizeof(glm::vec3), &position
+                0, sizeof(offsets), offsets.data()
                 );
 
+        // One launch layer per probe: gl_LaunchIDEXT.z selects both the probe and the image layer
         auto[width, height, depth] = this->envMapExtent;
         cmd.traceRaysKHR(
                 this->sbt.strides[0],
                 this->sbt.strides[1],
                 this->sbt.strides[2],
                 {},
-                width, height, depth
+                width, height, count
                 );
+    }
 
+    void EnvMapGenerator::getMaps(uint32_t firstProbe, uint32_t count)
+    {
+        auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.graphics);
+        recordMaps(cmd, firstProbe, count);
         Application::flushCommandBuffer(this->device, this->commandPool.graphics, cmd, this->queue.graphics);
     }
 }
-
@@ -38,6 +38,8 @@ namespace vlb {
             Application::Image  envMap;
             vk::Format          envMapFormat = vk::Format::eR8G8B8A8Unorm;
             vk::Extent3D        envMapExtent;
+            uint32_t            batchSize = 1u;
+            Application::Buffer probePositions;
 
             vk::UniqueDescriptorPool      descriptorPool;
             vk::UniqueDescriptorSet       sceneDS;
@@ -50,6 +52,7 @@ namespace vlb {
 
             void createRayTracingPipeline();
             void updateImageDescriptorSet();
+            void updateProbesDescriptorSet();
 
         public:
             EnvMapGenerator();
@@ -57,15 +60,20 @@ namespace vlb {
 
             void                setScene(Scene&& scene);
             void                setEnvShpereRadius(uint32_t radius);
+            void                setBatchSize(uint32_t batchSize);
+            void                setProbePositions(const std::vector<glm::vec3>& positions);
             void                passVulkanResources(VulkanResources& info);
             void                setupVukanRaytracing();
-            void                getMap(glm::vec3 position);
+            void                recordMaps(vk::CommandBuffer cmd, uint32_t firstProbe, uint32_t count, uint32_t firstLayer = 0);
+            void                getMaps(uint32_t firstProbe, uint32_t count);
             void                loadDebugMapFromPNG(const char* filename, unsigned char** texels);
             Application::Image& createImage();
             Application::Image& createImage(const char* filename);
             Application::Image& getImage();
             vk::Extent3D        getImageExtent();
-            void                saveImage(const std::string& imageName);
+            uint32_t            getBatchSize();
+            void                saveImage(const std::string& imageName, uint32_t layer = 0);
+            void                recordCopy(vk::CommandBuffer cmd, uint32_t layer, vk::Buffer dst);
     };
 }
 
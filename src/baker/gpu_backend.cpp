@@ -0,0 +1,517 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "gpu_backend.hpp"
+#include "light_baker.hpp"
+#include "tqdm/tqdm.h"
+
+namespace vlb {
+
+    GpuBackend::GpuBackend(CreateInfo& ci)
+        : settings(ci)
+    {
+        const std::string& assetName = ci.assetName;
+
+        this->lmax       = ci.lmax;
+        this->coeffCount = ProbeVolume::getCoeffsPerProbe(ci.lmax);
+
+        auto vulkanContext = EnvMapGenerator::VulkanResources
+        {
+            this->physicalDevice,
+                this->device.get(),
+                this->queue.transfer,
+                this->commandPool.transfer.get(),
+                this->queue.graphics,
+                this->commandPool.graphics.get(),
+        };
+
+        this->envMapGenerator.passVulkanResources(vulkanContext);
+
+        if (LightBaker::isScene(assetName))
+        {
+            this->imageInput = false;
+
+            auto sceneManagerVulkanContext = Scene_t::VulkanResources
+            {
+                this->physicalDevice,
+                    this->device.get(),
+                    this->queue.transfer,
+                    this->commandPool.transfer.get(),
+                    this->queue.graphics,
+                    this->commandPool.graphics.get(),
+                    this->queue.compute,
+                    this->commandPool.compute.get(),
+                    static_cast<uint32_t>(1),
+                    this->queueFamilyIndex.transfer,
+                    this->queueFamilyIndex.graphics,
+                    this->queueFamilyIndex.compute
+            };
+
+            SceneManager sceneManager{};
+            sceneManager.passVulkanResources(sceneManagerVulkanContext);
+            std::string path = assetName;
+            sceneManager.pushScene(path);
+            sceneManager.finishLoading();
+            sceneManager.setSceneIndex(0);
+            this->scene  = sceneManager.getScene();
+            this->bounds = this->scene->getBounds();
+        }
+        else
+        {
+            this->imageInput        = true;
+            this->directIntegration = false;
+            this->batchSize         = 1u;
+            this->inFlight          = 1u;
+            this->envMapGenerator.createImage(assetName.c_str());
+        }
+    }
+
+    GpuBackend::~GpuBackend()
+    {
+    }
+
+    const char* GpuBackend::getName()
+    {
+        return "gpu";
+    }
+
+    std::array<glm::vec3, 2> GpuBackend::getBounds()
+    {
+        return this->bounds;
+    }
+
+    void GpuBackend::setProbePositions(const std::vector<glm::vec3>& positions)
+    {
+        this->probeCount = static_cast<uint32_t>(positions.size());
+
+        if (!this->imageInput)
+        {
+            const CreateInfo& ci = this->settings;
+
+            this->directIntegration = !ci.envMaps;
+            this->batchSize = std::max(std::min(ci.batchSize, this->probeCount), 1u);
+            this->inFlight  = std::max(std::min(ci.inFlight, (this->probeCount + this->batchSize - 1) / this->batchSize), 1u);
+
+            if (this->directIntegration)
+            {
+                auto integratorContext = ProbeIntegrator::VulkanResources
+                {
+                    this->physicalDevice,
+                        this->device.get(),
+                        this->queue.graphics,
+                        this->commandPool.graphics.get(),
+                };
+
+                this->probeIntegrator.passVulkanResources(integratorContext);
+                this->probeIntegrator.setScene(std::move(this->scene));
+                this->probeIntegrator.setStrata(ci.strata);
+                this->probeIntegrator.setLmax(this->lmax);
+                this->probeIntegrator.setBatchSize(this->batchSize * this->inFlight);
+                this->probeIntegrator.setupVukanRaytracing();
+                this->probeIntegrator.setProbePositions(positions);
+            }
+            else
+            {
+                auto maxLayers = this->physicalDevice.getProperties().limits.maxImageArrayLayers;
+                this->batchSize = std::max(std::min(this->batchSize, maxLayers / this->inFlight), 1u);
+
+                this->envMapGenerator.setScene(std::move(this->scene));
+                this->envMapGenerator.setupVukanRaytracing();
+                this->envMapGenerator.setProbePositions(positions);
+
+                this->envMapGenerator.setEnvShpereRadius(500u);
+                this->envMapGenerator.setBatchSize(this->batchSize * this->inFlight);
+                this->envMapGenerator.createImage();
+            }
+        }
+
+        if (this->settings.dumpEnvMaps)
+        {
+            if (this->directIntegration)
+            {
+                throw std::runtime_error("--dump-env-maps requires --env-maps");
+            }
+
+            // enough staging buffers for every in-flight layer, so acquiring never waits on an unretired slot
+            auto dumperInfo = ImageDumper::CreateInfo
+            {
+                this->physicalDevice,
+                    this->device.get(),
+                    this->envMapGenerator.getImageExtent(),
+                    std::max(std::thread::hardware_concurrency() / 2, 1u),
+                    this->batchSize * this->inFlight,
+                    this->settings.dumpFilter
+            };
+
+            this->dumper = std::make_unique<ImageDumper>(dumperInfo);
+        }
+    }
+
+    vk::UniquePipeline GpuBackend::createComputePipeline(const std::string& shaderPath)
+    {
+        vk::UniqueShaderModule shaderModule = Application::createShaderModule(shaderPath);
+
+        // SH_LMAX in sh_common.h, so the band loops unroll; sh_reduce.comp ignores it
+        const vk::SpecializationMapEntry lmaxEntry{ 0, 0, sizeof(uint32_t) };
+        const vk::SpecializationInfo     specialization{ 1, &lmaxEntry, sizeof(this->lmax), &this->lmax };
+
+        vk::PipelineShaderStageCreateInfo shaderStageCreateInfo{};
+        shaderStageCreateInfo
+            .setStage(vk::ShaderStageFlagBits::eCompute)
+            .setModule(shaderModule.get())
+            .setPName("main")
+            .setPSpecializationInfo(&specialization);
+
+        auto[result, p] = this->device.get().createComputePipelineUnique(
+                PipelineCache::get(this->device.get(), this->physicalDevice),
+                vk::ComputePipelineCreateInfo{}
+                .setStage(shaderStageCreateInfo)
+                .setLayout(this->pipelineLayout.get()));
+
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to create compute pipeline");
+        }
+
+        return std::move(p);
+    }
+
+    void GpuBackend::createBakingPipeline()
+    {
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+
+        if (this->directIntegration)
+        {
+            this->groupCount = this->probeIntegrator.getPartialsPerProbe();
+        }
+        else
+        {
+            vk::Extent3D extent = this->envMapGenerator.getImageExtent();
+            pushConstants.width  = extent.width;
+            pushConstants.height = extent.height;
+
+            this->groupCount = static_cast<uint32_t>(ceil(extent.width / float(WORKGROUP_SIZE)) * ceil(extent.height / float(WORKGROUP_SIZE)));
+        }
+
+        const uint32_t layerCount = this->batchSize * this->inFlight;
+
+        const MemoryAllocator::Tag tag{ MemoryAllocator::Category::eSHProbes, "baker" };
+        this->SHCoeffs   = createBuffer(layerCount * this->coeffCount * sizeof(glm::vec3), eStorageBuffer, eHostVisible | eHostCoherent, nullptr, tag);
+        this->SHPartials = createBuffer(layerCount * this->groupCount * this->coeffCount * sizeof(glm::vec3), eStorageBuffer, eDeviceLocal, nullptr, tag);
+
+        // stays mapped for the whole bake, slots read their own range
+        this->mappedCoeffs = this->SHCoeffs.memory.map();
+
+        // POOL
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            {vk::DescriptorType::eStorageBuffer, 2},
+            {vk::DescriptorType::eStorageImage, 1}
+        };
+
+        this->descriptorPool = this->device.get().createDescriptorPoolUnique(
+                vk::DescriptorPoolCreateInfo{}
+                .setPoolSizes(poolSizes)
+                .setMaxSets(1)
+                .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet
+                    | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+                );
+
+        // LAYOUT
+        std::vector<vk::DescriptorSetLayoutBinding> dsLayoutBinding(0);
+        dsLayoutBinding.push_back(vk::DescriptorSetLayoutBinding{}
+                .setBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+                );
+        dsLayoutBinding.push_back(vk::DescriptorSetLayoutBinding{}
+                .setBinding(1)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+                );
+        dsLayoutBinding.push_back(vk::DescriptorSetLayoutBinding{}
+                .setBinding(2)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+                );
+
+        this->descriptorSetLayout = this->device.get().createDescriptorSetLayoutUnique(
+                vk::DescriptorSetLayoutCreateInfo{}
+                .setBindings(dsLayoutBinding)
+                );
+
+        // DESCRIPOR
+        this->descriptorSet = std::move(this->device.get().allocateDescriptorSetsUnique(
+                    vk::DescriptorSetAllocateInfo{}
+                    .setDescriptorPool(this->descriptorPool.get())
+                    .setSetLayouts(this->descriptorSetLayout.get())
+                    ).front());
+
+        // WRITE
+        if (this->directIntegration)
+        {
+            // raygen writes partials itself, binding 0 stays unused
+            this->probeIntegrator.setPartialsBuffer(this->SHPartials);
+        }
+        else
+        {
+            Image& image = this->envMapGenerator.getImage();
+            vk::DescriptorImageInfo imageInfo{};
+            imageInfo
+                .setImageView(image.imageView.get())
+                .setImageLayout(vk::ImageLayout::eGeneral);
+
+            vk::WriteDescriptorSet writeImage{};
+            writeImage
+                .setDstSet(this->descriptorSet.get())
+                .setDstBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setImageInfo(imageInfo);
+
+            this->device.get().updateDescriptorSets(writeImage, nullptr);
+        }
+
+        std::array<vk::DescriptorBufferInfo, 2> bufferInfos{
+            vk::DescriptorBufferInfo{ SHCoeffs.handle.get(), 0, SHCoeffs.size },
+            vk::DescriptorBufferInfo{ SHPartials.handle.get(), 0, SHPartials.size }
+        };
+
+        for (uint32_t i = 0; i < bufferInfos.size(); ++i)
+        {
+            vk::WriteDescriptorSet writeBuffer{};
+            writeBuffer
+                .setDstSet(this->descriptorSet.get())
+                .setDstBinding(i + 1)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setBufferInfo(bufferInfos[i]);
+
+            this->device.get().updateDescriptorSets(writeBuffer, nullptr);
+        }
+
+        // PIPELINE LAYOUT
+        // sh.comp pushes {width, height, layerOffset}, sh_reduce.comp pushes its own three words
+        vk::PushConstantRange pcRange{};
+        pcRange
+            .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+            .setOffset(0)
+            .setSize(sizeof(this->pushConstants));
+
+        this->pipelineLayout = this->device.get().createPipelineLayoutUnique(
+                vk::PipelineLayoutCreateInfo{}
+                .setSetLayouts(this->descriptorSetLayout.get())
+                .setPushConstantRanges(pcRange)
+                );
+
+        // PIPELINE
+        this->pipeline       = createComputePipeline("shaders/sh.comp.spv");
+        this->reducePipeline = createComputePipeline("shaders/sh_reduce.comp.spv");
+    }
+
+    void GpuBackend::recordBakingKernel(vk::CommandBuffer cmd, uint32_t probeCount, uint32_t firstLayer)
+    {
+        vk::MemoryBarrier barrier{};
+        barrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                this->pipelineLayout.get(),
+                0,
+                { this->descriptorSet.get() },
+                {});
+
+        // Per-workgroup partial sums (direct integration gets them from raygen)...
+        if (!this->directIntegration)
+        {
+            this->pushConstants.layerOffset = firstLayer;
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, this->pipeline.get());
+            cmd.pushConstants(
+                    this->pipelineLayout.get(),
+                    vk::ShaderStageFlagBits::eCompute,
+                    0, sizeof(this->pushConstants), &(this->pushConstants)
+                    );
+            cmd.dispatch((uint32_t)ceil(this->pushConstants.width / float(WORKGROUP_SIZE)), (uint32_t)ceil(this->pushConstants.height / float(WORKGROUP_SIZE)), probeCount);
+
+            barrier
+                .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+        }
+
+        // ...are summed in a fixed order, so every run gives the same bits
+        std::array<uint32_t, 3> reduceConstants{ this->groupCount, firstLayer, this->coeffCount };
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, this->reducePipeline.get());
+        cmd.pushConstants(
+                this->pipelineLayout.get(),
+                vk::ShaderStageFlagBits::eCompute,
+                0, sizeof(reduceConstants), reduceConstants.data()
+                );
+        cmd.dispatch(this->coeffCount, probeCount, 1u);
+
+        barrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+    }
+
+    void GpuBackend::submitSlot(Slot& slot, uint32_t firstProbe, uint32_t probeCount)
+    {
+        slot.firstProbe    = firstProbe;
+        slot.probeCount    = probeCount;
+        slot.timelineValue = ++this->timelineValue;
+
+        vk::CommandBuffer cmd = slot.cmd.get();
+        cmd.reset();
+        cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        // Trace and projection of the whole batch share one submission
+        if (this->directIntegration)
+        {
+            Profiler::GpuScope gpuScope{cmd, this->queue.graphics, "probe trace"};
+            this->probeIntegrator.recordProbes(cmd, firstProbe, probeCount, slot.firstLayer);
+        }
+        else if (!this->imageInput)
+        {
+            Profiler::GpuScope gpuScope{cmd, this->queue.graphics, "env map trace"};
+            this->envMapGenerator.recordMaps(cmd, firstProbe, probeCount, slot.firstLayer);
+        }
+
+        if (this->dumper)
+        {
+            vk::MemoryBarrier barrier{};
+            barrier
+                .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eTransfer, {}, barrier, {}, {});
+
+            for (uint32_t i = 0; i < probeCount; ++i)
+            {
+                if (!this->dumper->isSelected(firstProbe + i)) continue;
+
+                auto staging = this->dumper->acquire();
+                this->envMapGenerator.recordCopy(cmd, slot.firstLayer + i, staging->buffer.handle.get());
+                slot.dumps.push_back({staging, firstProbe + i});
+            }
+
+            barrier
+                .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+        }
+
+        {
+            Profiler::GpuScope gpuScope{cmd, this->queue.graphics, "projection"};
+            recordBakingKernel(cmd, probeCount, slot.firstLayer);
+        }
+
+        cmd.end();
+
+        vk::Semaphore timeline = this->timeline.get();
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.setSignalSemaphoreValues(slot.timelineValue);
+
+        auto lock = lockQueue(this->queue.graphics);
+        this->queue.graphics.submit(
+                vk::SubmitInfo{}
+                .setCommandBuffers(cmd)
+                .setSignalSemaphores(timeline)
+                .setPNext(&timelineInfo),
+                nullptr);
+    }
+
+    void GpuBackend::retireSlot(Slot& slot)
+    {
+        {
+            Profiler::Scope scope{"wait for slot"};
+
+            vk::Semaphore timeline = this->timeline.get();
+            auto result = this->device.get().waitSemaphores(
+                    vk::SemaphoreWaitInfo{}
+                    .setSemaphores(timeline)
+                    .setValues(slot.timelineValue),
+                    std::numeric_limits<uint64_t>::max());
+
+            if (result != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("failed to wait for baking slot");
+            }
+        }
+        Profiler::collect();
+
+        Profiler::Scope scope{"readback"};
+
+        // PNG encoding happens on the dumper threads
+        for (auto [staging, probe] : slot.dumps)
+        {
+            this->dumper->write(staging, std::to_string(probe) + ".png");
+        }
+        slot.dumps.clear();
+
+        const size_t probeBytes = this->coeffCount * sizeof(glm::vec3);
+        memcpy(this->coeffs.data() + slot.firstProbe * probeBytes,
+                static_cast<uint8_t*>(this->mappedCoeffs) + slot.firstLayer * probeBytes,
+                slot.probeCount * probeBytes);
+
+        slot.probeCount = 0;
+    }
+
+    std::vector<uint8_t> GpuBackend::bake()
+    {
+        createBakingPipeline();
+
+        vk::SemaphoreTypeCreateInfo timelineInfo{ vk::SemaphoreType::eTimeline, this->timelineValue };
+        this->timeline = this->device.get().createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&timelineInfo));
+
+        auto cmds = this->device.get().allocateCommandBuffersUnique(
+                vk::CommandBufferAllocateInfo(this->commandPool.graphics.get(), vk::CommandBufferLevel::ePrimary, this->inFlight));
+
+        this->slots = std::vector<Slot>(this->inFlight);
+        for (uint32_t i = 0; i < this->inFlight; ++i)
+        {
+            this->slots[i].cmd        = std::move(cmds[i]);
+            this->slots[i].firstLayer = i * this->batchSize;
+        }
+
+        tqdm bar;
+        bar.set_theme_circle();
+        bar.set_label("probes");
+
+        this->coeffs = std::vector<uint8_t>(size_t(this->probeCount) * this->coeffCount * sizeof(glm::vec3));
+
+        // Slots are reused round-robin: while the CPU reads back one slot
+        // the GPU keeps working on the other inFlight - 1 submissions
+        const uint32_t probeCount = this->probeCount;
+        uint32_t submitted = 0;
+        uint32_t retired   = 0;
+        for (size_t i = 0; retired < probeCount; i = (i + 1) % this->slots.size())
+        {
+            Slot& slot = this->slots[i];
+
+            if (slot.probeCount)
+            {
+                retired += slot.probeCount;
+                retireSlot(slot);
+                bar.progress(retired, probeCount);
+            }
+
+            if (submitted < probeCount)
+            {
+                const uint32_t count = std::min(this->batchSize, probeCount - submitted);
+                submitSlot(slot, submitted, count);
+                submitted += count;
+            }
+        }
+
+        bar.finish();
+
+        this->mappedCoeffs = nullptr;
+        this->slots.clear();
+
+        return std::move(this->coeffs);
+    }
+
+}
@@ -0,0 +1,108 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef GPU_BACKEND_HPP
+#define GPU_BACKEND_HPP
+
+#include <memory>
+
+#include "scene_manager.hpp"
+#include "application.hpp"
+#include "probe_volume.hpp"
+#include "baking_backend.hpp"
+#include "env_map_generator.hpp"
+#include "probe_integrator.hpp"
+#include "image_dumper.hpp"
+
+#define WORKGROUP_SIZE 16
+
+namespace vlb {
+
+    // Vulkan ray tracing backend: integrates probes in raygen (or renders env maps
+    // and projects them with sh.comp) and reduces partials with sh_reduce.comp
+    class GpuBackend : public Application, public BakingBackend
+    {
+        public:
+            struct CreateInfo
+            {
+                std::string assetName;
+                uint32_t    lmax        = 3u;
+                uint32_t    batchSize   = 8u;
+                uint32_t    inFlight    = 2u;
+                uint32_t    strata      = 64u;
+                bool        envMaps     = false;
+                bool        dumpEnvMaps = false;
+                std::string dumpFilter;
+            };
+
+        private:
+            struct PushConstant
+            {
+                uint32_t width;
+                uint32_t height;
+                uint32_t layerOffset;
+            } pushConstants;
+
+            // Every in-flight slot owns batchSize layers of the env map, partials and SH buffers
+            struct Slot
+            {
+                vk::UniqueCommandBuffer cmd;
+                uint64_t                timelineValue = 0;
+                uint32_t                firstProbe    = 0;
+                uint32_t                probeCount    = 0;
+                uint32_t                firstLayer    = 0;
+
+                std::vector<std::pair<ImageDumper::Staging*, uint32_t>> dumps; // staging, probe
+            };
+
+            EnvMapGenerator envMapGenerator;
+            ProbeIntegrator probeIntegrator;
+
+            std::unique_ptr<ImageDumper> dumper;
+
+            CreateInfo               settings;
+            Scene                    scene;
+            std::array<glm::vec3, 2> bounds{};
+            bool                     imageInput;
+            bool                     directIntegration;
+            uint32_t                 batchSize;
+            uint32_t                 inFlight;
+            std::vector<Slot>        slots;
+            vk::UniqueSemaphore      timeline;
+            uint64_t                 timelineValue = 0;
+            void*                    mappedCoeffs  = nullptr;
+            uint32_t                 probeCount    = 0;
+            uint32_t                 lmax;
+            uint32_t                 coeffCount;
+            Application::Buffer      SHCoeffs;
+            Application::Buffer      SHPartials; // one set of coefficients per projection workgroup
+            uint32_t                 groupCount;
+            std::vector<uint8_t>     coeffs;
+
+            vk::UniqueDescriptorPool      descriptorPool;
+            vk::UniqueDescriptorSet       descriptorSet;
+            vk::UniqueDescriptorSetLayout descriptorSetLayout;
+            vk::UniquePipeline            pipeline;
+            vk::UniquePipeline            reducePipeline;
+            vk::UniquePipelineLayout      pipelineLayout;
+
+            vk::UniquePipeline createComputePipeline(const std::string& shaderPath);
+
+        public:
+
+            GpuBackend(CreateInfo& ci);
+            ~GpuBackend();
+
+            const char*              getName() override;
+            std::array<glm::vec3, 2> getBounds() override;
+            void                     setProbePositions(const std::vector<glm::vec3>& positions) override;
+            std::vector<uint8_t>     bake() override;
+
+            void createBakingPipeline();
+            void recordBakingKernel(vk::CommandBuffer cmd, uint32_t probeCount, uint32_t firstLayer = 0);
+            void submitSlot(Slot& slot, uint32_t firstProbe, uint32_t probeCount);
+            void retireSlot(Slot& slot);
+    };
+}
+
+#endif // GPU_BACKEND_HPP
+
@@ -0,0 +1,115 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "image_dumper.hpp"
+
+#include <stb_image_write.h>
+
+namespace vlb {
+
+    ImageDumper::ImageDumper(CreateInfo& ci)
+        : device(ci.device)
+        , extent(ci.extent)
+    {
+        std::stringstream filter{ci.filter};
+        std::string range{};
+        while (std::getline(filter, range, ','))
+        {
+            if (range.empty()) continue;
+
+            size_t dash = range.find('-');
+            uint32_t first = static_cast<uint32_t>(std::stoul(range.substr(0, dash)));
+            uint32_t last  = dash == std::string::npos ? first : static_cast<uint32_t>(std::stoul(range.substr(dash + 1)));
+            this->ranges.push_back({first, last});
+        }
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        vk::BufferUsageFlags    usg  = eTransferDst;
+        vk::MemoryPropertyFlags mem  = eHostVisible | eHostCoherent;
+        vk::DeviceSize          size = static_cast<vk::DeviceSize>(this->extent.width * this->extent.height * 4);
+
+        this->stagings = std::vector<Staging>(std::max(ci.stagingCount, 1u));
+        for (auto& staging : this->stagings)
+        {
+            staging.buffer = Application::createBuffer(ci.device, ci.physicalDevice, size, usg, mem, nullptr, { MemoryAllocator::Category::eStaging, "baker" });
+            staging.mapped = staging.buffer.memory.map();
+            this->freeStagings.push_back(&staging);
+        }
+
+        for (uint32_t i = 0; i < std::max(ci.threadCount, 1u); ++i)
+        {
+            this->workers.emplace_back(&ImageDumper::work, this);
+        }
+    }
+
+    ImageDumper::~ImageDumper()
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->mutex};
+            this->stopping = true;
+        }
+        this->jobAdded.notify_all();
+
+        for (auto& worker : this->workers)
+        {
+            worker.join();
+        }
+    }
+
+    bool ImageDumper::isSelected(uint32_t probe)
+    {
+        if (this->ranges.empty()) return true;
+
+        for (auto [first, last] : this->ranges)
+        {
+            if (probe >= first && probe <= last) return true;
+        }
+
+        return false;
+    }
+
+    ImageDumper::Staging* ImageDumper::acquire()
+    {
+        std::unique_lock<std::mutex> lock{this->mutex};
+        this->stagingFreed.wait(lock, [this]{ return !this->freeStagings.empty(); });
+
+        Staging* staging = this->freeStagings.back();
+        this->freeStagings.pop_back();
+        return staging;
+    }
+
+    void ImageDumper::write(Staging* staging, std::string&& name)
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->mutex};
+            this->jobs.push_back(Job{staging, std::move(name)});
+        }
+        this->jobAdded.notify_one();
+    }
+
+    void ImageDumper::work()
+    {
+        while (true)
+        {
+            Job job{};
+            {
+                std::unique_lock<std::mutex> lock{this->mutex};
+                this->jobAdded.wait(lock, [this]{ return this->stopping || !this->jobs.empty(); });
+
+                // pending jobs are still written on shutdown
+                if (this->jobs.empty()) return;
+
+                job = std::move(this->jobs.front());
+                this->jobs.pop_front();
+            }
+
+            stbi_write_png(job.name.c_str(), this->extent.width, this->extent.height, 4, job.staging->mapped, this->extent.width * 4);
+
+            {
+                std::lock_guard<std::mutex> lock{this->mutex};
+                this->freeStagings.push_back(job.staging);
+            }
+            this->stagingFreed.notify_one();
+        }
+    }
+}
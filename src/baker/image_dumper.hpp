@@ -0,0 +1,75 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef IMAGE_DUMPER_HPP
+#define IMAGE_DUMPER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "application.hpp"
+
+namespace vlb {
+
+    // Writes RGBA8 images to PNG on a small pool of background threads.
+    // Staging buffers stay mapped and are recycled once their PNG is written,
+    // so the number of dumps in flight is bounded by the staging count.
+    class ImageDumper
+    {
+        public:
+            struct Staging
+            {
+                Application::Buffer buffer;
+                void*               mapped;
+            };
+
+            struct CreateInfo
+            {
+                vk::PhysicalDevice physicalDevice;
+                vk::Device         device;
+                vk::Extent3D       extent;
+                uint32_t           threadCount  = 2u;
+                uint32_t           stagingCount = 4u;
+                std::string        filter; // e.g. "0-9,25"; empty selects every probe
+            };
+
+        private:
+            struct Job
+            {
+                Staging*    staging;
+                std::string name;
+            };
+
+            vk::Device   device;
+            vk::Extent3D extent;
+
+            std::vector<std::pair<uint32_t, uint32_t>> ranges;
+
+            std::vector<Staging>  stagings;
+            std::vector<Staging*> freeStagings;
+            std::deque<Job>       jobs;
+            bool                  stopping = false;
+
+            std::mutex               mutex;
+            std::condition_variable  jobAdded;
+            std::condition_variable  stagingFreed;
+            std::vector<std::thread> workers;
+
+            void work();
+
+        public:
+            ImageDumper(CreateInfo& ci);
+            ~ImageDumper();
+
+            ImageDumper(const ImageDumper& other) = delete;
+
+            bool     isSelected(uint32_t probe);
+            Staging* acquire(); // blocks while every staging buffer is in use
+            void     write(Staging* staging, std::string&& name);
+    };
+}
+
+#endif // IMAGE_DUMPER_HPP
+
@@ -5,54 +5,55 @@
 
 #include <memory>
 
-#include "scene_manager.hpp"
-#include "application.hpp"
-#include "env_map_generator.hpp"
-
-#define WORKGROUP_SIZE 16
+#include "probe_volume.hpp"
+#include "baking_backend.hpp"
 
 namespace vlb {
 
-    class LightBaker : public Application
+    class LightBaker
     {
-        private:
-            struct PushConstant
+        public:
+            struct CreateInfo
             {
-                uint32_t width;
-                uint32_t height;
-            } pushConstants;
+                std::string assetName;
+                std::string backend;                   // "gpu" or "cpu", empty picks gpu for scenes and cpu for images
+                glm::uvec3  gridDims    = glm::uvec3(7u);
+                float       spacing     = 0.0f; // > 0 derives gridDims from the scene bounds
+                uint32_t    lmax        = 3u;   // highest SH band, (lmax + 1)^2 coefficients per probe
+                uint32_t    batchSize   = 8u;  // probes rendered per submission
+                uint32_t    inFlight    = 2u;  // submissions the GPU may work on while the CPU reads back
+                uint32_t    strata      = 64u; // direct integration traces strata^2 directions per probe
+                uint32_t    threadCount = 0u;  // cpu backend workers, 0 uses every hardware thread
+                bool        envMaps     = false; // debug: render env maps and project them instead
+                bool        dumpEnvMaps = false; // write <probe>.png for env maps, needs envMaps
+                std::string dumpFilter;          // probes to dump, e.g. "0-9,25"; empty dumps all
+            };
 
-            EnvMapGenerator envMapGenerator;
+        private:
+            std::unique_ptr<BakingBackend> backend;
 
-            std::string            gltfFileName;
+            std::string            assetName;
             bool                   imageInput;
             std::vector<glm::vec3> probePositions;
-            glm::vec3              probesCount3D;
+            glm::uvec3             gridDims;
+            uint32_t               lmax;
+            uint32_t               coeffCount;
+            glm::vec3              gridOrigin;
             glm::vec3              gridStep;
-            Application::Buffer    SHCoeffs;
 
             std::vector<uint8_t> coeffs;
 
-            vk::UniqueDescriptorPool      descriptorPool;
-            vk::UniqueDescriptorSet       descriptorSet;
-            vk::UniqueDescriptorSetLayout descriptorSetLayout;
-            vk::UniquePipeline            pipeline;
-            vk::UniquePipelineCache       pipelineCache;
-            vk::UniquePipelineLayout      pipelineLayout;
-
         public:
 
-            LightBaker(std::string& sceneName);
+            LightBaker(CreateInfo& ci);
             ~LightBaker();
 
-            std::vector<glm::vec3> probePositionsFromBoudingBox(std::array<glm::vec3, 2> boundingBox);
-            void createBakingPipeline();
-            void modifyPipelineForDebug();
-            void dispatchBakingKernel();
+            static bool isScene(const std::string& assetName);
+
+            std::vector<glm::vec3> probePositionsFromBoudingBox(std::array<glm::vec3, 2> boundingBox, float spacing = 0.0f);
             void bake();
             void serialize();
     };
 }
 
 #endif // LIGHT_BAKER_HPP
-
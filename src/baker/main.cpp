@@ -1,27 +1,157 @@
 // created in 2022 by Andrey Treefonov https://github.com/Reefufui
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
 #include <string>
+#include <cctype>
+
+#include <nlohmann/json.hpp>
+#include <vulkan/vulkan.hpp>
 
 #include "light_baker.hpp"
+#include "profiler.hpp"
+
+// "8" or "8x4x8"
+glm::uvec3 parseGrid(const std::string& grid)
+{
+    std::vector<uint32_t> dims{};
+    std::stringstream stream{grid};
+    std::string dim{};
+    while (std::getline(stream, dim, 'x'))
+    {
+        dims.push_back(static_cast<uint32_t>(std::stoul(dim)));
+    }
+
+    if (dims.size() == 1) return glm::uvec3(dims[0]);
+    if (dims.size() == 3) return glm::uvec3(dims[0], dims[1], dims[2]);
+
+    throw std::runtime_error("Bad grid: " + grid);
+}
+
+// Job files carry the same settings as the command line, flags given after --job override them
+void loadJob(vlb::LightBaker::CreateInfo& ci, const std::string& path)
+{
+    std::ifstream i(path);
+    if (!i)
+    {
+        throw std::runtime_error("Could not open job file: " + path);
+    }
+
+    nlohmann::json job{};
+    i >> job;
+
+    ci.assetName   = job.value("scene", ci.assetName);
+    ci.backend     = job.value("backend", ci.backend);
+    ci.spacing     = job.value("spacing", ci.spacing);
+    ci.lmax        = job.value("lmax", ci.lmax);
+    ci.batchSize   = job.value("batchSize", ci.batchSize);
+    ci.inFlight    = job.value("inFlight", ci.inFlight);
+    ci.strata      = job.value("strata", ci.strata);
+    ci.envMaps     = job.value("envMaps", ci.envMaps);
+    ci.dumpEnvMaps = job.value("dumpEnvMaps", ci.dumpEnvMaps);
+    ci.dumpFilter  = job.value("dumpFilter", ci.dumpFilter);
+    ci.threadCount = job.value("threads", ci.threadCount);
+
+    if (job.contains("grid"))
+    {
+        auto grid = job["grid"].get<std::vector<uint32_t>>();
+        if (grid.size() != 3)
+        {
+            throw std::runtime_error("job grid must have 3 dimensions");
+        }
+        ci.gridDims = glm::uvec3(grid[0], grid[1], grid[2]);
+    }
+}
 
 int main(int argc, char** argv)
 {
     try
     {
-        std::string sceneFileName{};
-        if (argc < 2)
+        vlb::LightBaker::CreateInfo ci{};
+        std::string tracePath{};
+        for (int i = 1; i < argc; ++i)
         {
-            throw std::runtime_error("Select scene to bake.");
+            std::string arg = argv[i];
+            if (arg == "--batch-size" && i + 1 < argc)
+            {
+                ci.batchSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--job" && i + 1 < argc)
+            {
+                loadJob(ci, argv[++i]);
+            }
+            else if (arg == "--grid" && i + 1 < argc)
+            {
+                ci.gridDims = parseGrid(argv[++i]);
+            }
+            else if (arg == "--spacing" && i + 1 < argc)
+            {
+                ci.spacing = std::stof(argv[++i]);
+            }
+            else if (arg == "--lmax" && i + 1 < argc)
+            {
+                ci.lmax = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--in-flight" && i + 1 < argc)
+            {
+                ci.inFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--strata" && i + 1 < argc)
+            {
+                ci.strata = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--dump-env-maps")
+            {
+                ci.dumpEnvMaps = true;
+                if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                {
+                    ci.dumpFilter = argv[++i];
+                }
+            }
+            else if (arg == "--env-maps")
+            {
+                ci.envMaps = true;
+            }
+            else if (arg == "--backend" && i + 1 < argc)
+            {
+                ci.backend = argv[++i];
+            }
+            else if (arg == "--threads" && i + 1 < argc)
+            {
+                ci.threadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+            else if (arg == "--profile")
+            {
+                tracePath = VLB_PROFILER_TRACE_PATH;
+                if (i + 1 < argc && std::string(argv[i + 1]).ends_with(".json"))
+                {
+                    tracePath = argv[++i];
+                }
+            }
+            else
+            {
+                ci.assetName = arg;
+            }
         }
-        else
+
+        if (ci.assetName.empty())
         {
-            sceneFileName = argv[1];
+            throw std::runtime_error("Select scene to bake.");
         }
 
-        vlb::LightBaker baker{sceneFileName};
+        vlb::Profiler::setEnabled(!tracePath.empty());
+
+        vlb::LightBaker baker{ci};
         baker.bake();
         baker.serialize();
+
+        if (!tracePath.empty())
+        {
+            vlb::Profiler::exportChromeTrace(tracePath);
+            std::cout << "trace written to " << tracePath << "\n";
+        }
     }
     catch(const vk::SystemError& error)
     {
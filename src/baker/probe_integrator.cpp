@@ -0,0 +1,283 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "probe_integrator.hpp"
+
+namespace vlb {
+
+    void ProbeIntegrator::passVulkanResources(VulkanResources& info)
+    {
+        this->device              = info.device;
+        this->physicalDevice      = info.physicalDevice;
+        this->graphicsQueue       = info.graphicsQueue;
+        this->graphicsCommandPool = info.graphicsCommandPool;
+    }
+
+    void ProbeIntegrator::setScene(Scene&& scene)
+    {
+        this->scene = scene;
+    }
+
+    void ProbeIntegrator::setStrata(uint32_t strata)
+    {
+        // every invocation integrates STRATA_PER_INVOCATION full rows
+        strata = std::max(strata, 1u);
+        this->strata = (strata + STRATA_PER_INVOCATION - 1) / STRATA_PER_INVOCATION * STRATA_PER_INVOCATION;
+    }
+
+    void ProbeIntegrator::setLmax(uint32_t lmax)
+    {
+        this->lmax = lmax;
+    }
+
+    void ProbeIntegrator::setBatchSize(uint32_t batchSize)
+    {
+        this->batchSize = std::max(batchSize, 1u);
+    }
+
+    uint32_t ProbeIntegrator::getPartialsPerProbe()
+    {
+        return this->strata * (this->strata / STRATA_PER_INVOCATION);
+    }
+
+    void ProbeIntegrator::setProbePositions(const std::vector<glm::vec3>& positions)
+    {
+        // std430 pads vec3 array elements to 16 bytes
+        std::vector<glm::vec4> padded(positions.size());
+        for (size_t i{}; i < positions.size(); ++i)
+        {
+            padded[i] = glm::vec4(positions[i], 1.0f);
+        }
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        vk::BufferUsageFlags    usg{ eStorageBuffer };
+        vk::MemoryPropertyFlags mem{ eHostVisible | eHostCoherent };
+
+        this->probePositions = Application::createBuffer(this->device, this->physicalDevice, padded.size() * sizeof(glm::vec4), usg, mem, padded.data(),
+                { MemoryAllocator::Category::eOther, "baker" });
+
+        this->device.updateDescriptorSets(
+                vk::WriteDescriptorSet{}
+                .setDstSet(this->probesDS.get())
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDstBinding(0)
+                .setBufferInfo(
+                    vk::DescriptorBufferInfo{}
+                    .setBuffer(this->probePositions.handle.get())
+                    .setRange(VK_WHOLE_SIZE)
+                    ),
+                nullptr);
+    }
+
+    void ProbeIntegrator::setPartialsBuffer(const Application::Buffer& partials)
+    {
+        assert(partials.size >= this->batchSize * getPartialsPerProbe() * (this->lmax + 1) * (this->lmax + 1) * sizeof(glm::vec3));
+
+        this->device.updateDescriptorSets(
+                vk::WriteDescriptorSet{}
+                .setDstSet(this->probesDS.get())
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDstBinding(1)
+                .setBufferInfo(
+                    vk::DescriptorBufferInfo{}
+                    .setBuffer(partials.handle.get())
+                    .setRange(VK_WHOLE_SIZE)
+                    ),
+                nullptr);
+    }
+
+    void ProbeIntegrator::createRayTracingPipeline()
+    {
+        // POOL
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            {vk::DescriptorType::eAccelerationStructureKHR, 1},
+            {vk::DescriptorType::eUniformBuffer, 1},
+            {vk::DescriptorType::eStorageBuffer, 5},
+            {vk::DescriptorType::eCombinedImageSampler, 1000}
+        };
+
+        this->descriptorPool = this->device.createDescriptorPoolUnique(
+                vk::DescriptorPoolCreateInfo{}
+                .setPoolSizes(poolSizes)
+                .setMaxSets(2)
+                .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet
+                    | vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+                );
+
+        // LAYOUT
+        std::vector<vk::DescriptorSetLayoutBinding> probesLayoutBindings{
+            vk::DescriptorSetLayoutBinding{}
+            .setBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR),
+                vk::DescriptorSetLayoutBinding{}
+            .setBinding(1)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR)
+        };
+
+        this->probesLayout = this->device.createDescriptorSetLayoutUnique(
+                vk::DescriptorSetLayoutCreateInfo{}
+                .setBindings(probesLayoutBindings)
+                );
+        auto sceneLayout = this->scene->getDescriptorSetLayout();
+
+        // DESCRIPOR
+        this->sceneDS = std::move(this->device.allocateDescriptorSetsUnique(
+                    vk::DescriptorSetAllocateInfo{}
+                    .setDescriptorPool(this->descriptorPool.get())
+                    .setSetLayouts(sceneLayout)
+                    ).front());
+        this->probesDS = std::move(this->device.allocateDescriptorSetsUnique(
+                    vk::DescriptorSetAllocateInfo{}
+                    .setDescriptorPool(this->descriptorPool.get())
+                    .setSetLayouts(probesLayout.get())
+                    ).front());
+
+        // PIPELINE LAYOUT
+        const std::vector<vk::PushConstantRange> pushConstants{
+            { vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(PushConstant) }
+        };
+        const std::array<vk::DescriptorSetLayout, 2> layouts { sceneLayout, probesLayout.get()};
+
+        this->pipelineLayout = this->device.createPipelineLayoutUnique(
+                vk::PipelineLayoutCreateInfo{}
+                .setSetLayouts(layouts)
+                .setPushConstantRanges(pushConstants)
+                );
+
+        // SHADERS
+        enum StageIndices
+        {
+            eRaygen,
+            eMiss,
+            eShadow,
+            eClosestHit,
+            eShaderGroupCount
+        };
+        std::array<vk::PipelineShaderStageCreateInfo, StageIndices::eShaderGroupCount> shaderStages{};
+
+        std::vector<vk::UniqueShaderModule> shaderModules{};
+        std::vector<vk::RayTracingShaderGroupCreateInfoKHR> shaderGroups{};
+
+        vk::RayTracingShaderGroupCreateInfoKHR groupTemplate{};
+        groupTemplate
+            .setType(vk::RayTracingShaderGroupTypeKHR::eGeneral)
+            .setClosestHitShader(VK_SHADER_UNUSED_KHR)
+            .setAnyHitShader(VK_SHADER_UNUSED_KHR)
+            .setIntersectionShader(VK_SHADER_UNUSED_KHR);
+
+        // SH_LMAX in sh_common.h, the pipeline is made for one band after setLmax()
+        const std::array<uint32_t, 2> raygenConstants{ this->lmax, STRATA_PER_INVOCATION };
+        const std::array<vk::SpecializationMapEntry, 2> raygenEntries{
+            vk::SpecializationMapEntry{ 0, 0 * sizeof(uint32_t), sizeof(uint32_t) }, // SH_LMAX
+            vk::SpecializationMapEntry{ 1, 1 * sizeof(uint32_t), sizeof(uint32_t) }, // STRATA_PER_INVOCATION
+        };
+        vk::SpecializationInfo raygenSpecialization{};
+        raygenSpecialization
+            .setMapEntries(raygenEntries)
+            .setDataSize(sizeof(raygenConstants))
+            .setPData(raygenConstants.data());
+
+        shaderModules.push_back(Application::createShaderModule(this->device, "shaders/probe_sh.rgen.spv"));
+        shaderStages[StageIndices::eRaygen] = vk::PipelineShaderStageCreateInfo{};
+        shaderStages[StageIndices::eRaygen]
+            .setStage(vk::ShaderStageFlagBits::eRaygenKHR)
+            .setModule(shaderModules.back().get())
+            .setPName("main")
+            .setPSpecializationInfo(&raygenSpecialization);
+        shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eRaygen));
+
+        shaderModules.push_back(Application::createShaderModule(this->device, "shaders/main.rmiss.spv"));
+        shaderStages[StageIndices::eMiss] = vk::PipelineShaderStageCreateInfo{};
+        shaderStages[StageIndices::eMiss]
+            .setStage(vk::ShaderStageFlagBits::eMissKHR)
+            .setModule(shaderModules.back().get())
+            .setPName("main");
+        shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eMiss));
+
+        shaderModules.push_back(Application::createShaderModule(this->device, "shaders/shadow.rmiss.spv"));
+        shaderStages[StageIndices::eShadow] = vk::PipelineShaderStageCreateInfo{};
+        shaderStages[StageIndices::eShadow]
+            .setStage(vk::ShaderStageFlagBits::eMissKHR)
+            .setModule(shaderModules.back().get())
+            .setPName("main");
+        shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eShadow));
+
+        shaderModules.push_back(Application::createShaderModule(this->device, "shaders/env_map.rchit.spv"));
+        shaderStages[StageIndices::eClosestHit] = vk::PipelineShaderStageCreateInfo{};
+        shaderStages[StageIndices::eClosestHit]
+            .setStage(vk::ShaderStageFlagBits::eClosestHitKHR)
+            .setModule(shaderModules.back().get())
+            .setPName("main");
+        shaderGroups.push_back(
+                groupTemplate
+                .setType(vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup)
+                .setGeneralShader(VK_SHADER_UNUSED_KHR)
+                .setClosestHitShader(StageIndices::eClosestHit)
+                );
+
+        auto[result, p] = this->device.createRayTracingPipelineKHRUnique(nullptr, PipelineCache::get(this->device, this->physicalDevice),
+                vk::RayTracingPipelineCreateInfoKHR{}
+                .setStages(shaderStages)
+                .setGroups(shaderGroups)
+                .setMaxPipelineRayRecursionDepth(2)
+                .setLayout(this->pipelineLayout.get())
+                );
+
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to create ray tracing pipeline");
+        }
+        else
+        {
+            this->pipeline = std::move(p);
+        }
+    }
+
+    void ProbeIntegrator::setupVukanRaytracing()
+    {
+        createRayTracingPipeline();
+        this->scene->updateSceneDescriptorSets(this->sceneDS.get());
+
+        this->sbt = Application::createShaderBindingTable(this->device, this->physicalDevice, this->pipeline.get(), 2u, 1u, "baker");
+    }
+
+    void ProbeIntegrator::recordProbes(vk::CommandBuffer cmd, uint32_t firstProbe, uint32_t count, uint32_t firstLayer)
+    {
+        assert(firstLayer + count <= this->batchSize);
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, this->pipeline.get());
+
+        std::vector<vk::DescriptorSet> descriptorSets(0);
+        descriptorSets.push_back(this->sceneDS.get());
+        descriptorSets.push_back(this->probesDS.get());
+
+        cmd.bindDescriptorSets(
+                vk::PipelineBindPoint::eRayTracingKHR,
+                this->pipelineLayout.get(),
+                0,
+                descriptorSets,
+                nullptr
+                );
+
+        this->pushConstants.probeOffset = firstProbe;
+        this->pushConstants.strata      = this->strata;
+        this->pushConstants.layerOffset = firstLayer;
+        cmd.pushConstants(
+                this->pipelineLayout.get(),
+                vk::ShaderStageFlagBits::eRaygenKHR,
+                0, sizeof(PushConstant), &this->pushConstants
+                );
+
+        cmd.traceRaysKHR(
+                this->sbt.strides[0],
+                this->sbt.strides[1],
+                this->sbt.strides[2],
+                {},
+                this->strata, this->strata / STRATA_PER_INVOCATION, count
+                );
+    }
+}
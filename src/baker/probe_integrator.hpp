@@ -0,0 +1,71 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef PROBE_INTEGRATOR_HPP
+#define PROBE_INTEGRATOR_HPP
+
+#include "scene_manager.hpp"
+
+#define STRATA_PER_INVOCATION 8 // probe_sh.rgen gets it as a specialization constant
+
+namespace vlb {
+
+    // Traces stratified directions from each probe and projects the radiance onto SH
+    // right in the raygen shader. Writes one set of partial coefficients per launch
+    // invocation; partials are summed by sh_reduce.comp.
+    class ProbeIntegrator
+    {
+        public:
+            struct VulkanResources
+            {
+                vk::PhysicalDevice physicalDevice;
+                vk::Device device;
+                vk::Queue graphicsQueue;
+                vk::CommandPool graphicsCommandPool;
+            };
+
+        private:
+            vk::PhysicalDevice physicalDevice;
+            vk::Device         device;
+            vk::Queue          graphicsQueue;
+            vk::CommandPool    graphicsCommandPool;
+
+            Scene               scene;
+            uint32_t            strata = 64u;
+            uint32_t            lmax = 3u;
+            uint32_t            batchSize = 1u;
+            Application::Buffer probePositions;
+
+            struct PushConstant
+            {
+                uint32_t probeOffset;
+                uint32_t strata;
+                uint32_t layerOffset;
+            } pushConstants;
+
+            vk::UniqueDescriptorPool      descriptorPool;
+            vk::UniqueDescriptorSet       sceneDS;
+            vk::UniqueDescriptorSetLayout probesLayout;
+            vk::UniqueDescriptorSet       probesDS;
+            vk::UniquePipeline            pipeline;
+            vk::UniquePipelineLayout      pipelineLayout;
+
+            Application::ShaderBindingTable sbt;
+
+            void createRayTracingPipeline();
+
+        public:
+            void     passVulkanResources(VulkanResources& info);
+            void     setScene(Scene&& scene);
+            void     setStrata(uint32_t strata);
+            void     setLmax(uint32_t lmax);
+            void     setBatchSize(uint32_t batchSize);
+            void     setProbePositions(const std::vector<glm::vec3>& positions);
+            void     setPartialsBuffer(const Application::Buffer& partials);
+            void     setupVukanRaytracing();
+            void     recordProbes(vk::CommandBuffer cmd, uint32_t firstProbe, uint32_t count, uint32_t firstLayer = 0);
+            uint32_t getPartialsPerProbe();
+    };
+}
+
+#endif // PROBE_INTEGRATOR_HPP
+
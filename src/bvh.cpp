@@ -0,0 +1,344 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace vlb {
+
+    namespace {
+
+        constexpr uint32_t maxBinCount       = 64u;
+        constexpr uint32_t maxDepth          = 60u;    // keeps traversal within its 64 entry stack
+        constexpr uint32_t parallelThreshold = 4096u;  // smaller subtrees are not worth a thread
+
+        struct Builder
+        {
+            const std::vector<AABB>& boxes;
+            std::vector<glm::vec3>   centroids;
+            std::vector<BVH::Node>&  nodes;
+            std::vector<uint32_t>&   indices;
+            std::atomic<uint32_t>    nodesUsed{1};
+            uint32_t                 maxLeafSize = 4u;
+            uint32_t                 binCount    = 16u;
+            uint32_t                 spawnDepth  = 0u;
+
+            uint32_t toBin(float centroid, float min, float scale)
+            {
+                return std::min(this->binCount - 1, static_cast<uint32_t>((centroid - min) * scale));
+            }
+
+            void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth)
+            {
+                BVH::Node& node = this->nodes[nodeIndex];
+
+                AABB bounds{};
+                AABB centroidBounds{};
+                for (uint32_t i = first; i < first + count; ++i)
+                {
+                    bounds.grow(this->boxes[this->indices[i]]);
+                    centroidBounds.grow(this->centroids[this->indices[i]]);
+                }
+                node.min       = bounds.min;
+                node.max       = bounds.max;
+                node.leftFirst = first;
+                node.count     = count;
+
+                if (count <= 1 || depth >= maxDepth) return;
+
+                // Sweep the bins of every axis, cost of a split is N_left * A_left + N_right * A_right
+                float    bestCost  = std::numeric_limits<float>::max();
+                int      bestAxis  = -1;
+                uint32_t bestSplit = 0;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                    if (extent <= 0.0f) continue;
+
+                    const float scale = this->binCount / extent;
+
+                    std::array<AABB, maxBinCount>     binBounds{};
+                    std::array<uint32_t, maxBinCount> binCounts{};
+                    for (uint32_t i = first; i < first + count; ++i)
+                    {
+                        uint32_t bin = toBin(this->centroids[this->indices[i]][axis], centroidBounds.min[axis], scale);
+                        binBounds[bin].grow(this->boxes[this->indices[i]]);
+                        binCounts[bin]++;
+                    }
+
+                    std::array<float, maxBinCount>    leftCost{};
+                    std::array<uint32_t, maxBinCount> leftCount{};
+                    AABB     leftBox{};
+                    uint32_t leftSum = 0;
+                    for (uint32_t bin = 0; bin + 1 < this->binCount; ++bin)
+                    {
+                        leftBox.grow(binBounds[bin]);
+                        leftSum += binCounts[bin];
+                        leftCount[bin + 1] = leftSum;
+                        leftCost[bin + 1]  = leftSum * leftBox.area();
+                    }
+
+                    AABB     rightBox{};
+                    uint32_t rightSum = 0;
+                    for (uint32_t split = this->binCount - 1; split > 0; --split)
+                    {
+                        rightBox.grow(binBounds[split]);
+                        rightSum += binCounts[split];
+
+                        if (!rightSum || !leftCount[split]) continue;
+
+                        float cost = leftCost[split] + rightSum * rightBox.area();
+                        if (cost < bestCost)
+                        {
+                            bestCost  = cost;
+                            bestAxis  = axis;
+                            bestSplit = split;
+                        }
+                    }
+                }
+
+                if (bestAxis < 0) return;
+                if (bestCost >= count * bounds.area() && count <= this->maxLeafSize) return;
+
+                const float min   = centroidBounds.min[bestAxis];
+                const float scale = this->binCount / (centroidBounds.max[bestAxis] - min);
+                auto middle = std::partition(this->indices.begin() + first, this->indices.begin() + first + count,
+                        [&](uint32_t i) { return toBin(this->centroids[i][bestAxis], min, scale) < bestSplit; });
+                const uint32_t leftCount = static_cast<uint32_t>(middle - this->indices.begin()) - first;
+
+                const uint32_t left = this->nodesUsed.fetch_add(2);
+                node.leftFirst = left;
+                node.count     = 0;
+
+                if (depth < this->spawnDepth && count >= parallelThreshold)
+                {
+                    std::thread worker(&Builder::subdivide, this, left, first, leftCount, depth + 1);
+                    subdivide(left + 1, first + leftCount, count - leftCount, depth + 1);
+                    worker.join();
+                }
+                else
+                {
+                    subdivide(left, first, leftCount, depth + 1);
+                    subdivide(left + 1, first + leftCount, count - leftCount, depth + 1);
+                }
+            }
+        };
+    }
+
+    void AABB::grow(const glm::vec3& point)
+    {
+        this->min = glm::min(this->min, point);
+        this->max = glm::max(this->max, point);
+    }
+
+    void AABB::grow(const AABB& other)
+    {
+        this->min = glm::min(this->min, other.min);
+        this->max = glm::max(this->max, other.max);
+    }
+
+    float AABB::area() const
+    {
+        glm::vec3 e = this->max - this->min;
+        return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    BVH::BVH(const std::vector<AABB>& boxes, const CreateInfo& ci)
+    {
+        const uint32_t count = static_cast<uint32_t>(boxes.size());
+        if (!count) return;
+
+        // root, then at most count - 1 child pairs
+        this->nodes   = std::vector<Node>(2 * size_t(count) - 1);
+        this->indices = std::vector<uint32_t>(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            this->indices[i] = i;
+        }
+
+        const uint32_t threadCount = ci.threadCount ? ci.threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+
+        Builder builder{ boxes, {}, this->nodes, this->indices };
+        builder.maxLeafSize = std::max(ci.maxLeafSize, 1u);
+        builder.binCount    = std::clamp(ci.binCount, 2u, maxBinCount);
+        builder.spawnDepth  = static_cast<uint32_t>(std::ceil(std::log2(threadCount)));
+        builder.centroids.reserve(count);
+        for (const AABB& box : boxes)
+        {
+            builder.centroids.push_back((box.min + box.max) * 0.5f);
+        }
+
+        builder.subdivide(0, 0, count, 0);
+
+        this->nodes.resize(builder.nodesUsed);
+    }
+
+    const std::vector<BVH::Node>& BVH::getNodes() const
+    {
+        return this->nodes;
+    }
+
+    const std::vector<uint32_t>& BVH::getPrimitiveIndices() const
+    {
+        return this->indices;
+    }
+
+    // Returns the entry distance, or float max on a miss
+    float BVH::intersectNode(const Node& node, const glm::vec3& origin, const glm::vec3& invDir, float tMin, float tMax)
+    {
+        const glm::vec3 t1 = (node.min - origin) * invDir;
+        const glm::vec3 t2 = (node.max - origin) * invDir;
+        const glm::vec3 tNear = glm::min(t1, t2);
+        const glm::vec3 tFar  = glm::max(t1, t2);
+
+        const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+        const float exit  = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+
+        return enter <= exit ? enter : std::numeric_limits<float>::max();
+    }
+
+    MeshBVH::MeshBVH(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const BVH::CreateInfo& ci)
+    {
+        const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+        std::vector<AABB> boxes(triangleCount);
+        for (uint32_t i = 0; i < triangleCount; ++i)
+        {
+            for (uint32_t v = 0; v < 3; ++v)
+            {
+                boxes[i].grow(positions[indices[3 * i + v]]);
+            }
+        }
+
+        this->bvh = BVH(boxes, ci);
+
+        this->triangles.reserve(triangleCount);
+        for (uint32_t primitive : this->bvh.getPrimitiveIndices())
+        {
+            const glm::vec3& v0 = positions[indices[3 * primitive + 0]];
+            const glm::vec3& v1 = positions[indices[3 * primitive + 1]];
+            const glm::vec3& v2 = positions[indices[3 * primitive + 2]];
+            this->triangles.push_back({ v0, v1 - v0, v2 - v0, primitive });
+        }
+    }
+
+    AABB MeshBVH::getBounds() const
+    {
+        const auto& nodes = this->bvh.getNodes();
+        return nodes.empty() ? AABB{} : AABB{ nodes[0].min, nodes[0].max };
+    }
+
+    // Moller-Trumbore, both faces count like eTriangleFacingCullDisable
+    bool MeshBVH::intersect(const Ray& ray, Hit& hit, bool anyHit) const
+    {
+        bool  found = false;
+        float tMax  = std::min(ray.tMax, hit.t);
+
+        this->bvh.traverse(ray.origin, ray.direction, ray.tMin, tMax, [&](uint32_t i, float& tMax)
+        {
+            const Triangle& triangle = this->triangles[i];
+
+            const glm::vec3 h = glm::cross(ray.direction, triangle.e2);
+            const float     a = glm::dot(triangle.e1, h);
+            if (a == 0.0f) return false;
+
+            const float     f = 1.0f / a;
+            const glm::vec3 s = ray.origin - triangle.v0;
+            const float     u = f * glm::dot(s, h);
+            if (u < 0.0f || u > 1.0f) return false;
+
+            const glm::vec3 q = glm::cross(s, triangle.e1);
+            const float     v = f * glm::dot(ray.direction, q);
+            if (v < 0.0f || u + v > 1.0f) return false;
+
+            const float t = f * glm::dot(triangle.e2, q);
+            if (t < ray.tMin || t >= tMax) return false;
+
+            tMax              = t;
+            hit.t             = t;
+            hit.barycentrics  = glm::vec2(u, v);
+            hit.primitive     = triangle.primitive;
+            found             = true;
+            return anyHit;
+        });
+
+        return found;
+    }
+
+    SceneBVH::SceneBVH(std::vector<Instance>&& instances, const BVH::CreateInfo& ci)
+    {
+        // meshes without triangles stay out of the build, hits keep the caller's instance indices
+        std::vector<uint32_t> built{};
+        std::vector<AABB>     boxes{};
+        for (uint32_t i = 0; i < instances.size(); ++i)
+        {
+            const AABB local = instances[i].mesh->getBounds();
+            if (local.min.x > local.max.x) continue;
+
+            AABB& box = boxes.emplace_back();
+            for (uint32_t corner = 0; corner < 8; ++corner)
+            {
+                glm::vec3 point{
+                    corner & 1 ? local.max.x : local.min.x,
+                    corner & 2 ? local.max.y : local.min.y,
+                    corner & 4 ? local.max.z : local.min.z };
+                box.grow(glm::vec3(instances[i].transform * glm::vec4(point, 1.0f)));
+            }
+            built.push_back(i);
+        }
+
+        this->bvh = BVH(boxes, ci);
+
+        this->instances.reserve(built.size());
+        for (uint32_t primitive : this->bvh.getPrimitiveIndices())
+        {
+            const uint32_t index = built[primitive];
+            this->instances.push_back({ std::move(instances[index].mesh), glm::inverse(instances[index].transform), index });
+        }
+    }
+
+    bool SceneBVH::trace(const Ray& ray, Hit& hit, bool anyHit) const
+    {
+        bool  found = false;
+        float tMax  = ray.tMax;
+
+        this->bvh.traverse(ray.origin, ray.direction, ray.tMin, tMax, [&](uint32_t i, float& tMax)
+        {
+            const PreparedInstance& instance = this->instances[i];
+
+            // direction is not renormalized, so t means the same in both spaces
+            Ray local{};
+            local.origin    = glm::vec3(instance.worldToObject * glm::vec4(ray.origin, 1.0f));
+            local.direction = glm::vec3(instance.worldToObject * glm::vec4(ray.direction, 0.0f));
+            local.tMin      = ray.tMin;
+            local.tMax      = tMax;
+
+            if (!instance.mesh->intersect(local, hit, anyHit)) return false;
+
+            tMax         = hit.t;
+            hit.instance = instance.index;
+            found        = true;
+            return anyHit;
+        });
+
+        return found;
+    }
+
+    Hit SceneBVH::closestHit(const Ray& ray) const
+    {
+        Hit hit{};
+        trace(ray, hit, false);
+        return hit;
+    }
+
+    bool SceneBVH::anyHit(const Ray& ray) const
+    {
+        Hit hit{};
+        return trace(ray, hit, true);
+    }
+}
+
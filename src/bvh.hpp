@@ -0,0 +1,197 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace vlb {
+
+    struct Ray
+    {
+        glm::vec3 origin;
+        float     tMin = 0.0f;
+        glm::vec3 direction;
+        float     tMax = std::numeric_limits<float>::max();
+    };
+
+    // instance indexes SceneBVH's instances; primitive and barycentrics mean gl_PrimitiveID and the hit attributes
+    struct Hit
+    {
+        float     t         = std::numeric_limits<float>::max();
+        glm::vec2 barycentrics{};
+        uint32_t  instance  = ~0u;
+        uint32_t  primitive = ~0u;
+
+        bool valid() const { return this->primitive != ~0u; }
+    };
+
+    struct AABB
+    {
+        glm::vec3 min{ std::numeric_limits<float>::max()};
+        glm::vec3 max{-std::numeric_limits<float>::max()};
+
+        void  grow(const glm::vec3& point);
+        void  grow(const AABB& other);
+        float area() const;
+    };
+
+    // Binned SAH hierarchy over boxes. Nodes are 32 bytes; the two children of
+    // an interior node are allocated next to each other, so one index is enough.
+    // Large subtrees are built on separate threads.
+    class BVH
+    {
+        public:
+            struct Node
+            {
+                glm::vec3 min;
+                uint32_t  leftFirst; // left child (right one follows it), or first primitive of a leaf
+                glm::vec3 max;
+                uint32_t  count;     // primitives in a leaf, 0 for interior nodes
+            };
+            static_assert(sizeof(Node) == 32);
+
+            struct CreateInfo
+            {
+                uint32_t threadCount = 0u; // 0 uses every hardware thread
+                uint32_t maxLeafSize = 4u;
+                uint32_t binCount    = 16u;
+            };
+
+            BVH() = default;
+            BVH(const std::vector<AABB>& boxes, const CreateInfo& ci);
+
+            const std::vector<Node>&     getNodes() const;
+            const std::vector<uint32_t>& getPrimitiveIndices() const; // leaf order -> input box
+
+            // Calls intersect(leafOrderIndex, tMax) for every primitive whose node the ray enters,
+            // nearest node first. intersect shrinks tMax on a hit and returns true to stop early.
+            template <class Intersect>
+            bool traverse(const glm::vec3& origin, const glm::vec3& direction, float tMin, float& tMax, Intersect&& intersect) const;
+
+        private:
+            std::vector<Node>     nodes;
+            std::vector<uint32_t> indices;
+
+            static float intersectNode(const Node& node, const glm::vec3& origin, const glm::vec3& invDir, float tMin, float tMax);
+    };
+
+    // Bottom level: triangles of one glTF primitive, like a BLAS
+    class MeshBVH
+    {
+        public:
+            MeshBVH(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const BVH::CreateInfo& ci = {});
+
+            bool intersect(const Ray& ray, Hit& hit, bool anyHit) const; // object space, hit.t must hold the current tMax
+            AABB getBounds() const;
+
+        private:
+            struct Triangle
+            {
+                glm::vec3 v0;
+                glm::vec3 e1;
+                glm::vec3 e2;
+                uint32_t  primitive;
+            };
+
+            BVH                   bvh;
+            std::vector<Triangle> triangles; // in leaf order
+    };
+
+    // Top level: instances of mesh hierarchies with their world transforms, like the TLAS
+    class SceneBVH
+    {
+        public:
+            struct Instance
+            {
+                std::shared_ptr<const MeshBVH> mesh;
+                glm::mat4                      transform; // object to world
+            };
+
+            SceneBVH(std::vector<Instance>&& instances, const BVH::CreateInfo& ci = {});
+
+            Hit  closestHit(const Ray& ray) const;
+            bool anyHit(const Ray& ray) const;
+
+        private:
+            struct PreparedInstance
+            {
+                std::shared_ptr<const MeshBVH> mesh;
+                glm::mat4                      worldToObject;
+                uint32_t                       index; // position in the input, matches instanceCustomIndex
+            };
+
+            BVH                           bvh;
+            std::vector<PreparedInstance> instances; // in leaf order
+
+            bool trace(const Ray& ray, Hit& hit, bool anyHit) const;
+    };
+
+    template <class Intersect>
+    bool BVH::traverse(const glm::vec3& origin, const glm::vec3& direction, float tMin, float& tMax, Intersect&& intersect) const
+    {
+        if (this->nodes.empty()) return false;
+
+        const glm::vec3 invDir = 1.0f / direction;
+
+        uint32_t stack[64];
+        uint32_t stackSize = 0;
+        uint32_t current   = 0;
+
+        if (intersectNode(this->nodes[0], origin, invDir, tMin, tMax) == std::numeric_limits<float>::max())
+        {
+            return false;
+        }
+
+        while (true)
+        {
+            const Node& node = this->nodes[current];
+            if (node.count)
+            {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+                {
+                    if (intersect(i, tMax)) return true;
+                }
+            }
+            else
+            {
+                uint32_t near = node.leftFirst;
+                uint32_t far  = node.leftFirst + 1;
+                float tNear = intersectNode(this->nodes[near], origin, invDir, tMin, tMax);
+                float tFar  = intersectNode(this->nodes[far],  origin, invDir, tMin, tMax);
+                if (tFar < tNear)
+                {
+                    std::swap(near, far);
+                    std::swap(tNear, tFar);
+                }
+
+                if (tNear != std::numeric_limits<float>::max())
+                {
+                    if (tFar != std::numeric_limits<float>::max())
+                    {
+                        stack[stackSize++] = far;
+                    }
+                    current = near;
+                    continue;
+                }
+            }
+
+            // popped nodes may have been passed by a closer hit in the meantime
+            do
+            {
+                if (!stackSize) return false;
+                current = stack[--stackSize];
+            }
+            while (intersectNode(this->nodes[current], origin, invDir, tMin, tMax) == std::numeric_limits<float>::max());
+        }
+    }
+}
+
+#endif // ifndef BVH_HPP
+
@@ -92,7 +92,7 @@ namespace vlb {
         for (auto& buffer : buffers)
         {
             buffer = Application::createBuffer(device, physicalDevice, 2 * sizeof(this->matrix), usage, props);
-            this->mappedMemory.push_back(device.mapMemory(buffer.memory.get(), 0, 2 * sizeof(this->matrix)));
+            this->mappedMemory.push_back(buffer.memory.map());
         }
 
         createDSLayout(device);
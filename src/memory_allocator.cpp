@@ -0,0 +1,354 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "application.hpp"
+#include "memory_allocator.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace vlb {
+
+    namespace {
+        std::mutex                                           registryMutex;
+        std::map<VkDevice, std::unique_ptr<MemoryAllocator>> registry;
+    }
+
+    const char* MemoryAllocator::getCategoryName(Category category)
+    {
+        switch (category)
+        {
+            case Category::eAccelerationStructure: return "acceleration structures";
+            case Category::eScratch:               return "scratch";
+            case Category::eVertex:                return "vertices";
+            case Category::eIndex:                 return "indices";
+            case Category::eTexture:               return "textures";
+            case Category::eSHProbes:              return "SH probes";
+            case Category::eStaging:               return "staging";
+            case Category::eShaderBindingTable:    return "shader binding tables";
+            default:                               return "other";
+        }
+    }
+
+    void MemoryAllocator::Ledger::add(const Tag& tag, vk::DeviceSize size)
+    {
+        std::lock_guard<std::mutex> lock{this->mutex};
+
+        for (Usage* usage : { &this->categories[static_cast<size_t>(tag.category)], &this->owners[tag.owner][static_cast<size_t>(tag.category)] })
+        {
+            usage->bytes += size;
+            usage->peak   = std::max(usage->peak, usage->bytes);
+            usage->count++;
+        }
+    }
+
+    void MemoryAllocator::Ledger::remove(const Tag& tag, vk::DeviceSize size)
+    {
+        std::lock_guard<std::mutex> lock{this->mutex};
+
+        for (Usage* usage : { &this->categories[static_cast<size_t>(tag.category)], &this->owners[tag.owner][static_cast<size_t>(tag.category)] })
+        {
+            usage->bytes -= size;
+            usage->count--;
+        }
+    }
+
+    MemoryAllocator::Block::~Block()
+    {
+        if (this->ledger)
+        {
+            std::lock_guard<std::mutex> lock{this->ledger->mutex};
+            this->ledger->heaps[this->heap] -= this->size;
+        }
+    }
+
+    MemoryAllocator::Allocation::Allocation(std::shared_ptr<Block> block, SubAllocator::Allocation range, Tag tag)
+        : block(std::move(block))
+        , range(range)
+        , tag(std::move(tag))
+    {
+        this->block->ledger->add(this->tag, this->range.size);
+    }
+
+    MemoryAllocator::Allocation::Allocation(Allocation&& other) noexcept
+        : block(std::move(other.block))
+        , range(other.range)
+        , tag(std::move(other.tag))
+    {
+        other.range = SubAllocator::Allocation{};
+    }
+
+    MemoryAllocator::Allocation& MemoryAllocator::Allocation::operator=(Allocation&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            this->block = std::move(other.block);
+            this->range = other.range;
+            this->tag   = std::move(other.tag);
+            other.range = SubAllocator::Allocation{};
+        }
+        return *this;
+    }
+
+    MemoryAllocator::Allocation::~Allocation()
+    {
+        reset();
+    }
+
+    void MemoryAllocator::Allocation::reset()
+    {
+        if (this->block)
+        {
+            this->block->ledger->remove(this->tag, this->range.size);
+        }
+        if (this->block && this->block->ranges)
+        {
+            std::lock_guard<std::mutex> lock{this->block->mutex};
+            this->block->ranges->free(this->range);
+        }
+        this->block.reset();
+        this->range = SubAllocator::Allocation{};
+    }
+
+    vk::DeviceMemory MemoryAllocator::Allocation::getMemory() const
+    {
+        return this->block ? this->block->memory.get() : vk::DeviceMemory{};
+    }
+
+    vk::DeviceSize MemoryAllocator::Allocation::getOffset() const
+    {
+        return this->range.offset;
+    }
+
+    vk::DeviceSize MemoryAllocator::Allocation::getSize() const
+    {
+        return this->range.size;
+    }
+
+    const MemoryAllocator::Tag& MemoryAllocator::Allocation::getTag() const
+    {
+        return this->tag;
+    }
+
+    void* MemoryAllocator::Allocation::map() const
+    {
+        if (!this->block || !this->block->mapped)
+        {
+            throw std::runtime_error("mapping memory that is not host visible");
+        }
+        return this->block->mapped + this->range.offset;
+    }
+
+    MemoryAllocator::Allocation::operator bool() const
+    {
+        return static_cast<bool>(this->block);
+    }
+
+    MemoryAllocator::MemoryAllocator(CreateInfo& ci)
+        : physicalDevice(ci.physicalDevice)
+        , device(ci.device)
+        , memoryProperties(ci.physicalDevice.getMemoryProperties())
+        , blockSize(ci.blockSize)
+        , ledger(std::make_shared<Ledger>())
+    {
+        this->ledger->heaps.resize(this->memoryProperties.memoryHeapCount);
+
+        auto extensions = this->physicalDevice.enumerateDeviceExtensionProperties();
+        this->hasBudget = std::any_of(extensions.begin(), extensions.end(), [](const vk::ExtensionProperties& extension)
+        {
+            return std::string(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        });
+    }
+
+    MemoryAllocator& MemoryAllocator::get(vk::Device device, vk::PhysicalDevice physicalDevice)
+    {
+        std::lock_guard<std::mutex> lock{registryMutex};
+
+        auto& allocator = registry[static_cast<VkDevice>(device)];
+        if (!allocator)
+        {
+            CreateInfo ci{ physicalDevice, device };
+            allocator = std::make_unique<MemoryAllocator>(ci);
+        }
+        return *allocator;
+    }
+
+    void MemoryAllocator::release(vk::Device device)
+    {
+        std::lock_guard<std::mutex> lock{registryMutex};
+        registry.erase(static_cast<VkDevice>(device));
+    }
+
+    std::shared_ptr<MemoryAllocator::Block> MemoryAllocator::createBlock(uint32_t memoryType, vk::DeviceSize size)
+    {
+        // buffers made with eShaderDeviceAddress may land in any block
+        vk::MemoryAllocateFlagsInfo memoryFlagsInfo{};
+        memoryFlagsInfo.flags = vk::MemoryAllocateFlagBits::eDeviceAddress;
+
+        auto block = std::make_shared<Block>();
+        block->memory = this->device.allocateMemoryUnique(
+                vk::MemoryAllocateInfo{}
+                .setAllocationSize(size)
+                .setMemoryTypeIndex(memoryType)
+                .setPNext(&memoryFlagsInfo)
+                );
+
+        block->ledger = this->ledger;
+        block->heap   = this->memoryProperties.memoryTypes[memoryType].heapIndex;
+        block->size   = size;
+        {
+            std::lock_guard<std::mutex> lock{this->ledger->mutex};
+            this->ledger->heaps[block->heap] += size;
+        }
+
+        if (this->memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        {
+            block->mapped = static_cast<uint8_t*>(this->device.mapMemory(block->memory.get(), 0, VK_WHOLE_SIZE));
+        }
+
+        return block;
+    }
+
+    MemoryAllocator::Allocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear, Tag tag)
+    {
+        uint32_t memoryType = Application::getMemoryType(this->physicalDevice, requirements, properties);
+
+        // small heaps (e.g. the host-visible device-local window) get smaller blocks
+        vk::DeviceSize heapSize  = this->memoryProperties.memoryHeaps[this->memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        vk::DeviceSize blockSize = std::max<vk::DeviceSize>(std::min(this->blockSize, heapSize / 8), 1u << 20);
+
+        if (requirements.size >= blockSize / 2)
+        {
+            auto block = createBlock(memoryType, requirements.size);
+            return Allocation{ std::move(block), SubAllocator::Allocation{ 0, requirements.size }, std::move(tag) };
+        }
+
+        std::lock_guard<std::mutex> lock{this->mutex};
+        Pool& pool = this->pools[{ memoryType, linear }];
+
+        SubAllocator::Allocation range{};
+        for (auto& block : pool.blocks)
+        {
+            std::lock_guard<std::mutex> blockLock{block->mutex};
+            if (block->ranges->allocate(requirements.size, requirements.alignment, range))
+            {
+                return Allocation{ block, range, std::move(tag) };
+            }
+        }
+
+        auto block = createBlock(memoryType, blockSize);
+        block->ranges = std::make_unique<SubAllocator>(blockSize);
+        if (!block->ranges->allocate(requirements.size, requirements.alignment, range))
+        {
+            throw std::runtime_error("memory requirements do not fit into a fresh block");
+        }
+        pool.blocks.push_back(block);
+
+        return Allocation{ std::move(block), range, std::move(tag) };
+    }
+
+    MemoryAllocator::Allocation MemoryAllocator::allocate(vk::Buffer buffer, vk::MemoryPropertyFlags properties, Tag tag)
+    {
+        Allocation allocation = allocate(this->device.getBufferMemoryRequirements(buffer), properties, true, std::move(tag));
+        this->device.bindBufferMemory(buffer, allocation.getMemory(), allocation.getOffset());
+        return allocation;
+    }
+
+    MemoryAllocator::Allocation MemoryAllocator::allocate(vk::Image image, vk::MemoryPropertyFlags properties, vk::ImageTiling tiling, Tag tag)
+    {
+        Allocation allocation = allocate(this->device.getImageMemoryRequirements(image), properties, tiling == vk::ImageTiling::eLinear, std::move(tag));
+        this->device.bindImageMemory(image, allocation.getMemory(), allocation.getOffset());
+        return allocation;
+    }
+
+    void MemoryAllocator::trim()
+    {
+        std::lock_guard<std::mutex> lock{this->mutex};
+
+        for (auto& [key, pool] : this->pools)
+        {
+            std::erase_if(pool.blocks, [](const std::shared_ptr<Block>& block)
+            {
+                std::lock_guard<std::mutex> blockLock{block->mutex};
+                return block->ranges->isEmpty();
+            });
+        }
+    }
+
+    MemoryAllocator::Report MemoryAllocator::getReport()
+    {
+        Report report{};
+        report.hasBudget = this->hasBudget;
+        {
+            std::lock_guard<std::mutex> lock{this->ledger->mutex};
+            report.categories = this->ledger->categories;
+            report.owners     = this->ledger->owners;
+
+            for (uint32_t i = 0; i < this->memoryProperties.memoryHeapCount; ++i)
+            {
+                const vk::MemoryHeap& heap = this->memoryProperties.memoryHeaps[i];
+                report.heaps.push_back({ heap.size, static_cast<bool>(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal), this->ledger->heaps[i], 0, 0 });
+            }
+        }
+
+        if (this->hasBudget)
+        {
+            auto properties = this->physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+            const auto& budget = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+            for (size_t i = 0; i < report.heaps.size(); ++i)
+            {
+                report.heaps[i].budget = budget.heapBudget[i];
+                report.heaps[i].usage  = budget.heapUsage[i];
+            }
+        }
+
+        return report;
+    }
+
+    void MemoryAllocator::dumpReport(const std::string& path)
+    {
+        Report report = getReport();
+
+        auto toJson = [](const Usages& usages)
+        {
+            nlohmann::json json = nlohmann::json::object();
+            for (size_t i = 0; i < CATEGORY_COUNT; ++i)
+            {
+                const Usage& usage = usages[i];
+                if (!usage.peak) continue;
+                json[getCategoryName(static_cast<Category>(i))] = { {"bytes", usage.bytes}, {"peak", usage.peak}, {"count", usage.count} };
+            }
+            return json;
+        };
+
+        nlohmann::json json{};
+        json["categories"] = toJson(report.categories);
+        json["owners"]     = nlohmann::json::object();
+        for (const auto& [owner, usages] : report.owners)
+        {
+            json["owners"][owner.empty() ? "unowned" : owner] = toJson(usages);
+        }
+
+        json["heaps"] = nlohmann::json::array();
+        for (const Heap& heap : report.heaps)
+        {
+            nlohmann::json entry = { {"size", heap.size}, {"deviceLocal", heap.deviceLocal}, {"blocks", heap.blocks} };
+            if (report.hasBudget)
+            {
+                entry["budget"] = heap.budget;
+                entry["usage"]  = heap.usage;
+            }
+            json["heaps"].push_back(entry);
+        }
+
+        std::ofstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("could not open " + path + " for writing");
+        }
+        file << json.dump(4);
+    }
+}
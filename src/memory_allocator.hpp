@@ -0,0 +1,180 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef MEMORY_ALLOCATOR_HPP
+#define MEMORY_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sub_allocator.hpp"
+
+#define VLB_MEMORY_REPORT_PATH "vlb_memory.json"
+
+namespace vlb {
+
+    // Device memory for every Application::Buffer and Application::Image. Resources
+    // are placed in large blocks, one pool per memory type, and sub-allocated with
+    // SubAllocator; buffers and optimal-tiling images use separate pools, so
+    // bufferImageGranularity never applies between neighbours. Resources of at least
+    // half a block get a dedicated allocation. Host-visible blocks stay mapped.
+    // Every allocation is accounted under a Tag; getReport() puts those numbers next
+    // to what the blocks take from each heap and, with VK_EXT_memory_budget, to what
+    // the driver reports.
+    class MemoryAllocator
+    {
+        public:
+            struct CreateInfo
+            {
+                vk::PhysicalDevice physicalDevice;
+                vk::Device         device;
+                vk::DeviceSize     blockSize = 64ull << 20;
+            };
+
+            enum class Category : uint32_t
+            {
+                eOther,
+                eAccelerationStructure,
+                eScratch,
+                eVertex,
+                eIndex,
+                eTexture,
+                eSHProbes,
+                eStaging,
+                eShaderBindingTable,
+                eCount
+            };
+            static constexpr size_t CATEGORY_COUNT = static_cast<size_t>(Category::eCount);
+            static const char* getCategoryName(Category category);
+
+            // What an allocation holds and who holds it: a scene name, or a subsystem
+            // for resources that belong to no scene
+            struct Tag
+            {
+                Category    category = Category::eOther;
+                std::string owner{};
+            };
+
+            struct Usage
+            {
+                vk::DeviceSize bytes = 0;
+                vk::DeviceSize peak  = 0;
+                uint64_t       count = 0; // live allocations
+            };
+            typedef std::array<Usage, CATEGORY_COUNT> Usages;
+
+            struct Heap
+            {
+                vk::DeviceSize size;
+                bool           deviceLocal;
+                vk::DeviceSize blocks; // device memory the allocator holds in this heap
+                vk::DeviceSize budget; // VK_EXT_memory_budget, 0 without it
+                vk::DeviceSize usage;  // same, includes what was allocated around the allocator
+            };
+
+            struct Report
+            {
+                Usages                        categories; // peaks of the sums, not sums of the peaks
+                std::map<std::string, Usages> owners;
+                std::vector<Heap>             heaps;
+                bool                          hasBudget;
+            };
+
+        private:
+            // Outlives the allocator as long as a block does
+            struct Ledger
+            {
+                std::mutex                    mutex;
+                Usages                        categories;
+                std::map<std::string, Usages> owners;
+                std::vector<vk::DeviceSize>   heaps; // block bytes by heap index
+
+                void add(const Tag& tag, vk::DeviceSize size);
+                void remove(const Tag& tag, vk::DeviceSize size);
+            };
+
+            struct Block
+            {
+                std::mutex                    mutex;
+                vk::UniqueDeviceMemory        memory;
+                uint8_t*                      mapped = nullptr;
+                std::unique_ptr<SubAllocator> ranges; // null for dedicated allocations
+                std::shared_ptr<Ledger>       ledger;
+                uint32_t                      heap = 0;
+                vk::DeviceSize                size = 0;
+
+                ~Block();
+            };
+
+        public:
+            // Owns a range of a block and returns it on destruction, like vk::UniqueDeviceMemory
+            class Allocation
+            {
+                private:
+                    std::shared_ptr<Block>   block;
+                    SubAllocator::Allocation range;
+                    Tag                      tag;
+
+                public:
+                    Allocation() = default;
+                    Allocation(std::shared_ptr<Block> block, SubAllocator::Allocation range, Tag tag);
+                    Allocation(Allocation&& other) noexcept;
+                    Allocation& operator=(Allocation&& other) noexcept;
+                    ~Allocation();
+
+                    vk::DeviceMemory getMemory() const;
+                    vk::DeviceSize   getOffset() const;
+                    vk::DeviceSize   getSize() const;
+                    const Tag&       getTag() const;
+                    void*            map() const; // persistent mapping, host-visible memory only
+                    void             reset();
+
+                    explicit operator bool() const;
+            };
+
+        private:
+            struct Pool
+            {
+                std::vector<std::shared_ptr<Block>> blocks;
+            };
+
+            vk::PhysicalDevice                 physicalDevice;
+            vk::Device                         device;
+            vk::PhysicalDeviceMemoryProperties memoryProperties;
+            vk::DeviceSize                     blockSize;
+            bool                               hasBudget;
+            std::shared_ptr<Ledger>            ledger;
+
+            std::mutex                         mutex;
+            std::map<std::pair<uint32_t, bool>, Pool> pools; // memory type, linear (buffers and linear images)
+
+            std::shared_ptr<Block> createBlock(uint32_t memoryType, vk::DeviceSize size);
+            Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear, Tag tag);
+
+        public:
+            MemoryAllocator(CreateInfo& ci);
+
+            MemoryAllocator(const MemoryAllocator& other) = delete;
+
+            // One allocator per device, made on first use
+            static MemoryAllocator& get(vk::Device device, vk::PhysicalDevice physicalDevice);
+            static void             release(vk::Device device);
+
+            // Allocates and binds
+            Allocation allocate(vk::Buffer buffer, vk::MemoryPropertyFlags properties, Tag tag = {});
+            Allocation allocate(vk::Image image, vk::MemoryPropertyFlags properties, vk::ImageTiling tiling = vk::ImageTiling::eOptimal, Tag tag = {});
+
+            void trim(); // frees blocks nothing lives in anymore
+
+            Report getReport();
+            void   dumpReport(const std::string& path); // getReport() as JSON, sizes in bytes
+    };
+}
+
+#endif // ifndef MEMORY_ALLOCATOR_HPP
+
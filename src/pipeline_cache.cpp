@@ -0,0 +1,115 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "application.hpp"
+#include "pipeline_cache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace vlb {
+
+    namespace {
+        // VkPipelineCacheHeaderVersionOne, the start of every cache blob
+        struct Header
+        {
+            uint32_t headerSize;
+            uint32_t headerVersion;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+        };
+        static_assert(sizeof(Header) == 32);
+
+        std::mutex                                  registryMutex;
+        std::map<VkDevice, vk::UniquePipelineCache> registry;
+
+        // Empty unless the file was written by this very driver and device
+        std::vector<char> readCacheFile(vk::PhysicalDevice physicalDevice)
+        {
+            std::ifstream file(VLB_PIPELINE_CACHE_PATH, std::ios::binary | std::ios::ate);
+            if (!file)
+            {
+                return {};
+            }
+
+            std::vector<char> data(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+            if (!file || data.size() < sizeof(Header))
+            {
+                return {};
+            }
+
+            Header header{};
+            memcpy(&header, data.data(), sizeof(Header));
+
+            const vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+            const bool valid = header.headerSize >= sizeof(Header)
+                && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                && header.vendorID == properties.vendorID
+                && header.deviceID == properties.deviceID
+                && !memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+
+            return valid ? data : std::vector<char>{};
+        }
+
+        void writeCacheFile(const std::vector<uint8_t>& data)
+        {
+            // written aside and renamed, so a crash never leaves half a cache behind
+            const std::string temporary = std::string(VLB_PIPELINE_CACHE_PATH) + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                file.write(reinterpret_cast<const char*>(data.data()), data.size());
+                if (!file)
+                {
+                    throw std::runtime_error("failed to write " + temporary);
+                }
+            }
+
+            std::filesystem::rename(temporary, VLB_PIPELINE_CACHE_PATH);
+        }
+    }
+
+    vk::PipelineCache PipelineCache::get(vk::Device device, vk::PhysicalDevice physicalDevice)
+    {
+        std::lock_guard<std::mutex> lock{registryMutex};
+
+        auto& cache = registry[static_cast<VkDevice>(device)];
+        if (!cache)
+        {
+            const std::vector<char> data = readCacheFile(physicalDevice);
+            cache = device.createPipelineCacheUnique(
+                    vk::PipelineCacheCreateInfo{}
+                    .setInitialDataSize(data.size())
+                    .setPInitialData(data.data()));
+        }
+        return cache.get();
+    }
+
+    void PipelineCache::release(vk::Device device)
+    {
+        std::lock_guard<std::mutex> lock{registryMutex};
+
+        auto it = registry.find(static_cast<VkDevice>(device));
+        if (it == registry.end())
+        {
+            return;
+        }
+
+        try
+        {
+            writeCacheFile(device.getPipelineCacheData(it->second.get()));
+        }
+        catch (std::exception& error)
+        {
+            printf("Warn: pipeline cache not written: %s\n", error.what());
+        }
+
+        registry.erase(it);
+    }
+}
+
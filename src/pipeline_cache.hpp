@@ -0,0 +1,28 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef PIPELINE_CACHE_HPP
+#define PIPELINE_CACHE_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#define VLB_PIPELINE_CACHE_PATH "vlb_pipelines.cache"
+
+namespace vlb {
+
+    // One vk::PipelineCache per device, shared by every pipeline in the process.
+    // It starts from VLB_PIPELINE_CACHE_PATH when that file was written for the same
+    // vendor, device and pipelineCacheUUID, and release() writes it back, so a cold
+    // start does not compile the shaders again.
+    class PipelineCache
+    {
+        public:
+            // Made on first use
+            static vk::PipelineCache get(vk::Device device, vk::PhysicalDevice physicalDevice);
+
+            // Saves the cache and destroys it; call before the device goes
+            static void release(vk::Device device);
+    };
+}
+
+#endif // ifndef PIPELINE_CACHE_HPP
+
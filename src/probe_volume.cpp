@@ -0,0 +1,154 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "probe_volume.hpp"
+
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    // false when the product does not fit, header fields come straight from disk
+    bool multiply(uint64_t& product, uint64_t factor)
+    {
+        if (factor && product > std::numeric_limits<uint64_t>::max() / factor) return false;
+        product *= factor;
+        return true;
+    }
+}
+
+namespace vlb {
+
+    uint32_t ProbeVolume::getCoeffsPerProbe(uint32_t lmax)
+    {
+        return (lmax + 1u) * (lmax + 1u);
+    }
+
+    uint32_t ProbeVolume::getCoeffSize(Encoding encoding)
+    {
+        switch (encoding)
+        {
+            case Encoding::eFloat32RGB:
+                return 3u * sizeof(float);
+            default:
+                throw std::runtime_error("unknown probe volume encoding");
+        }
+    }
+
+    void ProbeVolume::write(const std::string& path, Header header, std::span<const uint8_t> data)
+    {
+        header.magic      = ProbeVolume::magic;
+        header.version    = ProbeVolume::version;
+        header.reserved   = 0u;
+        header.dataOffset = (sizeof(Header) + dataAlignment - 1) / dataAlignment * dataAlignment;
+        header.dataSize   = data.size();
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("could not open " + path + " for writing");
+        }
+
+        std::vector<char> padding(header.dataOffset - sizeof(Header), 0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(padding.data(), padding.size());
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+        if (!file)
+        {
+            throw std::runtime_error("failed to write " + path);
+        }
+    }
+
+    ProbeVolume::ProbeVolume(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            throw std::runtime_error("could not open probe volume: " + path);
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) == -1)
+        {
+            close(fd);
+            throw std::runtime_error("could not stat probe volume: " + path);
+        }
+        this->size = static_cast<size_t>(info.st_size);
+
+        if (this->size >= sizeof(Header))
+        {
+            this->mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+
+        if (!this->mapped || this->mapped == MAP_FAILED)
+        {
+            this->mapped = nullptr;
+            throw std::runtime_error("could not map probe volume: " + path);
+        }
+
+        const Header& header = getHeader();
+        bool valid = header.magic == ProbeVolume::magic
+            && header.version == ProbeVolume::version
+            && header.encoding < Encoding::eEncodingCount
+            && header.dataOffset >= sizeof(Header)
+            && header.dataOffset <= this->size
+            && header.dataSize <= this->size - header.dataOffset;
+
+        if (valid)
+        {
+            uint64_t dataSize = 1u;
+            valid = multiply(dataSize, header.dims[0])
+                && multiply(dataSize, header.dims[1])
+                && multiply(dataSize, header.dims[2]);
+            this->probeCount = dataSize;
+
+            // (lmax + 1)^2 coefficients, in 64 bits as lmax is not checked yet
+            valid = valid
+                && multiply(dataSize, uint64_t(header.lmax) + 1u)
+                && multiply(dataSize, uint64_t(header.lmax) + 1u)
+                && multiply(dataSize, getCoeffSize(header.encoding))
+                && header.dataSize == dataSize;
+        }
+
+        if (!valid)
+        {
+            munmap(this->mapped, this->size);
+            this->mapped = nullptr;
+            throw std::runtime_error("invalid or unsupported probe volume: " + path);
+        }
+
+        madvise(this->mapped, this->size, MADV_SEQUENTIAL);
+    }
+
+    ProbeVolume::~ProbeVolume()
+    {
+        if (this->mapped)
+        {
+            munmap(this->mapped, this->size);
+        }
+    }
+
+    const ProbeVolume::Header& ProbeVolume::getHeader()
+    {
+        return *static_cast<const Header*>(this->mapped);
+    }
+
+    uint64_t ProbeVolume::getProbeCount()
+    {
+        return this->probeCount;
+    }
+
+    std::span<const uint8_t> ProbeVolume::getData()
+    {
+        const Header& header = getHeader();
+        return { static_cast<const uint8_t*>(this->mapped) + header.dataOffset, header.dataSize };
+    }
+}
@@ -0,0 +1,68 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef PROBE_VOLUME_HPP
+#define PROBE_VOLUME_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <span>
+
+#define VLB_PROBE_VOLUME_EXTENSION ".vlbprobe"
+#define VLB_SH_MAX_LMAX 4 // keep in sync with SH_MAX_LMAX in shaders/sh_common.h
+
+namespace vlb {
+
+    // Binary container for baked probe grids (*.vlbprobe):
+    // [Header][padding up to dataOffset][coefficients, probe-major, x fastest]
+    class ProbeVolume
+    {
+        public:
+            static constexpr uint32_t magic         = 0x50424c56; // "VLBP"
+            static constexpr uint32_t version       = 1u;
+            static constexpr uint64_t dataAlignment = 256u;
+
+            enum class Encoding : uint32_t
+            {
+                eFloat32RGB, // one vec3 per coefficient
+                eEncodingCount
+            };
+
+            struct Header
+            {
+                uint32_t magic;
+                uint32_t version;
+                float    origin[3];
+                uint32_t dims[3];
+                float    step[3];
+                uint32_t lmax;     // highest SH band, (lmax + 1)^2 coefficients per probe
+                Encoding encoding;
+                uint32_t reserved;
+                uint64_t dataOffset;
+                uint64_t dataSize;
+            };
+            static_assert(sizeof(Header) == 72);
+
+            static void write(const std::string& path, Header header, std::span<const uint8_t> data);
+
+            ProbeVolume() = delete;
+            ProbeVolume(const std::string& path); // maps the file read-only and validates the header
+            ProbeVolume(const ProbeVolume& other) = delete;
+            ~ProbeVolume();
+
+            const Header&            getHeader();
+            std::span<const uint8_t> getData();
+            uint64_t                 getProbeCount(); // dims product, checked against dataSize on load
+
+            static uint32_t getCoeffsPerProbe(uint32_t lmax);
+            static uint32_t getCoeffSize(Encoding encoding);
+
+        private:
+            void*    mapped     = nullptr;
+            size_t   size       = 0;
+            uint64_t probeCount = 0;
+    };
+}
+
+#endif // ifndef PROBE_VOLUME_HPP
+
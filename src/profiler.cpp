@@ -0,0 +1,311 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "application.hpp"
+#include "profiler.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace vlb {
+
+    namespace {
+        constexpr uint32_t GPU_QUERIES    = 4096;    // per queue, two per scope
+        constexpr uint32_t GPU_TRACKS     = 1000;    // first track id of the queues, CPU threads count from 0
+        constexpr size_t   MAX_EVENTS     = 1 << 20; // the trace keeps the newest ones
+        constexpr size_t   FRAME_HISTORY  = 240;
+        constexpr double   AVERAGE_WEIGHT = 0.05;    // share of the newest sample in Stat::averageMs
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point epoch = Clock::now();
+
+        int64_t now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+        }
+
+        // nanoseconds since epoch
+        struct Event
+        {
+            const char* name;
+            uint32_t    track;
+            int64_t     start;
+            int64_t     duration;
+        };
+
+        struct PendingScope
+        {
+            const char* name;
+            uint32_t    query;
+            int64_t     recordedAt;
+        };
+
+        struct QueryRing
+        {
+            vk::Device               device;
+            vk::UniqueQueryPool      pool;
+            uint32_t                 track;
+            double                   period; // nanoseconds per tick
+            uint64_t                 mask;   // timestampValidBits
+            uint32_t                 next = 0;
+            std::deque<PendingScope> pending;
+
+            // GPU clock to CPU clock: the latest offset that starts no scope before it was recorded
+            int64_t offset = std::numeric_limits<int64_t>::min();
+        };
+
+        std::mutex                                             mutex;
+        std::map<VkQueue, QueryRing>                           rings;
+        std::map<uint32_t, std::string>                        trackNames;
+        std::deque<Event>                                      events;
+        std::map<std::pair<std::string, bool>, Profiler::Stat> stats; // by name, GPU or not
+        std::vector<float>                                     frameTimes;
+        size_t                                                 frameCursor = 0;
+        int64_t                                                lastFrame   = -1;
+
+        std::atomic<uint32_t> threadCount{0};
+
+        uint32_t threadTrack()
+        {
+            thread_local const uint32_t track = threadCount++;
+            return track;
+        }
+
+        // mutex held
+        void record(const char* name, uint32_t track, int64_t start, int64_t duration, bool gpu)
+        {
+            if (!trackNames.contains(track))
+            {
+                trackNames[track] = "CPU thread " + std::to_string(track);
+            }
+
+            events.push_back({ name, track, start, duration });
+            if (events.size() > MAX_EVENTS)
+            {
+                events.pop_front();
+            }
+
+            const double ms = duration * 1e-6;
+            auto [it, inserted] = stats.try_emplace(std::pair<std::string, bool>{ name, gpu }, Profiler::Stat{ name, gpu, ms, ms, 0 });
+            Profiler::Stat& stat = it->second;
+            stat.lastMs    = ms;
+            stat.averageMs = inserted ? ms : stat.averageMs + AVERAGE_WEIGHT * (ms - stat.averageMs);
+            stat.count++;
+        }
+    }
+
+    Profiler::Scope::Scope(const char* name)
+        : name(name)
+    {
+        if (Profiler::isEnabled())
+        {
+            this->start = now();
+        }
+    }
+
+    Profiler::Scope::~Scope()
+    {
+        if (this->start < 0) return;
+
+        const int64_t end = now();
+        std::lock_guard<std::mutex> lock{mutex};
+        record(this->name, threadTrack(), this->start, end - this->start, false);
+    }
+
+    Profiler::GpuScope::GpuScope(vk::CommandBuffer cmd, vk::Queue queue, const char* name)
+        : cmd(cmd)
+    {
+        if (!Profiler::isEnabled()) return;
+
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto it = rings.find(static_cast<VkQueue>(queue));
+        if (it == rings.end()) return;
+        QueryRing& ring = it->second;
+
+        // the oldest scope never finished (its commands were not submitted), its queries get reused
+        if (ring.pending.size() >= GPU_QUERIES / 2)
+        {
+            ring.pending.pop_front();
+        }
+
+        this->pool  = ring.pool.get();
+        this->query = ring.next;
+        ring.next   = (ring.next + 2) % GPU_QUERIES;
+
+        ring.device.resetQueryPool(this->pool, this->query, 2);
+        ring.pending.push_back({ name, this->query, now() });
+
+        this->cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, this->pool, this->query);
+    }
+
+    Profiler::GpuScope::~GpuScope()
+    {
+        if (!this->pool) return;
+
+        this->cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, this->pool, this->query + 1);
+    }
+
+    void Profiler::setEnabled(bool enable)
+    {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    void Profiler::attach(vk::Device device, vk::PhysicalDevice physicalDevice, vk::Queue queue, uint32_t queueFamily, const char* name)
+    {
+        const uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamily].timestampValidBits;
+        if (!validBits) return;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        if (rings.contains(static_cast<VkQueue>(queue))) return; // one queue serving several roles
+
+        QueryRing ring{};
+        ring.device = device;
+        ring.pool   = device.createQueryPoolUnique(
+                vk::QueryPoolCreateInfo{}
+                .setQueryType(vk::QueryType::eTimestamp)
+                .setQueryCount(GPU_QUERIES));
+        ring.track  = GPU_TRACKS + static_cast<uint32_t>(rings.size());
+        ring.period = physicalDevice.getProperties().limits.timestampPeriod;
+        ring.mask   = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        device.resetQueryPool(ring.pool.get(), 0, GPU_QUERIES);
+
+        trackNames[ring.track] = std::string("GPU ") + name + " queue";
+        rings.emplace(static_cast<VkQueue>(queue), std::move(ring));
+    }
+
+    void Profiler::release(vk::Device device)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        std::erase_if(rings, [&](const auto& entry) { return entry.second.device == device; });
+    }
+
+    void Profiler::collect()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        for (auto& [queue, ring] : rings)
+        {
+            std::erase_if(ring.pending, [&](const PendingScope& scope)
+            {
+                // value and availability of both queries
+                std::array<uint64_t, 4> results{};
+                auto result = ring.device.getQueryPoolResults(ring.pool.get(), scope.query, 2, sizeof(results), results.data(),
+                        2 * sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+                if (result != vk::Result::eSuccess || !results[1] || !results[3]) return false;
+
+                const int64_t begin = static_cast<int64_t>((results[0] & ring.mask) * ring.period);
+                const int64_t end   = static_cast<int64_t>((results[2] & ring.mask) * ring.period);
+
+                ring.offset = std::max(ring.offset, scope.recordedAt - begin);
+                record(scope.name, ring.track, begin + ring.offset, std::max<int64_t>(end - begin, 0), true);
+                return true;
+            });
+        }
+    }
+
+    void Profiler::frame()
+    {
+        if (!isEnabled())
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            lastFrame = -1;
+            return;
+        }
+
+        collect();
+
+        const int64_t time = now();
+        std::lock_guard<std::mutex> lock{mutex};
+
+        if (lastFrame >= 0)
+        {
+            const float ms = (time - lastFrame) * 1e-6f;
+            if (frameTimes.size() < FRAME_HISTORY)
+            {
+                frameTimes.push_back(ms);
+            }
+            else
+            {
+                frameTimes[frameCursor] = ms;
+            }
+            frameCursor = (frameCursor + 1) % FRAME_HISTORY;
+
+            record("frame", threadTrack(), lastFrame, time - lastFrame, false);
+        }
+        lastFrame = time;
+    }
+
+    std::vector<float> Profiler::getFrameTimes()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        std::vector<float> ordered(frameTimes.begin(), frameTimes.end());
+        if (ordered.size() == FRAME_HISTORY)
+        {
+            std::rotate(ordered.begin(), ordered.begin() + frameCursor, ordered.end());
+        }
+        return ordered;
+    }
+
+    std::vector<Profiler::Stat> Profiler::getStats()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        std::vector<Stat> result{};
+        for (const auto& [key, stat] : stats)
+        {
+            result.push_back(stat);
+        }
+        return result;
+    }
+
+    void Profiler::exportChromeTrace(const std::string& path)
+    {
+        collect();
+
+        nlohmann::json trace{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+
+            auto traceEvents = nlohmann::json::array();
+            for (const auto& [track, name] : trackNames)
+            {
+                traceEvents.push_back({ {"name", "thread_name"}, {"ph", "M"}, {"pid", 0}, {"tid", track}, {"args", {{"name", name}}} });
+            }
+
+            // Chrome traces count in microseconds
+            for (const Event& event : events)
+            {
+                traceEvents.push_back({
+                        {"name", event.name},
+                        {"cat", event.track >= GPU_TRACKS ? "gpu" : "cpu"},
+                        {"ph", "X"},
+                        {"pid", 0},
+                        {"tid", event.track},
+                        {"ts", event.start * 1e-3},
+                        {"dur", event.duration * 1e-3} });
+            }
+
+            trace["traceEvents"]     = std::move(traceEvents);
+            trace["displayTimeUnit"] = "ms";
+        }
+
+        std::ofstream file(path);
+        if (!file)
+        {
+            throw std::runtime_error("could not open " + path + " for writing");
+        }
+        file << trace;
+    }
+}
@@ -0,0 +1,84 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define VLB_PROFILER_TRACE_PATH "vlb_trace.json"
+
+namespace vlb {
+
+    // CPU scopes and GPU timestamp pairs, kept as a Chrome trace (chrome://tracing,
+    // ui.perfetto.dev) and as running statistics per scope name. Off by default: a
+    // scope of a disabled profiler costs one relaxed atomic load.
+    class Profiler
+    {
+        public:
+            struct Stat
+            {
+                std::string name;
+                bool        gpu;
+                double      lastMs;
+                double      averageMs; // exponential moving average
+                uint64_t    count;
+            };
+
+            // Times its own lifetime on the calling thread. name must outlive the profiler,
+            // scopes are meant to be named with literals
+            class Scope
+            {
+                private:
+                    const char* name;
+                    int64_t     start = -1;
+
+                public:
+                    explicit Scope(const char* name);
+                    Scope(const Scope& other) = delete;
+                    ~Scope();
+            };
+
+            // Timestamps around what is recorded into cmd during its lifetime; queue is the
+            // one cmd gets submitted to. Queues that were not attach()ed are not timed.
+            class GpuScope
+            {
+                private:
+                    vk::CommandBuffer cmd;
+                    vk::QueryPool     pool;
+                    uint32_t          query = 0;
+
+                public:
+                    GpuScope(vk::CommandBuffer cmd, vk::Queue queue, const char* name);
+                    GpuScope(const GpuScope& other) = delete;
+                    ~GpuScope();
+            };
+
+            static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+            static void setEnabled(bool enable);
+
+            // Gives the queue a timestamp query pool, unless its family has no timestamps.
+            // The device needs hostQueryReset, release() before the device goes.
+            static void attach(vk::Device device, vk::PhysicalDevice physicalDevice, vk::Queue queue, uint32_t queueFamily, const char* name);
+            static void release(vk::Device device);
+
+            // Reads back GPU scopes that finished. frame() does it once per frame and adds
+            // the time since the previous frame() to the history.
+            static void collect();
+            static void frame();
+
+            static std::vector<float> getFrameTimes(); // milliseconds, oldest first
+            static std::vector<Stat>  getStats();
+
+            static void exportChromeTrace(const std::string& path);
+
+        private:
+            inline static std::atomic<bool> enabled{false};
+    };
+}
+
+#endif // ifndef PROFILER_HPP
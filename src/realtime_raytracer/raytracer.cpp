@@ -29,7 +29,7 @@ namespace vlb {
         layouts.push_back(this->skyboxManager.getDescriptorSetLayout());
 
         const std::vector<vk::PushConstantRange> constants{
-            { vk::ShaderStageFlagBits::eClosestHitKHR, 0, sizeof(Raytracer::Constants) }
+            { vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eMissKHR, 0, sizeof(Raytracer::Constants) }
         };
 
         this->pipelineLayout = this->device.get().createPipelineLayoutUnique(
@@ -84,12 +84,33 @@ namespace vlb {
             .setPName("main");
         shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eShadow));
 
+        // The SH misses are made for the band (and probe grid) of the current scene and skybox,
+        // see SH_LMAX in sh_common.h; the pipeline is rebuilt whenever either changes
+        auto& scene = this->sceneManager.getScene();
+        const std::array<uint32_t, 4> probeVolume{ scene->getLmax(), scene->getGridDims().x, scene->getGridDims().y, scene->getGridDims().z };
+        const std::array<vk::SpecializationMapEntry, 4> probeVolumeEntries{
+            vk::SpecializationMapEntry{ 0, 0 * sizeof(uint32_t), sizeof(uint32_t) }, // SH_LMAX
+            vk::SpecializationMapEntry{ 1, 1 * sizeof(uint32_t), sizeof(uint32_t) }, // GRID_DIMS_X
+            vk::SpecializationMapEntry{ 2, 2 * sizeof(uint32_t), sizeof(uint32_t) }, // GRID_DIMS_Y
+            vk::SpecializationMapEntry{ 3, 3 * sizeof(uint32_t), sizeof(uint32_t) }, // GRID_DIMS_Z
+        };
+        vk::SpecializationInfo probeVolumeSpecialization{};
+        probeVolumeSpecialization
+            .setMapEntries(probeVolumeEntries)
+            .setDataSize(sizeof(probeVolume))
+            .setPData(probeVolume.data());
+
+        const uint32_t                   skyboxLmax = VLB_SKYBOX_SH_LMAX;
+        const vk::SpecializationMapEntry skyboxLmaxEntry{ 0, 0, sizeof(uint32_t) };
+        const vk::SpecializationInfo     skyboxSpecialization{ 1, &skyboxLmaxEntry, sizeof(skyboxLmax), &skyboxLmax };
+
         shaderModules.push_back(Application::createShaderModule("shaders/sh.rmiss.spv"));
         shaderStages[StageIndices::eSH] = vk::PipelineShaderStageCreateInfo{};
         shaderStages[StageIndices::eSH]
             .setStage(vk::ShaderStageFlagBits::eMissKHR)
             .setModule(shaderModules.back().get())
-            .setPName("main");
+            .setPName("main")
+            .setPSpecializationInfo(&probeVolumeSpecialization);
         shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eSH));
 
         shaderModules.push_back(Application::createShaderModule("shaders/skybox_sh.rmiss.spv"));
@@ -97,7 +118,8 @@ namespace vlb {
         shaderStages[StageIndices::eSkyboxSH]
             .setStage(vk::ShaderStageFlagBits::eMissKHR)
             .setModule(shaderModules.back().get())
-            .setPName("main");
+            .setPName("main")
+            .setPSpecializationInfo(&skyboxSpecialization);
         shaderGroups.push_back(groupTemplate.setGeneralShader(StageIndices::eSkyboxSH));
 
         shaderModules.push_back(Application::createShaderModule("shaders/main.rchit.spv"));
@@ -114,7 +136,7 @@ namespace vlb {
                 );
 
         this->shaderGroupsCount = static_cast<uint32_t>(StageIndices::eShaderGroupCount);
-        auto[result, p] = this->device.get().createRayTracingPipelineKHRUnique(nullptr, nullptr,
+        auto[result, p] = this->device.get().createRayTracingPipelineKHRUnique(nullptr, PipelineCache::get(this->device.get(), this->physicalDevice),
                 vk::RayTracingPipelineCreateInfoKHR{}
                 .setStages(shaderStages)
                 .setGroups(shaderGroups)
@@ -169,8 +191,8 @@ namespace vlb {
                 );
 
         auto& scene = this->sceneManager.getScene();
-        this->constants.gridStep = scene->getGridStep();
-        this->constants.lmax     = scene->getLmax();
+        this->constants.gridStep   = scene->getGridStep();
+        this->constants.gridOrigin = scene->getGridOrigin();
         auto sceneLayout = scene->getDescriptorSetLayout();
         this->descriptorSet.scene = std::move(this->device.get().allocateDescriptorSetsUnique(
                     vk::DescriptorSetAllocateInfo{}
@@ -190,6 +212,8 @@ namespace vlb {
 
     void Raytracer::recordDrawCommandBuffer(uint64_t imageIndex)
     {
+        Profiler::Scope scope{"recordDrawCommandBuffer"};
+
         if (this->sceneManager.sceneChanged() || this->skyboxManager.skyboxChanged())
         {
             handleSceneChange();
@@ -201,6 +225,16 @@ namespace vlb {
         commandBuffer->begin(vk::CommandBufferBeginInfo{}
                 .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+        auto& scene = this->sceneManager.getScene();
+        if (scene->isAnimated())
+        {
+            const float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - this->startTime).count();
+            scene->animate(time);
+
+            Profiler::GpuScope gpuScope{commandBuffer.get(), this->queue.graphics, "TLAS refit"};
+            scene->recordTopLevelUpdate(commandBuffer.get(), static_cast<uint32_t>(imageIndex));
+        }
+
         commandBuffer->bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, this->pipeline.get());
 
         std::vector<vk::DescriptorSet> descriptorSets(0);
@@ -221,18 +255,21 @@ namespace vlb {
 
         commandBuffer->pushConstants(
                 this->pipelineLayout.get(),
-                vk::ShaderStageFlagBits::eClosestHitKHR,
+                vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eMissKHR,
                 0, sizeof(Raytracer::Constants), &this->constants
                 );
 
         auto[width, height, depth] = this->surfaceExtent;
-        commandBuffer->traceRaysKHR(
-                this->sbt.strides[0],
-                this->sbt.strides[1],
-                this->sbt.strides[2],
-                {},
-                width, height, depth
-                );
+        {
+            Profiler::GpuScope gpuScope{commandBuffer.get(), this->queue.graphics, "traceRays"};
+            commandBuffer->traceRaysKHR(
+                    this->sbt.strides[0],
+                    this->sbt.strides[1],
+                    this->sbt.strides[2],
+                    {},
+                    width, height, depth
+                    );
+        }
 
         vk::ImageSubresourceRange subresourceRange{};
         subresourceRange
@@ -269,7 +306,10 @@ namespace vlb {
         Application::setImageLayout(commandBuffer.get(), swapChainImage,
                 vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR, subresourceRange);
 
-        ui.draw(imageIndex, commandBuffer.get());
+        {
+            Profiler::GpuScope gpuScope{commandBuffer.get(), this->queue.graphics, "UI pass"};
+            ui.draw(imageIndex, commandBuffer.get());
+        }
 
         commandBuffer->end();
     }
@@ -277,7 +317,10 @@ namespace vlb {
     void Raytracer::draw()
     {
         auto timeout = std::numeric_limits<uint64_t>::max();
-        this->device.get().waitForFences(this->inFlightFences[this->currentFrame], true, timeout);
+        {
+            Profiler::Scope scope{"wait for frame"};
+            this->device.get().waitForFences(this->inFlightFences[this->currentFrame], true, timeout);
+        }
         this->device.get().resetFences(this->inFlightFences[this->currentFrame]);
 
         auto [result, imageIndex] = this->device.get().acquireNextImageKHR(
@@ -298,6 +341,7 @@ namespace vlb {
 
         recordDrawCommandBuffer(imageIndex);
 
+        Profiler::Scope scope{"submit and present"};
         vk::PipelineStageFlags waitStage{vk::PipelineStageFlagBits::eRayTracingShaderKHR};
         vk::SubmitInfo submitInfo{};
         submitInfo
@@ -306,19 +350,35 @@ namespace vlb {
             .setCommandBuffers(this->drawCommandBuffers[imageIndex].get())
             .setSignalSemaphores(this->renderFinishedSemaphores[this->currentFrame].get());
 
-        this->queue.graphics.submit(submitInfo, this->inFlightFences[this->currentFrame]);
+        {
+            auto lock = lockQueue(this->queue.graphics);
+            this->queue.graphics.submit(submitInfo, this->inFlightFences[this->currentFrame]);
+        }
 
         Renderer::present(imageIndex);
     }
 
     void Raytracer::createShaderBindingTable()
     {
-        this->sbt = Application::createShaderBindingTable(this->pipeline.get(), 4u, 1u);
+        this->sbt = Application::createShaderBindingTable(this->pipeline.get(), 4u, 1u, "raytracer");
     }
 
     void Raytracer::handleSceneChange()
     {
-        this->device.get().waitIdle();
+        Profiler::Scope scope{"handleSceneChange"};
+
+        // Only frames still in flight use the pipeline and descriptor sets; scenes loading
+        // on other queues go on. The current frame's fence is already reset.
+        std::vector<vk::Fence> framesInFlight{};
+        for (size_t frame = 0; frame < this->inFlightFences.size(); ++frame)
+        {
+            if (frame != this->currentFrame) framesInFlight.push_back(this->inFlightFences[frame]);
+        }
+        if (!framesInFlight.empty())
+        {
+            this->device.get().waitForFences(framesInFlight, true, std::numeric_limits<uint64_t>::max());
+        }
+
         createRayTracingPipeline();
         createShaderBindingTable();
         this->descriptorSet.scene.reset();
@@ -329,7 +389,7 @@ namespace vlb {
 
     Raytracer::Raytracer()
     {
-        this->rayGenStorage = createImage(this->surfaceFormat, this->surfaceExtent);
+        this->rayGenStorage = createImage(this->surfaceFormat, this->surfaceExtent, 1, vk::ImageViewType::e2D, { MemoryAllocator::Category::eOther, "raytracer" });
         createResultImageDSLayout();
 
         createRayTracingPipeline();
@@ -3,6 +3,8 @@
 #ifndef RAYTRACER_HPP
 #define RAYTRACER_HPP
 
+#include <chrono>
+
 #include "renderer.hpp"
 
 namespace vlb {
@@ -38,7 +40,7 @@ namespace vlb {
             struct Constants
             {
                 glm::vec3               gridStep;
-                unsigned                lmax;
+                glm::vec3               gridOrigin;
                 UI::InteractiveLighting lighting;
             } constants;
 
@@ -51,6 +53,8 @@ namespace vlb {
 
             std::vector<vk::UniqueCommandBuffer> drawCommandBuffers{};
 
+            std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now(); // animation clock
+
         public:
             Raytracer();
 
@@ -142,6 +142,7 @@ namespace vlb {
 
     void Renderer::present(uint32_t imageIndex)
     {
+        auto lock = lockQueue(this->queue.graphics);
         auto result = this->queue.graphics.presentKHR(
                 vk::PresentInfoKHR{}
                 .setWaitSemaphores(this->renderFinishedSemaphores[this->currentFrame].get())
@@ -195,7 +196,10 @@ namespace vlb {
                 this->commandPool.graphics.get(),
                 this->queue.compute,
                 this->commandPool.compute.get(),
-                static_cast<uint32_t>(this->swapchainImageViews.size())
+                static_cast<uint32_t>(this->swapchainImageViews.size()),
+                this->queueFamilyIndex.transfer,
+                this->queueFamilyIndex.graphics,
+                this->queueFamilyIndex.compute
         };
 
         this->sceneManager.passVulkanResources(context);
@@ -222,14 +226,23 @@ namespace vlb {
     {
         while (!glfwWindowShouldClose(this->window.get()))
         {
+            Profiler::frame();
+
             glfwPollEvents();
             //TODO: handle window resize here
-            this->ui.update();
+            {
+                Profiler::Scope scope{"UI update"};
+                this->ui.update();
+            }
+            {
+                Profiler::Scope scope{"SceneManager::update"};
+                this->sceneManager.update(); // swaps in scenes that finished loading
+            }
             draw();
             this->currentFrame = (this->currentFrame + 1) % this->maxFramesInFlight;
         }
 
-        this->device.get().waitIdle();
+        Application::waitIdle(this->device.get());
     }
 
     Renderer::Renderer()
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
+#include <numeric>
 
 namespace ImGui {
     static auto vector_getter = [](void* vec, int idx, const char** out_text)
@@ -105,26 +107,8 @@ namespace vlb {
 
         this->depthBuffer.handle = this->device.createImageUnique(imageCreateInfo);
 
-        vk::MemoryPropertyFlags memoryProperties   = vk::MemoryPropertyFlagBits::eDeviceLocal;
-        auto memoryRequirements             = this->device.getImageMemoryRequirements(this->depthBuffer.handle.get());
-        auto physicalDeviceMemoryProperties = this->physicalDevice.getMemoryProperties();
-
-        uint32_t typeIndex = -1;
-        for (uint32_t i{}; i < VK_MAX_MEMORY_TYPES; ++i)
-        {
-            if (memoryRequirements.memoryTypeBits & (1 << i))
-            {
-                if ((physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & memoryProperties) == memoryProperties)
-                {
-                    typeIndex = i;
-                    break;
-                }
-            }
-        }
-        assert(typeIndex != -1);
-
-        this->depthBuffer.memory = this->device.allocateMemoryUnique(vk::MemoryAllocateInfo(memoryRequirements.size, typeIndex));
-        this->device.bindImageMemory(this->depthBuffer.handle.get(), this->depthBuffer.memory.get(), 0);
+        this->depthBuffer.memory = MemoryAllocator::get(this->device, this->physicalDevice)
+            .allocate(this->depthBuffer.handle.get(), vk::MemoryPropertyFlagBits::eDeviceLocal, tiling);
 
         this->depthBuffer.imageView = this->device.createImageViewUnique(vk::ImageViewCreateInfo(vk::ImageViewCreateFlags(),
                     this->depthBuffer.handle.get(),
@@ -208,6 +192,7 @@ namespace vlb {
         init_info.PhysicalDevice = this->physicalDevice;
         init_info.Device = this->device;
         init_info.Queue = this->queue;
+        init_info.PipelineCache = PipelineCache::get(this->device, this->physicalDevice);
         init_info.DescriptorPool = imguiPool.get();
         init_info.MinImageCount = this->swapchainImageViews.size();
         init_info.ImageCount = this->swapchainImageViews.size();
@@ -371,6 +356,12 @@ namespace vlb {
                 this->pSceneManager->popScene();
             }
         }
+
+        for (auto& load : this->pSceneManager->getLoads())
+        {
+            const std::string name = std::filesystem::path(load->getPath()).filename().string();
+            ImGui::ProgressBar(load->getProgress(), ImVec2{-1.0f, 0.0f}, name.c_str());
+        }
     }
 
     void UI::skyboxManager()
@@ -449,6 +440,172 @@ namespace vlb {
         ImGui::SliderFloat("Glossyness", &this->lighting.Cglossyness, 2.0f, 200.0f);
     }
 
+    void UI::profiler()
+    {
+        bool enabled = Profiler::isEnabled();
+        if (ImGui::Checkbox("Enabled", &enabled))
+        {
+            Profiler::setEnabled(enabled);
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Export trace"))
+        {
+            try
+            {
+                Profiler::exportChromeTrace(VLB_PROFILER_TRACE_PATH);
+            }
+            catch (std::runtime_error& e)
+            {
+                std::cerr << e.what() << "\n";
+            }
+        }
+
+        const auto frameTimes = Profiler::getFrameTimes();
+        if (!frameTimes.empty())
+        {
+            const float average = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0f) / frameTimes.size();
+            const float longest = *std::max_element(frameTimes.begin(), frameTimes.end());
+            char overlay[32];
+            snprintf(overlay, sizeof(overlay), "%.2f ms average", average);
+
+            ImGui::PlotLines("##frame_times", frameTimes.data(), static_cast<int>(frameTimes.size()), 0, overlay,
+                    0.0f, longest, ImVec2{-1.0f, 80.0f});
+        }
+
+        if (ImGui::BeginTable("##profiler_scopes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+        {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Timeline");
+            ImGui::TableSetupColumn("Last, ms");
+            ImGui::TableSetupColumn("Average, ms");
+            ImGui::TableHeadersRow();
+
+            for (const auto& stat : Profiler::getStats())
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(stat.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(stat.gpu ? "GPU" : "CPU");
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stat.lastMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", stat.averageMs);
+            }
+
+            ImGui::EndTable();
+        }
+    }
+
+    void UI::memory()
+    {
+        MemoryAllocator& allocator = MemoryAllocator::get(this->device, this->physicalDevice);
+        const MemoryAllocator::Report report = allocator.getReport();
+
+        if (ImGui::Button("Dump report"))
+        {
+            try
+            {
+                allocator.dumpReport(VLB_MEMORY_REPORT_PATH);
+            }
+            catch (std::runtime_error& e)
+            {
+                std::cerr << e.what() << "\n";
+            }
+        }
+
+        auto toMiB = [](vk::DeviceSize bytes)
+        {
+            return static_cast<double>(bytes) / (1 << 20);
+        };
+
+        // blocks is what the allocator holds, usage also counts the swapchain, pipelines, query pools...
+        if (ImGui::BeginTable("##memory_heaps", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+        {
+            ImGui::TableSetupColumn("Heap");
+            ImGui::TableSetupColumn("Size, MiB");
+            ImGui::TableSetupColumn("Blocks, MiB");
+            ImGui::TableSetupColumn("Usage, MiB");
+            ImGui::TableSetupColumn("Budget, MiB");
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < report.heaps.size(); ++i)
+            {
+                const MemoryAllocator::Heap& heap = report.heaps[i];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu%s", i, heap.deviceLocal ? " (device local)" : "");
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", toMiB(heap.size));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", toMiB(heap.blocks));
+                for (vk::DeviceSize driver : { heap.usage, heap.budget })
+                {
+                    ImGui::TableNextColumn();
+                    if (report.hasBudget)
+                    {
+                        ImGui::Text("%.1f", toMiB(driver));
+                    }
+                    else
+                    {
+                        ImGui::TextUnformatted("-");
+                    }
+                }
+            }
+
+            ImGui::EndTable();
+        }
+
+        auto usageTable = [&](const char* id, const MemoryAllocator::Usages& usages)
+        {
+            if (!ImGui::BeginTable(id, 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) return;
+
+            ImGui::TableSetupColumn("Category");
+            ImGui::TableSetupColumn("MiB");
+            ImGui::TableSetupColumn("Peak, MiB");
+            ImGui::TableSetupColumn("Allocations");
+            ImGui::TableHeadersRow();
+
+            for (size_t i = 0; i < usages.size(); ++i)
+            {
+                const MemoryAllocator::Usage& usage = usages[i];
+                if (!usage.peak) continue;
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(MemoryAllocator::getCategoryName(static_cast<MemoryAllocator::Category>(i)));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", toMiB(usage.bytes));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", toMiB(usage.peak));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(usage.count));
+            }
+
+            ImGui::EndTable();
+        };
+
+        usageTable("##memory_categories", report.categories);
+
+        for (const auto& [owner, usages] : report.owners)
+        {
+            vk::DeviceSize bytes = 0;
+            for (const auto& usage : usages)
+            {
+                bytes += usage.bytes;
+            }
+
+            const std::string label = owner.empty() ? "unowned" : owner;
+            if (ImGui::TreeNode(label.c_str(), "%s: %.1f MiB", label.c_str(), toMiB(bytes)))
+            {
+                usageTable("##memory_owner", usages);
+                ImGui::TreePop();
+            }
+        }
+    }
+
     void UI::update()
     {
         ImGui_ImplVulkan_NewFrame();
@@ -474,6 +631,16 @@ namespace vlb {
                 tweakLighting();
                 ImGui::EndTabItem();
             }
+            if (ImGui::BeginTabItem("Profiler"))
+            {
+                profiler();
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Memory"))
+            {
+                memory();
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }
         ImGui::End();
@@ -513,8 +680,9 @@ namespace vlb {
             nlohmann::json json{};
             file >> json;
 
-            this->pSceneManager->setSceneIndex(json["selectedSceneIndex"].get<int>());
             this->sceneFileDialog.SetPwd(json["assetsBrowsingDir"].get<std::string>());
+            this->pSceneManager->setPrefetchDistance(json.value("scenePrefetchDistance", 0u));
+            Profiler::setEnabled(json.value("profilerEnabled", false));
 
             for (const auto& jsonScene : json["scenes"])
             {
@@ -535,21 +703,26 @@ namespace vlb {
                     ci.cameras.push_back(cameraCI);
                 }
 
-                try
-                {
-                    this->pSceneManager->pushScene(ci);
-                }
-                catch(std::exception& error)
-                {
-                    std::cerr << error.what() << "\n";
-                }
+                this->pSceneManager->pushScene(ci);
+            }
+
+            // only the selected scene is loaded now, the rest when first selected
+            const int scenesCount = static_cast<int>(this->pSceneManager->getScenesCount());
+            if (scenesCount)
+            {
+                const int sceneIndex = std::clamp(json["selectedSceneIndex"].get<int>(), 0, scenesCount - 1);
+                this->pSceneManager->setSceneIndex(sceneIndex);
+                this->pSceneManager->activateScene(sceneIndex)->wait();
+                this->pSceneManager->update();
             }
         }
-        else
+
+        // also when the selected scene failed to load, something has to be on screen
+        if (!this->pSceneManager->getScenesCount() || !this->pSceneManager->isSceneResident(this->pSceneManager->getSceneIndex()))
         {
             std::string fileName{VLB_DEFAULT_SCENE_NAME};
             this->pSceneManager->pushScene(fileName);
-            this->pSceneManager->setSceneIndex(0);
+            this->pSceneManager->finishLoading();
         }
 
         // TODO: skybox serialization
@@ -565,13 +738,40 @@ namespace vlb {
         nlohmann::json json{};
         json["selectedSceneIndex"] = this->pSceneManager->getSceneIndex();
         json["assetsBrowsingDir"] = this->sceneFileDialog.GetPwd();
+        json["scenePrefetchDistance"] = this->pSceneManager->getPrefetchDistance();
+        json["profilerEnabled"] = Profiler::isEnabled();
 
         json["scenes"] = nlohmann::json::array();
         for (int i{}; i < this->pSceneManager->getScenesCount(); ++i)
         {
-            auto& scene = this->pSceneManager->getScene(i);
             auto jsonScene = nlohmann::json::object();
 
+            // placeholders were never loaded, so they write back what was read
+            if (!this->pSceneManager->isSceneResident(i))
+            {
+                const auto& ci = this->pSceneManager->getSceneInfo(i);
+                jsonScene["path"] = ci.path;
+                jsonScene["name"] = ci.name;
+                jsonScene["cameras"] = nlohmann::json::array();
+                jsonScene["cameraIndex"] = ci.cameraIndex;
+
+                for (const auto& cameraInfo : ci.cameras)
+                {
+                    auto jsonCamera = nlohmann::json::object();
+                    jsonCamera["movementSpeed"]     = cameraInfo.movementSpeed;
+                    jsonCamera["mouse sensitivity"] = cameraInfo.rotationSpeed;
+                    jsonCamera["position"]          = cameraInfo.position;
+                    jsonCamera["yaw"]               = cameraInfo.yaw;
+                    jsonCamera["pitch"]             = cameraInfo.pitch;
+                    jsonScene["cameras"].push_back(jsonCamera);
+                }
+
+                json["scenes"].push_back(jsonScene);
+                continue;
+            }
+
+            auto& scene = this->pSceneManager->getScene(i);
+
             jsonScene["path"] = scene->path;
             jsonScene["name"] = scene->name;
             jsonScene["cameras"] = nlohmann::json::array();
@@ -46,6 +46,8 @@ namespace vlb {
             void skyboxManager();
             void camera();
             void tweakLighting();
+            void profiler();
+            void memory();
 
         public:
             struct InteractiveLighting
@@ -0,0 +1,170 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "scene_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace vlb {
+
+    void SceneCache::Writer::write(const std::string& path, const Key& key)
+    {
+        auto alignUp = [](uint64_t offset) { return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment; };
+
+        Header header{};
+        header.magic          = SceneCache::magic;
+        header.version        = SceneCache::version;
+        header.key            = key;
+        header.sectionCount   = static_cast<uint32_t>(this->sections.size());
+        header.sectionsOffset = sizeof(Header);
+
+        std::vector<Section> table{};
+        uint64_t offset = alignUp(sizeof(Header) + this->sections.size() * sizeof(Section));
+        for (const auto& [id, bytes] : this->sections)
+        {
+            table.push_back({ id, 0u, offset, bytes.size() });
+            offset = alignUp(offset + bytes.size());
+        }
+
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                throw std::runtime_error("could not open " + temporary + " for writing");
+            }
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(Section));
+
+            uint64_t written = sizeof(Header) + table.size() * sizeof(Section);
+            std::vector<char> padding(sectionAlignment, 0);
+            for (const Section& section : table)
+            {
+                file.write(padding.data(), section.offset - written);
+                file.write(reinterpret_cast<const char*>(this->sections[section.id].data()), section.size);
+                written = section.offset + section.size;
+            }
+
+            if (!file)
+            {
+                throw std::runtime_error("failed to write " + temporary);
+            }
+        }
+
+        std::filesystem::rename(temporary, path);
+    }
+
+    uint64_t SceneCache::hashFile(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("could not open " + path);
+        }
+
+        uint64_t hash = 0xcbf29ce484222325ull;
+        std::vector<char> chunk(1u << 20);
+        while (file)
+        {
+            file.read(chunk.data(), chunk.size());
+            for (std::streamsize i = 0; i < file.gcount(); ++i)
+            {
+                hash = (hash ^ static_cast<uint8_t>(chunk[i])) * 0x100000001b3ull;
+            }
+        }
+
+        return hash;
+    }
+
+    SceneCache::SceneCache(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            throw std::runtime_error("could not open scene cache: " + path);
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) == -1)
+        {
+            close(fd);
+            throw std::runtime_error("could not stat scene cache: " + path);
+        }
+        this->size = static_cast<size_t>(info.st_size);
+
+        if (this->size >= sizeof(Header))
+        {
+            this->mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+
+        if (!this->mapped || this->mapped == MAP_FAILED)
+        {
+            this->mapped = nullptr;
+            throw std::runtime_error("could not map scene cache: " + path);
+        }
+
+        const Header& header = *static_cast<const Header*>(this->mapped);
+        bool valid = header.magic == SceneCache::magic
+            && header.version == SceneCache::version
+            && header.sectionsOffset >= sizeof(Header)
+            && header.sectionsOffset % alignof(Section) == 0
+            && header.sectionsOffset <= this->size
+            && uint64_t(header.sectionCount) * sizeof(Section) <= this->size - header.sectionsOffset;
+
+        if (valid)
+        {
+            const Section* table = reinterpret_cast<const Section*>(static_cast<const uint8_t*>(this->mapped) + header.sectionsOffset);
+            for (uint32_t i = 0; i < header.sectionCount && valid; ++i)
+            {
+                valid = table[i].offset % sectionAlignment == 0
+                    && table[i].offset <= this->size
+                    && table[i].size <= this->size - table[i].offset;
+            }
+        }
+
+        if (!valid)
+        {
+            munmap(this->mapped, this->size);
+            this->mapped = nullptr;
+            throw std::runtime_error("invalid or unsupported scene cache: " + path);
+        }
+    }
+
+    SceneCache::~SceneCache()
+    {
+        if (this->mapped)
+        {
+            munmap(this->mapped, this->size);
+        }
+    }
+
+    const SceneCache::Key& SceneCache::getKey()
+    {
+        return static_cast<const Header*>(this->mapped)->key;
+    }
+
+    std::span<const uint8_t> SceneCache::getBytes(uint32_t id)
+    {
+        const Header&  header = *static_cast<const Header*>(this->mapped);
+        const uint8_t* base   = static_cast<const uint8_t*>(this->mapped);
+        const Section* table  = reinterpret_cast<const Section*>(base + header.sectionsOffset);
+
+        for (uint32_t i = 0; i < header.sectionCount; ++i)
+        {
+            if (table[i].id == id)
+            {
+                return { base + table[i].offset, table[i].size };
+            }
+        }
+
+        return {};
+    }
+}
+
@@ -0,0 +1,142 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SCENE_CACHE_HPP
+#define SCENE_CACHE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define VLB_SCENE_CACHE_EXTENSION ".vlbscene"
+
+namespace vlb {
+
+    // Binary container for processed scenes (*.vlbscene), written next to the glTF:
+    // [Header][Section table][sections, each sectionAlignment aligned]
+    // Sections are arrays of trivially copyable records, the scene loader decides
+    // what an id holds. The file is mapped read-only, so loaders can hand section
+    // memory straight to the upload path.
+    class SceneCache
+    {
+        public:
+            static constexpr uint32_t magic            = 0x53424c56; // "VLBS"
+            static constexpr uint32_t version          = 1u;
+            static constexpr uint64_t sectionAlignment = 64u;
+
+            // What the cache was made from; a mismatch means the cache is stale
+            struct Key
+            {
+                uint64_t sourceHash;
+                uint64_t sourceSize;
+                uint32_t loaderVersion;
+                uint32_t reserved;
+            };
+
+            struct Header
+            {
+                uint32_t magic;
+                uint32_t version;
+                Key      key;
+                uint32_t sectionCount;
+                uint32_t reserved;
+                uint64_t sectionsOffset;
+            };
+            static_assert(sizeof(Header) == 48);
+
+            struct Section
+            {
+                uint32_t id;
+                uint32_t reserved;
+                uint64_t offset;
+                uint64_t size;
+            };
+            static_assert(sizeof(Section) == 24);
+
+            // Sections are collected in memory and written in one go
+            class Writer
+            {
+                private:
+                    std::map<uint32_t, std::vector<uint8_t>> sections;
+
+                public:
+                    // Returns the index of the first appended record within the section
+                    template <class T> uint64_t append(uint32_t id, std::span<const T> records);
+                    template <class T> uint64_t append(uint32_t id, const T& record);
+                    template <class T> std::span<T> get(uint32_t id); // records appended so far
+
+                    // Writes to a temporary file first, so readers never see a partial cache
+                    void write(const std::string& path, const Key& key);
+            };
+
+            static uint64_t hashFile(const std::string& path); // 64-bit FNV-1a of the contents
+
+            SceneCache() = delete;
+            SceneCache(const std::string& path); // maps the file read-only and validates the header
+            SceneCache(const SceneCache& other) = delete;
+            ~SceneCache();
+
+            const Key& getKey();
+
+            // Empty when the cache has no such section
+            template <class T> std::span<const T> getSection(uint32_t id);
+
+        private:
+            void*  mapped = nullptr;
+            size_t size   = 0;
+
+            std::span<const uint8_t> getBytes(uint32_t id);
+    };
+
+    template <class T>
+    uint64_t SceneCache::Writer::append(uint32_t id, std::span<const T> records)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        std::vector<uint8_t>& bytes = this->sections[id];
+        const uint64_t first = bytes.size() / sizeof(T);
+
+        bytes.resize(bytes.size() + records.size_bytes());
+        if (!records.empty())
+        {
+            memcpy(bytes.data() + first * sizeof(T), records.data(), records.size_bytes());
+        }
+
+        return first;
+    }
+
+    template <class T>
+    uint64_t SceneCache::Writer::append(uint32_t id, const T& record)
+    {
+        return append(id, std::span<const T>(&record, 1));
+    }
+
+    template <class T>
+    std::span<T> SceneCache::Writer::get(uint32_t id)
+    {
+        std::vector<uint8_t>& bytes = this->sections[id];
+        return { reinterpret_cast<T*>(bytes.data()), bytes.size() / sizeof(T) };
+    }
+
+    template <class T>
+    std::span<const T> SceneCache::getSection(uint32_t id)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+        std::span<const uint8_t> bytes = getBytes(id);
+        if (bytes.size() % sizeof(T))
+        {
+            throw std::runtime_error("scene cache section " + std::to_string(id) + " does not hold whole records");
+        }
+
+        return { reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T) };
+    }
+}
+
+#endif // ifndef SCENE_CACHE_HPP
+
@@ -0,0 +1,159 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "scene_graph.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vlb {
+
+    uint32_t SceneGraph::push(uint32_t parent, const Transform& transform, int32_t mesh, uint32_t source)
+    {
+        const uint32_t node = getCount();
+        if (parent != NONE && (parent >= node || getSubtreeEnd(parent) != node))
+        {
+            throw std::runtime_error("scene graph nodes must be pushed depth first");
+        }
+
+        this->parents.push_back(parent);
+        this->subtreeEnds.push_back(node + 1);
+        this->meshes.push_back(mesh);
+        this->sources.push_back(source);
+        this->translations.push_back(transform.translation);
+        this->rotations.push_back(transform.rotation);
+        this->scales.push_back(transform.scale);
+        this->matrices.push_back(transform.matrix);
+        this->worldMatrices.push_back(glm::mat4(1.0f));
+        this->dirty.push_back(0);
+
+        for (uint32_t p = parent; p != NONE; p = this->parents[p])
+        {
+            this->subtreeEnds[p] = node + 1;
+        }
+
+        markDirty(node);
+        return node;
+    }
+
+    void SceneGraph::clear()
+    {
+        *this = SceneGraph{};
+    }
+
+    void SceneGraph::setTranslation(uint32_t node, const glm::vec3& translation)
+    {
+        this->translations[node] = translation;
+        markDirty(node);
+    }
+
+    void SceneGraph::setRotation(uint32_t node, const glm::quat& rotation)
+    {
+        this->rotations[node] = rotation;
+        markDirty(node);
+    }
+
+    void SceneGraph::setScale(uint32_t node, const glm::vec3& scale)
+    {
+        this->scales[node] = scale;
+        markDirty(node);
+    }
+
+    void SceneGraph::setMatrix(uint32_t node, const glm::mat4& matrix)
+    {
+        this->matrices[node] = matrix;
+        markDirty(node);
+    }
+
+    void SceneGraph::markDirty(uint32_t node)
+    {
+        if (this->dirty[node]) return;
+
+        this->dirty[node] = 1;
+        this->dirtyRoots.push_back(node);
+    }
+
+    std::span<const uint32_t> SceneGraph::update()
+    {
+        this->updated.clear();
+        std::sort(this->dirtyRoots.begin(), this->dirtyRoots.end());
+
+        // parents come first, so one pass over each subtree is enough; roots inside
+        // a subtree that was already walked are skipped
+        uint32_t end = 0;
+        for (uint32_t root : this->dirtyRoots)
+        {
+            if (root < end) continue;
+            end = this->subtreeEnds[root];
+
+            for (uint32_t i = root; i < end; ++i)
+            {
+                const uint32_t parent = this->parents[i];
+                this->worldMatrices[i] = parent == NONE ? getLocalMatrix(i) : this->worldMatrices[parent] * getLocalMatrix(i);
+                this->dirty[i]         = 0;
+                this->updated.push_back(i);
+            }
+        }
+        this->dirtyRoots.clear();
+
+        return this->updated;
+    }
+
+    bool SceneGraph::isDirty()
+    {
+        return !this->dirtyRoots.empty();
+    }
+
+    uint32_t SceneGraph::getCount()
+    {
+        return static_cast<uint32_t>(this->parents.size());
+    }
+
+    uint32_t SceneGraph::getParent(uint32_t node)
+    {
+        return this->parents[node];
+    }
+
+    uint32_t SceneGraph::getSubtreeEnd(uint32_t node)
+    {
+        return this->subtreeEnds[node];
+    }
+
+    int32_t SceneGraph::getMesh(uint32_t node)
+    {
+        return this->meshes[node];
+    }
+
+    uint32_t SceneGraph::getSource(uint32_t node)
+    {
+        return this->sources[node];
+    }
+
+    SceneGraph::Transform SceneGraph::getTransform(uint32_t node)
+    {
+        return Transform{ this->translations[node], this->rotations[node], this->scales[node], this->matrices[node] };
+    }
+
+    glm::mat4 SceneGraph::getLocalMatrix(uint32_t node)
+    {
+        glm::mat4 matrix(1.0f);
+        matrix = glm::translate(matrix, this->translations[node]);
+        matrix = matrix * glm::mat4_cast(this->rotations[node]);
+        matrix = glm::scale(matrix, this->scales[node]);
+        matrix = matrix * this->matrices[node];
+
+        return matrix;
+    }
+
+    const glm::mat4& SceneGraph::getWorldMatrix(uint32_t node)
+    {
+        return this->worldMatrices[node];
+    }
+
+    std::span<const glm::mat4> SceneGraph::getWorldMatrices()
+    {
+        return this->worldMatrices;
+    }
+}
+
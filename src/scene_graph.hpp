@@ -0,0 +1,76 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SCENE_GRAPH_HPP
+#define SCENE_GRAPH_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace vlb {
+
+    // Node hierarchy as flat arrays in depth-first order: a parent always precedes
+    // its children and every subtree is one contiguous range [node, getSubtreeEnd(node)).
+    // World matrices are cached; setters only mark nodes dirty and update()
+    // recomputes the dirty subtrees, so its cost follows what changed, not the scene size.
+    class SceneGraph
+    {
+        public:
+            static constexpr uint32_t NONE = ~0u;
+
+            // glTF node transform: translation * rotation * scale * matrix
+            struct Transform
+            {
+                glm::vec3 translation = glm::vec3(0.0f);
+                glm::quat rotation    = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+                glm::vec3 scale       = glm::vec3(1.0f);
+                glm::mat4 matrix      = glm::mat4(1.0f);
+            };
+
+        private:
+            std::vector<uint32_t>  parents;
+            std::vector<uint32_t>  subtreeEnds;
+            std::vector<int32_t>   meshes;  // glTF mesh index, -1 for none
+            std::vector<uint32_t>  sources; // glTF node index
+            std::vector<glm::vec3> translations;
+            std::vector<glm::quat> rotations;
+            std::vector<glm::vec3> scales;
+            std::vector<glm::mat4> matrices;
+            std::vector<glm::mat4> worldMatrices;
+            std::vector<uint8_t>   dirty;
+            std::vector<uint32_t>  dirtyRoots;
+            std::vector<uint32_t>  updated;
+
+        public:
+            // Nodes must be pushed depth first, after their parent
+            uint32_t push(uint32_t parent, const Transform& transform, int32_t mesh, uint32_t source);
+            void     clear();
+
+            void setTranslation(uint32_t node, const glm::vec3& translation);
+            void setRotation(uint32_t node, const glm::quat& rotation);
+            void setScale(uint32_t node, const glm::vec3& scale);
+            void setMatrix(uint32_t node, const glm::mat4& matrix);
+            void markDirty(uint32_t node);
+
+            // Recomputes world matrices of dirty subtrees, returns the recomputed nodes in order
+            std::span<const uint32_t> update();
+            bool                      isDirty();
+
+            uint32_t  getCount();
+            uint32_t  getParent(uint32_t node);
+            uint32_t  getSubtreeEnd(uint32_t node);
+            int32_t   getMesh(uint32_t node);
+            uint32_t  getSource(uint32_t node);
+            Transform getTransform(uint32_t node);
+            glm::mat4 getLocalMatrix(uint32_t node);
+
+            const glm::mat4&           getWorldMatrix(uint32_t node); // valid after update()
+            std::span<const glm::mat4> getWorldMatrices();
+    };
+}
+
+#endif // ifndef SCENE_GRAPH_HPP
+
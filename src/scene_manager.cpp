@@ -2,6 +2,7 @@
 
 #include "scene_manager.hpp"
 #include "structures.h"
+#include "probe_volume.hpp"
 
 #include <glm/ext/vector_double3.hpp>
 #include <glm/ext/matrix_double4x4.hpp>
@@ -13,9 +14,17 @@
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <cmath>
 #include <utility>
 #include <array>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <tuple>
+#include <set>
+#include <deque>
+
+#include <stb_image.h>
 
 namespace glm
 {
@@ -29,27 +38,156 @@ namespace glm
 
 namespace vlb {
 
+    namespace {
+        VkTransformMatrixKHR toTransformMatrix(const glm::mat4& matrix)
+        {
+            const glm::mat4 rows = glm::transpose(matrix);
+
+            VkTransformMatrixKHR transformMatrix;
+            memcpy(&transformMatrix, &rows, sizeof(VkTransformMatrixKHR));
+            return transformMatrix;
+        }
+
+        // Bump whenever the loaders change what they produce, older caches get rebuilt
+        constexpr uint32_t SCENE_CACHE_LOADER_VERSION = 1u;
+
+        enum CacheSection : uint32_t
+        {
+            eCacheDependencies, // CachedDependency
+            eCacheNames,        // char, file names of the dependencies
+            eCacheSamplers,     // Application::Sampler
+            eCacheTextures,     // CachedTexture
+            eCacheTexels,       // uint8_t, decoded images
+            eCacheMaterials,    // shader::Material
+            eCacheMeshes,       // CachedMesh, by glTF mesh
+            eCachePrimitives,   // CachedPrimitive, grouped by mesh
+            eCacheVertices,     // shader::Vertex
+            eCacheIndices,      // uint32_t
+            eCacheNodes,        // CachedNode, in SceneGraph order
+            eCacheChannels,     // CachedChannel
+            eCacheKeyTimes,     // float
+            eCacheKeyValues     // glm::vec4
+        };
+
+        // External buffers and images, a cache is stale once one of them changes
+        struct CachedDependency
+        {
+            uint64_t size;
+            int64_t  writeTime;
+            uint64_t firstChar;
+            uint64_t charCount;
+        };
+
+        struct CachedTexture
+        {
+            uint32_t width;
+            uint32_t height;
+            int32_t  sampler;
+            uint32_t reserved;
+            uint64_t firstTexel;
+            uint64_t texelCount;
+        };
+
+        struct CachedMesh
+        {
+            uint32_t firstPrimitive;
+            uint32_t primitiveCount; // 0 for meshes no node references
+        };
+
+        struct CachedPrimitive
+        {
+            uint32_t  mesh;
+            uint32_t  vertexCount;
+            uint32_t  indexCount;
+            uint32_t  reserved;
+            uint64_t  materialIndex;
+            uint64_t  firstVertex;
+            uint64_t  firstIndex;
+            glm::vec3 bounds[2];
+        };
+
+        struct CachedNode
+        {
+            SceneGraph::Transform transform;
+            uint32_t              parent;
+            int32_t               mesh;
+            uint32_t              source;
+            uint32_t              reserved;
+        };
+
+        struct CachedChannel
+        {
+            uint32_t                 animation;
+            uint32_t                 node;
+            Animation::Path          path;
+            Animation::Interpolation interpolation;
+            uint64_t                 firstTime;
+            uint64_t                 timeCount;
+            uint64_t                 firstValue;
+            uint64_t                 valueCount;
+        };
+    }
+
     Scene_t::Scene_t(std::string& filename)
     {
-        std::string err{};
-        std::string warn{};
-
         std::filesystem::path filePath{filename};
         this->path = filename;
         this->name = filePath.stem();
 
-        bool loaded{false};
-        if (filePath.extension() == ".gltf")
+        if (filePath.extension() != ".gltf" && filePath.extension() != ".glb")
         {
-            loaded = loader.LoadASCIIFromFile(&this->model, &err, &warn, filename);
+            throw std::runtime_error("Not supported file format");
+        }
+    }
+
+    // The glTF is only parsed when there is no current cache to load from
+    void Scene_t::loadSource()
+    {
+        Profiler::Scope scope{"loadSource"};
+
+        const std::string cachePath = this->path + VLB_SCENE_CACHE_EXTENSION;
+
+        // headless scenes serve CPU queries from the glTF model itself
+        if (!isHeadless())
+        {
+            if (std::filesystem::exists(cachePath))
+            {
+                try
+                {
+                    auto cache = std::make_unique<SceneCache>(cachePath);
+                    if (isCacheCurrent(*cache))
+                    {
+                        this->cache = std::move(cache);
+                        return;
+                    }
+                }
+                catch (const std::exception& error)
+                {
+                    printf("Warn: ignoring %s: %s\n", cachePath.c_str(), error.what());
+                }
+            }
+
+            this->cacheWriter = std::make_unique<SceneCache::Writer>();
         }
-        else if (filePath.extension() == ".glb")
+
+        std::string err{};
+        std::string warn{};
+
+        // images are only handed over encoded here, decodeImages() does the work in parallel
+        this->loader.SetImageLoader([](tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*) -> bool
+        {
+            image->image.assign(bytes, bytes + size);
+            return true;
+        }, nullptr);
+
+        bool loaded{false};
+        if (std::filesystem::path(this->path).extension() == ".gltf")
         {
-            loaded = loader.LoadBinaryFromFile(&this->model, &err, &warn, filename);
+            loaded = loader.LoadASCIIFromFile(&this->model, &err, &warn, this->path);
         }
         else
         {
-            throw std::runtime_error("Not supported file format");
+            loaded = loader.LoadBinaryFromFile(&this->model, &err, &warn, this->path);
         }
 
         if (!warn.empty())
@@ -64,6 +202,110 @@ namespace vlb {
         {
             throw std::runtime_error("Failed to parse glTF");
         }
+        decodeImages();
+
+        if (this->cacheWriter)
+        {
+            std::vector<std::string> uris{};
+            for (const auto& buffer : this->model.buffers) uris.push_back(buffer.uri);
+            for (const auto& image : this->model.images)   uris.push_back(image.uri);
+
+            const std::filesystem::path directory = std::filesystem::path(this->path).parent_path();
+            for (const auto& uri : uris)
+            {
+                if (uri.empty() || uri.starts_with("data:")) continue;
+
+                std::error_code sizeError{};
+                std::error_code timeError{};
+                const auto file = directory / uri;
+                const auto size = std::filesystem::file_size(file, sizeError);
+                const auto time = std::filesystem::last_write_time(file, timeError);
+                if (sizeError || timeError)
+                {
+                    // the cache could not tell when this file changes, so it would go stale unnoticed
+                    printf("Warn: scene cache not written: could not stat %s\n", file.string().c_str());
+                    this->cacheWriter.reset();
+                    break;
+                }
+
+                CachedDependency dependency{};
+                dependency.size      = size;
+                dependency.writeTime = time.time_since_epoch().count();
+                dependency.firstChar = this->cacheWriter->append<char>(eCacheNames, uri);
+                dependency.charCount = uri.size();
+                this->cacheWriter->append(eCacheDependencies, dependency);
+            }
+        }
+    }
+
+    SceneCache::Key Scene_t::getCacheKey()
+    {
+        SceneCache::Key key{};
+        key.sourceHash    = SceneCache::hashFile(this->path);
+        key.sourceSize    = std::filesystem::file_size(this->path);
+        key.loaderVersion = SCENE_CACHE_LOADER_VERSION;
+
+        return key;
+    }
+
+    bool Scene_t::isCacheCurrent(SceneCache& cache)
+    {
+        const SceneCache::Key  key    = getCacheKey();
+        const SceneCache::Key& cached = cache.getKey();
+        if (cached.sourceHash != key.sourceHash || cached.sourceSize != key.sourceSize || cached.loaderVersion != key.loaderVersion)
+        {
+            return false;
+        }
+
+        const std::filesystem::path directory = std::filesystem::path(this->path).parent_path();
+        const auto names = cache.getSection<char>(eCacheNames);
+        for (const auto& dependency : cache.getSection<CachedDependency>(eCacheDependencies))
+        {
+            if (dependency.firstChar + dependency.charCount > names.size()) return false;
+
+            std::error_code sizeError{};
+            std::error_code timeError{};
+            const auto file = directory / std::string(names.data() + dependency.firstChar, dependency.charCount);
+            const auto size = std::filesystem::file_size(file, sizeError);
+            const auto time = std::filesystem::last_write_time(file, timeError);
+            if (sizeError || timeError || size != dependency.size || time.time_since_epoch().count() != dependency.writeTime)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Scene Scene_t::storeCache()
+    {
+        if (!this->cacheWriter) return shared_from_this();
+
+        // primitives were recorded in load order, meshes need them grouped
+        auto primitives = this->cacheWriter->get<CachedPrimitive>(eCachePrimitives);
+        std::stable_sort(primitives.begin(), primitives.end(), [](const CachedPrimitive& a, const CachedPrimitive& b) { return a.mesh < b.mesh; });
+
+        std::vector<CachedMesh> meshes(this->meshes.size(), CachedMesh{0u, 0u});
+        for (uint32_t p = 0; p < primitives.size(); ++p)
+        {
+            CachedMesh& mesh = meshes[primitives[p].mesh];
+            if (!mesh.primitiveCount) mesh.firstPrimitive = p;
+            ++mesh.primitiveCount;
+        }
+        this->cacheWriter->append<CachedMesh>(eCacheMeshes, meshes);
+
+        const std::string cachePath = this->path + VLB_SCENE_CACHE_EXTENSION;
+        try
+        {
+            this->cacheWriter->write(cachePath, getCacheKey());
+        }
+        catch (const std::exception& error)
+        {
+            printf("Warn: scene cache not written: %s\n", error.what());
+        }
+        this->cacheWriter.reset();
+
+        return shared_from_this();
     }
 
     Scene Scene_t::passVulkanResources(Scene_t::VulkanResources& info)
@@ -81,6 +323,11 @@ namespace vlb {
         return shared_from_this();
     }
 
+    bool Scene_t::isHeadless()
+    {
+        return !this->device;
+    }
+
     // TODO: make manager's private (all scenes have same ds layout)
     Scene Scene_t::createDescriptorSetLayout()
     {
@@ -125,6 +372,16 @@ namespace vlb {
         return this->descriptorSetLayout.get();
     }
 
+    glm::vec3 Scene_t::getGridOrigin()
+    {
+        return this->bakedLight.origin;
+    }
+
+    glm::uvec3 Scene_t::getGridDims()
+    {
+        return this->bakedLight.dims;
+    }
+
     glm::vec3 Scene_t::getGridStep()
     {
         return this->bakedLight.gridStep;
@@ -216,6 +473,11 @@ namespace vlb {
         return this->bounds;
     }
 
+    SceneGraph& Scene_t::getGraph()
+    {
+        return this->graph;
+    }
+
     auto Scene_t::Primitive_t::getGeometry()
     {
         vk::AccelerationStructureGeometryTrianglesDataKHR data{};
@@ -336,266 +598,601 @@ namespace vlb {
         return std::move(indices);
     }
 
-    Scene_t::AccelerationStructure Scene_t::buildAS(const vk::AccelerationStructureGeometryKHR& geometry, const vk::AccelerationStructureBuildRangeInfoKHR& range)
+    Scene_t::AccelerationStructure Scene_t::createAS(vk::AccelerationStructureTypeKHR level, vk::DeviceSize size)
     {
-        using enum vk::AccelerationStructureTypeKHR;
-        vk::AccelerationStructureTypeKHR level = geometry.geometryType == vk::GeometryTypeKHR::eInstances ? eTopLevel : eBottomLevel;
-
-        vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
-        buildInfo
-            .setType(level)
-            .setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace)
-            .setGeometries(geometry);
-
-        auto buildSizes = this->device.getAccelerationStructureBuildSizesKHR(
-                vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, range.primitiveCount);
-
         using enum vk::BufferUsageFlagBits;
         using enum vk::MemoryPropertyFlagBits;
         vk::BufferUsageFlags    usg{ eAccelerationStructureStorageKHR | eShaderDeviceAddress };
-        vk::MemoryPropertyFlags mem{ eHostVisible | eHostCoherent };
+        vk::MemoryPropertyFlags mem{ eDeviceLocal };
 
         auto as = std::make_shared<Scene_t::AccelerationStructure_t>();
-        as->buffer = Application::createBuffer(this->device, this->physicalDevice, buildSizes.accelerationStructureSize, usg, mem);
+        as->buffer = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, nullptr,
+                { MemoryAllocator::Category::eAccelerationStructure, this->name });
         as->handle = this->device.createAccelerationStructureKHRUnique(
                 vk::AccelerationStructureCreateInfoKHR{}
                 .setBuffer(as->buffer.handle.get())
-                .setSize(buildSizes.accelerationStructureSize)
+                .setSize(size)
                 .setType(level)
                 );
-
-        usg = eStorageBuffer | eShaderDeviceAddress;
-        mem = eDeviceLocal;
-        Application::Buffer scratch = Application::createBuffer(this->device, this->physicalDevice, buildSizes.buildScratchSize, usg, mem);
-
-        buildInfo
-            .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
-            .setDstAccelerationStructure(as->handle.get())
-            .setScratchData(scratch.deviceAddress);
-
-        auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.compute);
-        cmd.buildAccelerationStructuresKHR(buildInfo, &range);
-        Application::flushCommandBuffer(this->device, this->commandPool.compute, cmd, this->queue.compute);
-
         as->address = this->device.getAccelerationStructureAddressKHR({as->handle.get()});
 
         return as;
     }
 
-    Scene Scene_t::buildAccelerationStructures()
+    void Scene_t::createTopLevel()
     {
-        std::vector<vk::AccelerationStructureInstanceKHR> instances(0);
-        std::vector<shader::InstanceInfo>                 instanceInfos(0);
+        const uint32_t copies = std::max(this->swapchainImagesCount, 1u);
+        const uint32_t count  = static_cast<uint32_t>(this->topLevel.instances.size());
+        const size_t   bytes  = count * sizeof(vk::AccelerationStructureInstanceKHR);
 
-        // One bottom level acceleration structure per gltf primitive
-        for (auto node : linearNodes)
-        {
-            auto mesh = node->mesh;
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        this->topLevel.copySize       = std::max<vk::DeviceSize>(bytes, sizeof(vk::AccelerationStructureInstanceKHR));
+        this->topLevel.instanceBuffer = Application::createBuffer(this->device, this->physicalDevice, this->topLevel.copySize * copies,
+                eAccelerationStructureBuildInputReadOnlyKHR | eShaderDeviceAddress, eHostVisible | eHostCoherent, nullptr,
+                { MemoryAllocator::Category::eAccelerationStructure, this->name });
 
-            if (mesh)
-            {
-                VkTransformMatrixKHR transform = node->getMatrix();
+        uint8_t* mapped = static_cast<uint8_t*>(this->topLevel.instanceBuffer.memory.map());
+        for (uint32_t copy = 0; copy < copies; ++copy)
+        {
+            memcpy(mapped + copy * this->topLevel.copySize, this->topLevel.instances.data(), bytes);
+        }
+        this->topLevel.pendingWrites.assign(copies, {});
 
-                for (auto primitive : mesh->primitives)
-                {
-                    const auto [geometry, range] = primitive->getGeometry();
-                    primitive->blas = buildAS(geometry, range);
+        using enum vk::BuildAccelerationStructureFlagBitsKHR;
+        this->topLevel.flags = isAnimated() ? ePreferFastTrace | eAllowUpdate : ePreferFastTrace;
 
-                    vk::AccelerationStructureInstanceKHR instance{};
-                    instance
-                        .setTransform(transform)
-                        .setInstanceCustomIndex(instances.size())
-                        .setMask(0xFF)
-                        .setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable)
-                        .setAccelerationStructureReference(primitive->blas->address);
+        vk::AccelerationStructureGeometryKHR geometry{};
+        geometry
+            .setGeometryType(vk::GeometryTypeKHR::eInstances)
+            .setGeometry({vk::AccelerationStructureGeometryInstancesDataKHR{}});
 
-                    shader::InstanceInfo info{};
-                    info.materialIndex       = primitive->materialIndex;
-                    info.vertexBufferAddress = primitive->vertexBuffer.deviceAddress;
-                    info.indexBufferAddress  = primitive->indexBuffer.deviceAddress;
+        vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+        buildInfo
+            .setType(vk::AccelerationStructureTypeKHR::eTopLevel)
+            .setFlags(this->topLevel.flags)
+            .setGeometries(geometry);
 
-                    instances.push_back(instance);
-                    instanceInfos.push_back(info);
+        auto buildSizes = this->device.getAccelerationStructureBuildSizesKHR(
+                vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, count);
 
-                }
-            }
-        }
+        this->tlas = createAS(vk::AccelerationStructureTypeKHR::eTopLevel, buildSizes.accelerationStructureSize);
 
-        vk::AccelerationStructureBuildRangeInfoKHR range{};
-        range.setPrimitiveCount(static_cast<uint32_t>(instances.size()));
+        // refits and rebuilds share one scratch buffer for the lifetime of the scene
+        const vk::DeviceSize scratchSize = std::max(buildSizes.buildScratchSize, buildSizes.updateScratchSize);
+        this->topLevel.scratch = Application::createBuffer(this->device, this->physicalDevice, scratchSize, eStorageBuffer | eShaderDeviceAddress, eDeviceLocal,
+                nullptr, { MemoryAllocator::Category::eScratch, this->name });
 
-        Application::Buffer instanceBuffer = toBuffer(std::move(instances));
+        auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.compute);
+        {
+            Profiler::GpuScope gpuScope{cmd, this->queue.compute, "TLAS build"};
+            buildTopLevel(cmd, 0, false);
+        }
+        Application::flushCommandBuffer(this->device, this->commandPool.compute, cmd, this->queue.compute);
+    }
 
+    void Scene_t::buildTopLevel(vk::CommandBuffer cmd, uint32_t copy, bool update)
+    {
         vk::AccelerationStructureGeometryInstancesDataKHR data{};
         data
             .setArrayOfPointers(false)
-            .setData(instanceBuffer.deviceAddress);
+            .setData(this->topLevel.instanceBuffer.deviceAddress + copy * this->topLevel.copySize);
 
         vk::AccelerationStructureGeometryKHR geometry{};
         geometry
             .setGeometryType(vk::GeometryTypeKHR::eInstances)
             .setGeometry({data});
 
-        this->tlas = buildAS(geometry, range);
-        this->instanceInfoBuffer = toBuffer(std::move(instanceInfos));
+        vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+        buildInfo
+            .setType(vk::AccelerationStructureTypeKHR::eTopLevel)
+            .setFlags(this->topLevel.flags)
+            .setMode(update ? vk::BuildAccelerationStructureModeKHR::eUpdate : vk::BuildAccelerationStructureModeKHR::eBuild)
+            .setSrcAccelerationStructure(update ? this->tlas->handle.get() : vk::AccelerationStructureKHR{})
+            .setDstAccelerationStructure(this->tlas->handle.get())
+            .setGeometries(geometry)
+            .setScratchData(this->topLevel.scratch.deviceAddress);
+
+        vk::AccelerationStructureBuildRangeInfoKHR range{};
+        range.setPrimitiveCount(static_cast<uint32_t>(this->topLevel.instances.size()));
 
-        return shared_from_this();
+        cmd.buildAccelerationStructuresKHR(buildInfo, &range);
     }
 
-    VkTransformMatrixKHR Scene_t::Node_t::getMatrix()
+    // One multi-geometry BLAS per mesh, all in one submission: builds are batched so a
+    // batch's scratch stays under SCRATCH_BUDGET, batches share one scratch buffer, and
+    // every BLAS is then compacted to the size the build reported
+    void Scene_t::buildBottomLevel(const std::vector<Mesh>& meshes)
     {
-        glm::mat4 matrix = this->matrix;
+        const vk::DeviceSize SCRATCH_BUDGET = 128ull << 20;
+
+        const uint32_t count = static_cast<uint32_t>(meshes.size());
+        if (!count) return;
+
+        Profiler::Scope scope{"buildBottomLevel"};
+
+        auto properties = this->physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+        const vk::DeviceSize scratchAlignment = properties.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>().minAccelerationStructureScratchOffsetAlignment;
+        auto alignUp = [&](vk::DeviceSize size) { return (size + scratchAlignment - 1) / scratchAlignment * scratchAlignment; };
 
-        Node p = this->parent;
-        while (p)
+        // geometries and ranges of mesh i start at firstGeometries[i]
+        std::vector<uint32_t> firstGeometries(count + 1, 0);
+        for (uint32_t i = 0; i < count; ++i)
         {
-            matrix = p->matrix * matrix;
-            p = p->parent;
+            firstGeometries[i + 1] = firstGeometries[i] + static_cast<uint32_t>(meshes[i]->primitives.size());
         }
 
-        matrix = glm::transpose(matrix);
+        std::vector<vk::AccelerationStructureGeometryKHR>          geometries(firstGeometries[count]);
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR>    ranges(firstGeometries[count]);
+        std::vector<uint32_t>                                      primitiveCounts(firstGeometries[count]);
+        std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> infos(count);
+        std::vector<vk::DeviceSize>                              scratchOffsets(count);
+        std::vector<AccelerationStructure>                       built(count);
 
-        VkTransformMatrixKHR transfromMatrix;
-        memcpy(&transfromMatrix, &matrix, sizeof(VkTransformMatrixKHR));
-        return transfromMatrix;
-    }
+        // batches[i] is the first build of batch i
+        std::vector<uint32_t> batches{};
+        vk::DeviceSize batchScratch = 0;
+        vk::DeviceSize scratchSize  = 0;
 
-    glm::mat4 Scene_t::loadMatrix(const tinygltf::Node& gltfNode)
-    {
-        glm::vec3 translation = gltfNode.translation.size() != 3 ? glm::dvec3(0.0) : glm::make_vec3(gltfNode.translation.data());
-        glm::mat4 rotation    = gltfNode.rotation.size() != 4 ? glm::dmat4(glm::dquat{}) : glm::dmat4(glm::make_quat(gltfNode.rotation.data()));
-        glm::vec3 scale       = gltfNode.scale.size() != 3 ? glm::dvec3(1.0f) : glm::make_vec3(gltfNode.scale.data());
-        glm::mat4 transform   = gltfNode.matrix.size() != 16 ? glm::dmat4(1.0f) : glm::make_mat4x4(gltfNode.matrix.data());
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t first = firstGeometries[i];
+            const uint32_t last  = firstGeometries[i + 1];
+            for (uint32_t g = first; g < last; ++g)
+            {
+                std::tie(geometries[g], ranges[g]) = meshes[i]->primitives[g - first]->getGeometry();
+                primitiveCounts[g] = ranges[g].primitiveCount;
+            }
 
-        glm::mat4 matrix(1.0f);
-        matrix = glm::translate(matrix, translation);
-        matrix = matrix * rotation;
-        matrix = glm::scale(matrix, scale);
-        matrix = matrix * transform;
+            infos[i]
+                .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
+                .setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace | vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction)
+                .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+                .setGeometryCount(last - first)
+                .setPGeometries(&geometries[first]);
 
-        return matrix;
-    }
+            auto buildSizes = this->device.getAccelerationStructureBuildSizesKHR(
+                    vk::AccelerationStructureBuildTypeKHR::eDevice, infos[i],
+                    vk::ArrayProxy<const uint32_t>(last - first, &primitiveCounts[first]));
 
-    void Scene_t::loadNode(const Node parent, const tinygltf::Node& gltfNode, const uint32_t nodeIndex)
-    {
-        Node node{new Node_t()};
-        node->parent = parent;
-        node->index  = nodeIndex;
+            built[i] = createAS(vk::AccelerationStructureTypeKHR::eBottomLevel, buildSizes.accelerationStructureSize);
+            infos[i].setDstAccelerationStructure(built[i]->handle.get());
 
-        node->matrix = loadMatrix(gltfNode);
+            vk::DeviceSize size = alignUp(buildSizes.buildScratchSize);
+            if (batches.empty() || (batchScratch + size > SCRATCH_BUDGET && batchScratch))
+            {
+                batches.push_back(i);
+                batchScratch = 0;
+            }
+            scratchOffsets[i] = batchScratch;
+            batchScratch     += size;
+            scratchSize       = std::max(scratchSize, batchScratch);
+        }
+        batches.push_back(count);
 
-        if (gltfNode.mesh > -1)
+        using enum vk::BufferUsageFlagBits;
+        Application::Buffer scratch = Application::createBuffer(this->device, this->physicalDevice, scratchSize + scratchAlignment,
+                eStorageBuffer | eShaderDeviceAddress, vk::MemoryPropertyFlagBits::eDeviceLocal, nullptr, { MemoryAllocator::Category::eScratch, this->name });
+        const vk::DeviceAddress scratchAddress = alignUp(scratch.deviceAddress);
+
+        for (uint32_t i = 0; i < count; ++i)
         {
-            const tinygltf::Mesh& gltfMesh = this->model.meshes[gltfNode.mesh];
-            Mesh mesh = std::make_shared<Mesh_t>();
+            infos[i].setScratchData(scratchAddress + scratchOffsets[i]);
+        }
 
-            for (const auto& gltfPrimitive: gltfMesh.primitives)
-            {
-                auto [vertices, nodeBounds] = fetchVertices(gltfPrimitive);
-                auto indices  = fetchIndices(gltfPrimitive);
+        vk::UniqueQueryPool queryPool = this->device.createQueryPoolUnique(
+                vk::QueryPoolCreateInfo{}
+                .setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR)
+                .setQueryCount(count)
+                );
 
-                std::array<glm::vec3, 2> globalNodeBounds{};
-                globalNodeBounds[0] = glm::vec3(node->matrix * glm::vec4(nodeBounds[0], 1.0f));
-                globalNodeBounds[1] = glm::vec3(node->matrix * glm::vec4(nodeBounds[1], 1.0f));
+        // a batch reuses the scratch of the previous one, and size queries read finished builds
+        vk::MemoryBarrier barrier{};
+        barrier
+            .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+            .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+        const auto buildStage = vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR;
 
-                this->bounds[0].x = std::min(this->bounds[0].x, globalNodeBounds[0].x);
-                this->bounds[0].y = std::min(this->bounds[0].y, globalNodeBounds[0].y);
-                this->bounds[0].z = std::min(this->bounds[0].z, globalNodeBounds[0].z);
+        waitForUploads();
 
-                this->bounds[1].x = std::max(this->bounds[1].x, globalNodeBounds[1].x);
-                this->bounds[1].y = std::max(this->bounds[1].y, globalNodeBounds[1].y);
-                this->bounds[1].z = std::max(this->bounds[1].z, globalNodeBounds[1].z);
+        auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.compute);
+        cmd.resetQueryPool(queryPool.get(), 0, count);
 
-                Primitive primitive{new Primitive_t()};
-                primitive->materialIndex = gltfPrimitive.material > -1 ? gltfPrimitive.material : this->materialsCount - 1;
-                primitive->vertexCount   = vertices.size();
-                primitive->indexCount    = indices.size();
-                primitive->vertexBuffer  = toBuffer(std::move(vertices));
-                primitive->indexBuffer   = toBuffer(std::move(indices));
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> rangePointers(count);
+        std::vector<vk::AccelerationStructureKHR>                     handles(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            rangePointers[i] = &ranges[firstGeometries[i]];
+            handles[i]       = built[i]->handle.get();
+        }
 
-                mesh->primitives.push_back(std::move(primitive));
-            }
+        {
+            Profiler::GpuScope gpuScope{cmd, this->queue.compute, "BLAS build"};
+            for (size_t b = 0; b + 1 < batches.size(); ++b)
+            {
+                const uint32_t first = batches[b];
+                const uint32_t size  = batches[b + 1] - first;
 
-            node->mesh = mesh;
+                cmd.buildAccelerationStructuresKHR(size, &infos[first], &rangePointers[first]);
+                cmd.pipelineBarrier(buildStage, buildStage, {}, barrier, {}, {});
+            }
         }
 
-        if (parent)
+        cmd.writeAccelerationStructuresPropertiesKHR(handles, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool.get(), 0);
+        Application::flushCommandBuffer(this->device, this->commandPool.compute, cmd, this->queue.compute);
+
+        std::vector<vk::DeviceSize> compactedSizes(count);
+        auto result = this->device.getQueryPoolResults(queryPool.get(), 0, count, count * sizeof(vk::DeviceSize), compactedSizes.data(),
+                sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+        if (result != vk::Result::eSuccess)
         {
-            parent->children.push_back(node);
+            throw std::runtime_error("failed to read compacted BLAS sizes");
         }
-        else
+
+        cmd = Application::recordCommandBuffer(this->device, this->commandPool.compute);
+
+        std::vector<AccelerationStructure> compacted(count);
         {
-            nodes.push_back(node);
+            Profiler::GpuScope gpuScope{cmd, this->queue.compute, "BLAS compaction"};
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (!compactedSizes[i] || compactedSizes[i] >= built[i]->buffer.size)
+                {
+                    compacted[i] = built[i];
+                    continue;
+                }
+
+                compacted[i] = createAS(vk::AccelerationStructureTypeKHR::eBottomLevel, compactedSizes[i]);
+                cmd.copyAccelerationStructureKHR(
+                        vk::CopyAccelerationStructureInfoKHR{}
+                        .setSrc(built[i]->handle.get())
+                        .setDst(compacted[i]->handle.get())
+                        .setMode(vk::CopyAccelerationStructureModeKHR::eCompact)
+                        );
+            }
         }
 
-        linearNodes.push_back(node);
+        Application::flushCommandBuffer(this->device, this->commandPool.compute, cmd, this->queue.compute);
 
-        for (const auto& childIndex : gltfNode.children)
+        for (uint32_t i = 0; i < count; ++i)
         {
-            const auto& child = this->model.nodes[childIndex];
-            loadNode(node, child, childIndex);
+            meshes[i]->blas = std::move(compacted[i]);
         }
     }
 
-    Scene Scene_t::loadCameras()
+    Scene Scene_t::buildAccelerationStructures()
     {
-        // TODO: load gltf cameras as well
-        Camera camera{new Camera_t()};
-        camera
-            ->setType(Camera_t::Type::eFirstPerson)
-            ->setRotationSpeed(0.2f)
-            ->setMovementSpeed(1.0f)
-            ->createCameraUBOs(this->device, this->physicalDevice, this->swapchainImagesCount);
+        std::vector<vk::AccelerationStructureInstanceKHR> instances(0);
+        std::vector<shader::InstanceInfo>                 instanceInfos(0);
 
-        this->cameras.push_back(camera);
-        this->cameraIndex = 0;
+        // One bottom level acceleration structure per loaded glTF mesh, one
+        // InstanceInfo per geometry: hit shaders read gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT
+        std::vector<Mesh> meshes{};
+        for (auto mesh : this->meshes)
+        {
+            if (!mesh) continue;
+
+            mesh->firstGeometry = static_cast<uint32_t>(instanceInfos.size());
+            for (auto primitive : mesh->primitives)
+            {
+                shader::InstanceInfo info{};
+                info.materialIndex       = primitive->materialIndex;
+                info.vertexBufferAddress = primitive->vertexBuffer.deviceAddress;
+                info.indexBufferAddress  = primitive->indexBuffer.deviceAddress;
+                instanceInfos.push_back(info);
+            }
+            meshes.push_back(mesh);
+        }
+        buildBottomLevel(meshes);
+
+        // Nodes only add instances
+        this->topLevel.nodeInstances.assign(this->graph.getCount(), SceneGraph::NONE);
+        for (uint32_t node = 0; node < this->graph.getCount(); ++node)
+        {
+            if (this->graph.getMesh(node) < 0) continue;
+            const Mesh& mesh = this->meshes[this->graph.getMesh(node)];
+            this->topLevel.nodeInstances[node] = static_cast<uint32_t>(instances.size());
+
+            vk::AccelerationStructureInstanceKHR instance{};
+            instance
+                .setTransform(toTransformMatrix(this->graph.getWorldMatrix(node)))
+                .setInstanceCustomIndex(mesh->firstGeometry)
+                .setMask(0xFF)
+                .setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable)
+                .setAccelerationStructureReference(mesh->blas->address);
+
+            instances.push_back(instance);
+        }
+
+        this->topLevel.instances = std::move(instances);
+        createTopLevel();
+
+        this->instanceInfoBuffer = toBuffer(std::move(instanceInfos), MemoryAllocator::Category::eOther);
 
         return shared_from_this();
     }
 
-    static inline bool is_base64(uint8_t c)
+    bool Scene_t::isAnimated()
     {
-        return (isalnum(c) || (c == '+') || (c == '/'));
+        return !this->animations.empty();
     }
 
-    std::string base64_decode(std::string const &encoded_string)
+    Scene Scene_t::animate(float time)
     {
-        int in_len = static_cast<int>(encoded_string.size());
-        int i = 0;
-        int j = 0;
-        int in_ = 0;
-        uint8_t char_array_4[4], char_array_3[3];
-        std::string ret;
-
-        const std::string base64_chars =
-            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-            "abcdefghijklmnopqrstuvwxyz"
-            "0123456789+/";
+        Profiler::Scope scope{"animate"};
 
-        while (in_len-- && (encoded_string[in_] != '=') &&
-                is_base64(encoded_string[in_])) {
-            char_array_4[i++] = encoded_string[in_];
-            in_++;
-            if (i == 4) {
-                for (i = 0; i < 4; i++)
-                    char_array_4[i] =
-                        static_cast<uint8_t>(base64_chars.find(char_array_4[i]));
+        for (auto& animation : this->animations)
+        {
+            animation.apply(time, this->graph);
+        }
 
-                char_array_3[0] =
-                    (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-                char_array_3[1] =
-                    ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-                char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+        for (uint32_t node : this->graph.update())
+        {
+            const uint32_t instance = this->topLevel.nodeInstances[node];
+            if (instance == SceneGraph::NONE) continue;
 
-                for (i = 0; (i < 3); i++) ret += char_array_3[i];
-                i = 0;
+            this->topLevel.instances[instance].setTransform(toTransformMatrix(this->graph.getWorldMatrix(node)));
+            for (auto& pending : this->topLevel.pendingWrites)
+            {
+                // a copy that is behind on more than all instances gets rewritten whole
+                if (pending.size() < this->topLevel.instances.size()) pending.push_back(instance);
             }
+            this->topLevel.dirty = true;
         }
 
-        if (i) {
-            for (j = i; j < 4; j++) char_array_4[j] = 0;
+        return shared_from_this();
+    }
 
-            for (j = 0; j < 4; j++)
+    Scene Scene_t::recordTopLevelUpdate(vk::CommandBuffer cmd, uint32_t imageIndex)
+    {
+        if (!this->topLevel.dirty) return shared_from_this();
+
+        const uint32_t copy    = imageIndex % static_cast<uint32_t>(this->topLevel.pendingWrites.size());
+        auto&          pending = this->topLevel.pendingWrites[copy];
+        auto*          mapped  = reinterpret_cast<vk::AccelerationStructureInstanceKHR*>(
+                static_cast<uint8_t*>(this->topLevel.instanceBuffer.memory.map()) + copy * this->topLevel.copySize);
+
+        if (pending.size() < this->topLevel.instances.size())
+        {
+            for (uint32_t instance : pending)
+            {
+                mapped[instance] = this->topLevel.instances[instance];
+            }
+        }
+        else
+        {
+            memcpy(mapped, this->topLevel.instances.data(), this->topLevel.instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+        }
+        pending.clear();
+
+        using enum vk::AccessFlagBits;
+        using enum vk::PipelineStageFlagBits;
+
+        // earlier frames on the queue may still trace rays through the TLAS or build it
+        vk::MemoryBarrier before{};
+        before
+            .setSrcAccessMask(eAccelerationStructureReadKHR | eAccelerationStructureWriteKHR)
+            .setDstAccessMask(eAccelerationStructureReadKHR | eAccelerationStructureWriteKHR);
+        cmd.pipelineBarrier(eRayTracingShaderKHR | eAccelerationStructureBuildKHR, eAccelerationStructureBuildKHR, {}, before, {}, {});
+
+        const bool rebuild = ++this->topLevel.refits >= TLAS_REBUILD_INTERVAL;
+        buildTopLevel(cmd, copy, !rebuild);
+        if (rebuild) this->topLevel.refits = 0;
+
+        vk::MemoryBarrier after{};
+        after
+            .setSrcAccessMask(eAccelerationStructureWriteKHR)
+            .setDstAccessMask(eAccelerationStructureReadKHR);
+        cmd.pipelineBarrier(eAccelerationStructureBuildKHR, eRayTracingShaderKHR, {}, after, {}, {});
+
+        this->topLevel.dirty = false;
+
+        return shared_from_this();
+    }
+
+    Scene Scene_t::buildBVH(uint32_t threadCount)
+    {
+        if (this->cache)
+        {
+            throw std::runtime_error("buildBVH() reads the glTF model, scenes loaded from a cache do not have one");
+        }
+
+        struct Job
+        {
+            Primitive                  primitive;
+            const tinygltf::Primitive* gltfPrimitive;
+        };
+
+        std::vector<Job>                     jobs{};
+        std::vector<SceneBVH::Instance>      instances{};
+        std::vector<std::pair<uint32_t, size_t>> instanceSources{}; // node, primitive
+
+        // One instance per (node, primitive) in node order; primitives of a shared mesh are built once
+        std::set<const Primitive_t*> queued{};
+        for (uint32_t node = 0; node < this->graph.getCount(); ++node)
+        {
+            if (this->graph.getMesh(node) < 0) continue;
+            const Mesh& mesh = this->meshes[this->graph.getMesh(node)];
+
+            const tinygltf::Mesh& gltfMesh = this->model.meshes[this->graph.getMesh(node)];
+            for (size_t i = 0; i < mesh->primitives.size(); ++i)
+            {
+                Primitive primitive = mesh->primitives[i];
+                if (!primitive->bvh && queued.insert(primitive.get()).second)
+                {
+                    jobs.push_back({ primitive, &gltfMesh.primitives[i] });
+                }
+                instanceSources.push_back({ node, i });
+            }
+        }
+
+        // Geometry is read straight from the glTF buffers, one primitive per thread,
+        // threads left over are split between the primitives' builds
+        if (!threadCount) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        BVH::CreateInfo bvhInfo{};
+        bvhInfo.threadCount = std::max(1u, threadCount / static_cast<uint32_t>(std::max<size_t>(jobs.size(), 1)));
+
+        std::atomic<size_t> nextJob{0};
+        auto work = [&]()
+        {
+            for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+            {
+                const tinygltf::Primitive& gltfPrimitive = *jobs[j].gltfPrimitive;
+                auto[posBuffer, posByteStride, posComponentType] = loadVertexAttribute(gltfPrimitive, "POSITION");
+
+                std::vector<glm::vec3> positions(jobs[j].primitive->vertexCount);
+                for (size_t v = 0; v < positions.size(); ++v)
+                {
+                    positions[v] = glm::make_vec3(&posBuffer[v * posByteStride]);
+                }
+
+                jobs[j].primitive->bvh = std::make_shared<MeshBVH>(positions, fetchIndices(gltfPrimitive), bvhInfo);
+            }
+        };
+
+        std::vector<std::thread> workers{};
+        for (uint32_t i = 1; i < std::min<size_t>(threadCount, jobs.size()); ++i)
+        {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        this->cpuInstances.clear();
+        for (auto& [node, i] : instanceSources)
+        {
+            const Primitive& primitive = this->meshes[this->graph.getMesh(node)]->primitives[i];
+            const glm::mat4& world     = this->graph.getWorldMatrix(node);
+            instances.push_back({ primitive->bvh, world });
+
+            if (isHeadless())
+            {
+                const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+                this->cpuInstances.push_back({ &primitive->vertices, &primitive->indices, &this->materials[primitive->materialIndex], normalMatrix });
+            }
+        }
+
+        BVH::CreateInfo topInfo{};
+        topInfo.threadCount = threadCount;
+        this->bvh = std::make_shared<SceneBVH>(std::move(instances), topInfo);
+
+        return shared_from_this();
+    }
+
+    const Scene_t::CpuInstance& Scene_t::getCpuInstance(uint32_t instance)
+    {
+        return this->cpuInstances[instance];
+    }
+
+    const tinygltf::Image& Scene_t::getTextureImage(int texture)
+    {
+        return this->model.images[this->model.textures[texture].source];
+    }
+
+    Application::Sampler Scene_t::getTextureSampler(int texture)
+    {
+        const int sampler = this->model.textures[texture].sampler;
+        return sampler == -1 ? Application::Sampler{} : this->samplers[sampler];
+    }
+
+    const SceneBVH& Scene_t::getBVH()
+    {
+        if (!this->bvh)
+        {
+            throw std::runtime_error("Scene BVH is not built, call buildBVH() first");
+        }
+        return *this->bvh;
+    }
+
+    SceneGraph::Transform Scene_t::loadTransform(const tinygltf::Node& gltfNode)
+    {
+        SceneGraph::Transform transform{};
+        if (gltfNode.translation.size() == 3) transform.translation = glm::make_vec3(gltfNode.translation.data());
+        if (gltfNode.rotation.size() == 4)    transform.rotation    = glm::make_quat(gltfNode.rotation.data());
+        if (gltfNode.scale.size() == 3)       transform.scale       = glm::make_vec3(gltfNode.scale.data());
+        if (gltfNode.matrix.size() == 16)     transform.matrix      = glm::make_mat4x4(gltfNode.matrix.data());
+
+        return transform;
+    }
+
+    void Scene_t::loadNode(const uint32_t parent, const tinygltf::Node& gltfNode, const uint32_t nodeIndex)
+    {
+        if (gltfNode.mesh > -1)
+        {
+            loadMesh(gltfNode.mesh);
+        }
+
+        const uint32_t node = this->graph.push(parent, loadTransform(gltfNode), gltfNode.mesh, nodeIndex);
+
+        for (const auto& childIndex : gltfNode.children)
+        {
+            const auto& child = this->model.nodes[childIndex];
+            loadNode(node, child, childIndex);
+        }
+    }
+
+    Scene Scene_t::loadCameras()
+    {
+        // TODO: load gltf cameras as well
+        Camera camera{new Camera_t()};
+        camera
+            ->setType(Camera_t::Type::eFirstPerson)
+            ->setRotationSpeed(0.2f)
+            ->setMovementSpeed(1.0f)
+            ->createCameraUBOs(this->device, this->physicalDevice, this->swapchainImagesCount);
+
+        this->cameras.push_back(camera);
+        this->cameraIndex = 0;
+
+        return shared_from_this();
+    }
+
+    static inline bool is_base64(uint8_t c)
+    {
+        return (isalnum(c) || (c == '+') || (c == '/'));
+    }
+
+    std::string base64_decode(std::string const &encoded_string)
+    {
+        int in_len = static_cast<int>(encoded_string.size());
+        int i = 0;
+        int j = 0;
+        int in_ = 0;
+        uint8_t char_array_4[4], char_array_3[3];
+        std::string ret;
+
+        const std::string base64_chars =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz"
+            "0123456789+/";
+
+        while (in_len-- && (encoded_string[in_] != '=') &&
+                is_base64(encoded_string[in_])) {
+            char_array_4[i++] = encoded_string[in_];
+            in_++;
+            if (i == 4) {
+                for (i = 0; i < 4; i++)
+                    char_array_4[i] =
+                        static_cast<uint8_t>(base64_chars.find(char_array_4[i]));
+
+                char_array_3[0] =
+                    (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
+                char_array_3[1] =
+                    ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
+                char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+
+                for (i = 0; (i < 3); i++) ret += char_array_3[i];
+                i = 0;
+            }
+        }
+
+        if (i) {
+            for (j = i; j < 4; j++) char_array_4[j] = 0;
+
+            for (j = 0; j < 4; j++)
                 char_array_4[j] =
                     static_cast<uint8_t>(base64_chars.find(char_array_4[j]));
 
@@ -617,10 +1214,67 @@ namespace vlb {
         i >> json;
         auto light = json["light"];
 
-        if (!light.empty())
+        // no baked light, the scene is lit by the skybox alone
+        auto loadEmptyLight = [this]()
+        {
+            this->bakedLight.origin   = glm::vec3(0.0f);
+            this->bakedLight.dims     = glm::uvec3(0u);
+            this->bakedLight.gridStep = glm::vec3(0.0f);
+            this->bakedLight.lmax     = 0u;
+            std::vector<uint8_t> dummy = {0, 0, 0};
+            this->bakedLight.coeffs = toBuffer(std::move(dummy), MemoryAllocator::Category::eSHProbes);
+        };
+
+        // bands above the shaders' SH would be read out of bounds
+        auto isSupported = [this](uint32_t lmax)
+        {
+            if (lmax <= VLB_SH_MAX_LMAX) return true;
+
+            std::cerr << "warning: baked light of " << this->path << " uses SH band " << lmax
+                << ", shaders support up to " << VLB_SH_MAX_LMAX << ", dropping it\n";
+            return false;
+        };
+
+        if (light.contains("uri"))
+        {
+            // the volume is mapped and copied straight into the staging buffer
+            std::filesystem::path volumePath = std::filesystem::path(this->path).parent_path() / light["uri"].get<std::string>();
+            ProbeVolume volume{volumePath.string()};
+
+            auto& header = volume.getHeader();
+            if (!isSupported(header.lmax))
+            {
+                loadEmptyLight();
+                return shared_from_this();
+            }
+
+            this->bakedLight.origin   = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+            this->bakedLight.dims     = glm::uvec3(header.dims[0], header.dims[1], header.dims[2]);
+            this->bakedLight.gridStep = glm::vec3(header.step[0], header.step[1], header.step[2]);
+            this->bakedLight.lmax     = header.lmax;
+
+            if (volume.getProbeCount() == 0 || glm::any(glm::lessThanEqual(this->bakedLight.gridStep, glm::vec3(0.0f))))
+            {
+                throw std::runtime_error("baked light has an empty or degenerate grid: " + volumePath.string());
+            }
+
+            this->bakedLight.coeffs = toBuffer(volume.getData(), MemoryAllocator::Category::eSHProbes);
+        }
+        else if (!light.empty()) // legacy: base64 buffer embedded in the glTF
         {
+            // legacy files store the coefficient count per probe, not the band
+            unsigned coeffCount = light["lmax"].get<unsigned>();
+            unsigned lmax       = static_cast<unsigned>(std::lround(std::sqrt(coeffCount))) - 1u;
+            if (!isSupported(lmax))
+            {
+                loadEmptyLight();
+                return shared_from_this();
+            }
+
+            this->bakedLight.origin   = glm::vec3(0.0f);
+            this->bakedLight.dims     = glm::uvec3(7u);
             this->bakedLight.gridStep = light["gridStep"].get<glm::vec3>();
-            this->bakedLight.lmax     = light["lmax"].get<int>();
+            this->bakedLight.lmax     = lmax;
 
             auto bufferView = json["bufferViews"][light["bufferView"].get<int>()];
             auto buffer     = json["buffers"]    [bufferView["buffer"].get<int>()];
@@ -629,19 +1283,16 @@ namespace vlb {
             std::string header = "data:application/octet-stream;base64,";
             uri.replace(0, header.length(), "");
 
-            char*  ptr = const_cast<char*>(base64_decode(uri).c_str());
+            std::string decoded = base64_decode(uri);
             size_t size = buffer["byteLength"].get<int>();
             std::vector<uint8_t> coeffs(size);
-            memcpy(coeffs.data(), ptr, size);
+            memcpy(coeffs.data(), decoded.data(), std::min(size, decoded.size()));
 
-            this->bakedLight.coeffs = toBuffer(std::move(coeffs));
+            this->bakedLight.coeffs = toBuffer(std::move(coeffs), MemoryAllocator::Category::eSHProbes);
         }
         else
         {
-            this->bakedLight.gridStep = glm::vec3(0.0f);
-            this->bakedLight.lmax     = 0u;
-            std::vector<uint8_t> dummy = {0, 0, 0};
-            this->bakedLight.coeffs = toBuffer(std::move(dummy));
+            loadEmptyLight();
         }
 
         return shared_from_this();
@@ -649,6 +1300,14 @@ namespace vlb {
 
     Scene Scene_t::loadSamplers()
     {
+        loadSource();
+        if (this->cache)
+        {
+            auto samplers = this->cache->getSection<Application::Sampler>(eCacheSamplers);
+            this->samplers.assign(samplers.begin(), samplers.end());
+            return shared_from_this();
+        }
+
         for (auto& gltfSampler : this->model.samplers)
         {
             auto toVkWrapMode = [](int32_t gltfWrapMode) -> vk::SamplerAddressMode
@@ -689,6 +1348,11 @@ namespace vlb {
             this->samplers.push_back(sampler);
         }
 
+        if (this->cacheWriter)
+        {
+            this->cacheWriter->append<Application::Sampler>(eCacheSamplers, this->samplers);
+        }
+
         return shared_from_this();
     }
 
@@ -838,33 +1502,269 @@ namespace vlb {
     {
         std::vector<shader::Material> materials;
 
-        for (tinygltf::Material &gltfMaterial : this->model.materials)
+        if (this->cache)
+        {
+            auto cached = this->cache->getSection<shader::Material>(eCacheMaterials);
+            materials.assign(cached.begin(), cached.end());
+        }
+        else
         {
-            shader::Material material{};
+            for (tinygltf::Material &gltfMaterial : this->model.materials)
+            {
+                shader::Material material{};
 
-            material.factors  = loadFactors(gltfMaterial);
-            material.textures = matchTextures(gltfMaterial);
+                material.factors  = loadFactors(gltfMaterial);
+                material.textures = matchTextures(gltfMaterial);
 
-            materials.push_back(material);
-        }
+                materials.push_back(material);
+            }
+
+            materials.push_back(shader::Material{});
 
-        materials.push_back(shader::Material{});
+            if (this->cacheWriter)
+            {
+                this->cacheWriter->append<shader::Material>(eCacheMaterials, materials);
+            }
+        }
 
+        this->materials      = materials;
         this->materialsCount = materials.size();
-        this->materialBuffer = toBuffer(std::move(materials));
+        this->materialBuffer = toBuffer(std::move(materials), MemoryAllocator::Category::eOther);
 
         return shared_from_this();
     }
 
 
+    // Geometry is fetched and uploaded on the first reference only
+    Scene_t::Mesh Scene_t::loadMesh(int meshIndex)
+    {
+        Mesh& mesh = this->meshes[meshIndex];
+        if (mesh) return mesh;
+
+        mesh = std::make_shared<Mesh_t>();
+
+        // cached geometry goes from the mapped file straight into the staging ring
+        if (this->cache)
+        {
+            const CachedMesh& cachedMesh = this->cache->getSection<CachedMesh>(eCacheMeshes)[meshIndex];
+            const auto vertices = this->cache->getSection<shader::Vertex>(eCacheVertices);
+            const auto indices  = this->cache->getSection<uint32_t>(eCacheIndices);
+
+            for (const auto& cached : this->cache->getSection<CachedPrimitive>(eCachePrimitives).subspan(cachedMesh.firstPrimitive, cachedMesh.primitiveCount))
+            {
+                Primitive primitive{new Primitive_t()};
+                primitive->materialIndex = cached.materialIndex;
+                primitive->vertexCount   = cached.vertexCount;
+                primitive->indexCount    = cached.indexCount;
+                primitive->bounds        = { cached.bounds[0], cached.bounds[1] };
+                primitive->vertexBuffer  = toBuffer(vertices.subspan(cached.firstVertex, cached.vertexCount), MemoryAllocator::Category::eVertex);
+                primitive->indexBuffer   = toBuffer(indices.subspan(cached.firstIndex, cached.indexCount), MemoryAllocator::Category::eIndex);
+
+                mesh->primitives.push_back(std::move(primitive));
+            }
+
+            return mesh;
+        }
+
+        for (const auto& gltfPrimitive : this->model.meshes[meshIndex].primitives)
+        {
+            auto [vertices, primitiveBounds] = fetchVertices(gltfPrimitive);
+            auto indices  = fetchIndices(gltfPrimitive);
+
+            Primitive primitive{new Primitive_t()};
+            primitive->materialIndex = gltfPrimitive.material > -1 ? gltfPrimitive.material : this->materialsCount - 1;
+            primitive->vertexCount   = vertices.size();
+            primitive->indexCount    = indices.size();
+            primitive->bounds        = primitiveBounds;
+
+            if (this->cacheWriter)
+            {
+                CachedPrimitive cached{};
+                cached.mesh          = static_cast<uint32_t>(meshIndex);
+                cached.vertexCount   = primitive->vertexCount;
+                cached.indexCount    = primitive->indexCount;
+                cached.materialIndex = primitive->materialIndex;
+                cached.firstVertex   = this->cacheWriter->append<shader::Vertex>(eCacheVertices, vertices);
+                cached.firstIndex    = this->cacheWriter->append<uint32_t>(eCacheIndices, indices);
+                cached.bounds[0]     = primitiveBounds[0];
+                cached.bounds[1]     = primitiveBounds[1];
+                this->cacheWriter->append(eCachePrimitives, cached);
+            }
+
+            if (isHeadless())
+            {
+                primitive->vertices = std::move(vertices);
+                primitive->indices  = std::move(indices);
+            }
+            else
+            {
+                primitive->vertexBuffer = toBuffer(std::move(vertices), MemoryAllocator::Category::eVertex);
+                primitive->indexBuffer  = toBuffer(std::move(indices), MemoryAllocator::Category::eIndex);
+            }
+
+            mesh->primitives.push_back(std::move(primitive));
+        }
+
+        return mesh;
+    }
+
     Scene Scene_t::loadNodes()
     {
-        const auto& scene = this->model.scenes[0];
+        if (this->cache)
+        {
+            this->meshes.resize(this->cache->getSection<CachedMesh>(eCacheMeshes).size());
 
-        for (const auto& nodeIndex : scene.nodes)
+            for (const auto& node : this->cache->getSection<CachedNode>(eCacheNodes))
+            {
+                if (node.mesh > -1)
+                {
+                    loadMesh(node.mesh);
+                }
+                this->graph.push(node.parent, node.transform, node.mesh, node.source);
+            }
+        }
+        else
         {
-            const auto& node = this->model.nodes[nodeIndex];
-            loadNode(nullptr, node, nodeIndex);
+            const auto& scene = this->model.scenes[0];
+            this->meshes.resize(this->model.meshes.size());
+
+            for (const auto& nodeIndex : scene.nodes)
+            {
+                const auto& node = this->model.nodes[nodeIndex];
+                loadNode(SceneGraph::NONE, node, nodeIndex);
+            }
+
+            for (uint32_t node = 0; this->cacheWriter && node < this->graph.getCount(); ++node)
+            {
+                CachedNode cached{};
+                cached.transform = this->graph.getTransform(node);
+                cached.parent    = this->graph.getParent(node);
+                cached.mesh      = this->graph.getMesh(node);
+                cached.source    = this->graph.getSource(node);
+                this->cacheWriter->append(eCacheNodes, cached);
+            }
+        }
+        this->graph.update();
+
+        // World space bounds of every primitive box
+        for (uint32_t node = 0; node < this->graph.getCount(); ++node)
+        {
+            if (this->graph.getMesh(node) < 0) continue;
+
+            const glm::mat4& world = this->graph.getWorldMatrix(node);
+            for (const auto& primitive : this->meshes[this->graph.getMesh(node)]->primitives)
+            {
+                for (uint32_t corner = 0; corner < 8; ++corner)
+                {
+                    const glm::vec3 local{
+                        primitive->bounds[(corner >> 0) & 1].x,
+                        primitive->bounds[(corner >> 1) & 1].y,
+                        primitive->bounds[(corner >> 2) & 1].z};
+                    const glm::vec3 point = glm::vec3(world * glm::vec4(local, 1.0f));
+
+                    this->bounds[0] = glm::min(this->bounds[0], point);
+                    this->bounds[1] = glm::max(this->bounds[1], point);
+                }
+            }
+        }
+
+        return shared_from_this();
+    }
+
+    Scene Scene_t::loadAnimations()
+    {
+        if (this->cache)
+        {
+            const auto times  = this->cache->getSection<float>(eCacheKeyTimes);
+            const auto values = this->cache->getSection<glm::vec4>(eCacheKeyValues);
+
+            for (const auto& channel : this->cache->getSection<CachedChannel>(eCacheChannels))
+            {
+                if (channel.animation >= this->animations.size())
+                {
+                    this->animations.resize(channel.animation + 1);
+                }
+                this->animations[channel.animation].addChannel(channel.node, channel.path, channel.interpolation,
+                        times.subspan(channel.firstTime, channel.timeCount), values.subspan(channel.firstValue, channel.valueCount));
+            }
+
+            return shared_from_this();
+        }
+
+        // channels target glTF nodes, the graph holds the ones of the default scene
+        std::vector<uint32_t> graphNodes(this->model.nodes.size(), SceneGraph::NONE);
+        for (uint32_t node = 0; node < this->graph.getCount(); ++node)
+        {
+            graphNodes[this->graph.getSource(node)] = node;
+        }
+
+        auto readKeys = [&](int accessorIndex)
+        {
+            const tinygltf::Accessor&   accessor   = this->model.accessors[accessorIndex];
+            const tinygltf::BufferView& bufferView = this->model.bufferViews[accessor.bufferView];
+            const uint8_t* data       = &this->model.buffers[bufferView.buffer].data[accessor.byteOffset + bufferView.byteOffset];
+            const size_t   stride     = accessor.ByteStride(bufferView);
+            const size_t   components = tinygltf::GetNumComponentsInType(accessor.type);
+
+            std::vector<glm::vec4> keys(accessor.count, glm::vec4(0.0f));
+            for (size_t k = 0; k < accessor.count; ++k)
+            {
+                memcpy(&keys[k], data + k * stride, std::min<size_t>(components, 4) * sizeof(float));
+            }
+            return keys;
+        };
+
+        for (const auto& gltfAnimation : this->model.animations)
+        {
+            Animation animation{};
+            for (const auto& channel : gltfAnimation.channels)
+            {
+                const auto& sampler = gltfAnimation.samplers[channel.sampler];
+                if (channel.target_node < 0 || graphNodes[channel.target_node] == SceneGraph::NONE) continue;
+
+                // morph weights are not supported, neither are normalized integer rotations
+                Animation::Path path{};
+                if      (channel.target_path == "translation") path = Animation::Path::eTranslation;
+                else if (channel.target_path == "rotation")    path = Animation::Path::eRotation;
+                else if (channel.target_path == "scale")       path = Animation::Path::eScale;
+                else continue;
+
+                if (this->model.accessors[sampler.input].componentType  != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+                    this->model.accessors[sampler.output].componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) continue;
+
+                Animation::Interpolation interpolation = Animation::Interpolation::eLinear;
+                if      (sampler.interpolation == "STEP")        interpolation = Animation::Interpolation::eStep;
+                else if (sampler.interpolation == "CUBICSPLINE") interpolation = Animation::Interpolation::eCubicSpline;
+
+                std::vector<glm::vec4> inputs = readKeys(sampler.input);
+                std::vector<float>     times(inputs.size());
+                for (size_t k = 0; k < inputs.size(); ++k)
+                {
+                    times[k] = inputs[k].x;
+                }
+
+                std::vector<glm::vec4> values = readKeys(sampler.output);
+                animation.addChannel(graphNodes[channel.target_node], path, interpolation, times, values);
+
+                if (this->cacheWriter)
+                {
+                    CachedChannel cached{};
+                    cached.animation     = static_cast<uint32_t>(this->animations.size());
+                    cached.node          = graphNodes[channel.target_node];
+                    cached.path          = path;
+                    cached.interpolation = interpolation;
+                    cached.firstTime     = this->cacheWriter->append<float>(eCacheKeyTimes, times);
+                    cached.timeCount     = times.size();
+                    cached.firstValue    = this->cacheWriter->append<glm::vec4>(eCacheKeyValues, values);
+                    cached.valueCount    = values.size();
+                    this->cacheWriter->append(eCacheChannels, cached);
+                }
+            }
+
+            if (animation.getChannelCount())
+            {
+                this->animations.push_back(std::move(animation));
+            }
         }
 
         return shared_from_this();
@@ -911,8 +1811,10 @@ namespace vlb {
     }
 
     template <class T>
-        Application::Buffer Scene_t::toBuffer(T data, size_t size)
+        Application::Buffer Scene_t::toBuffer(T data, MemoryAllocator::Category category, size_t size)
         {
+            if (isHeadless()) return Application::Buffer{};
+
             size = size == -1 ? data.size() * sizeof(data.front()) : size;
 
             using enum vk::BufferUsageFlagBits;
@@ -920,126 +1822,485 @@ namespace vlb {
             vk::BufferUsageFlags    usg{};
             vk::MemoryPropertyFlags mem{};
 
-            usg = eTransferSrc;
-            mem = eHostVisible | eHostCoherent;
-            Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, data.data());
-
             usg = eTransferDst | eAccelerationStructureBuildInputReadOnlyKHR | eShaderDeviceAddress | eStorageBuffer;
             mem = eDeviceLocal;
-            Application::Buffer buffer = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem);
+            Application::Buffer buffer = Application::createBuffer(this->device, this->physicalDevice, size, usg, mem, nullptr, { category, this->name });
 
-            vk::BufferCopy copyRegion{};
-            copyRegion.setSize(size);
+            if (!this->uploader)
+            {
+                auto uploaderInfo = UploadBatcher::CreateInfo
+                {
+                    this->physicalDevice,
+                        this->device,
+                        this->queue.transfer,
+                        this->commandPool.transfer,
+                };
+                uploaderInfo.owner = this->name;
+                this->uploader = std::make_unique<UploadBatcher>(uploaderInfo);
+            }
 
-            auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.transfer);
-            cmd.copyBuffer(staging.handle.get(), buffer.handle.get(), 1, &copyRegion);
-            Application::flushCommandBuffer(this->device, this->commandPool.transfer, cmd, this->queue.transfer);
+            // the copy is only recorded here, device reads must wait for uploadTicket
+            this->uploadTicket = this->uploader->upload(buffer.handle.get(), data.data(), size);
 
             return std::move(buffer);
         }
 
+    void Scene_t::waitForUploads()
+    {
+        if (this->uploader)
+        {
+            this->uploader->wait(this->uploadTicket);
+        }
+    }
+
+    UploadBatcher::Ticket Scene_t::getUploadTicket()
+    {
+        return this->uploadTicket;
+    }
+
+    Scene Scene_t::finishUploads()
+    {
+        waitForUploads();
+        this->uploader.reset();
+
+        return shared_from_this();
+    }
+
+    // Texels of a batch are written into one staging buffer on every core, then the
+    // copies and mip chains of the whole batch go out in a single submission
     Scene Scene_t::loadTextures()
     {
-        vk::BufferUsageFlags usage             = vk::BufferUsageFlagBits::eTransferSrc;
-        vk::MemoryPropertyFlags memoryProperty = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        const vk::DeviceSize STAGING_BUDGET = 256ull << 20;
+
+        struct Source
+        {
+            uint32_t                 width;
+            uint32_t                 height;
+            int                      sampler;
+            std::span<const uint8_t> texels;
+        };
 
+        std::vector<Source> sources{};
+        if (this->cache)
+        {
+            const auto texels = this->cache->getSection<uint8_t>(eCacheTexels);
+            for (const auto& cached : this->cache->getSection<CachedTexture>(eCacheTextures))
+            {
+                sources.push_back({ cached.width, cached.height, cached.sampler, texels.subspan(cached.firstTexel, cached.texelCount) });
+            }
+        }
+
+        // the model stays empty when loading from the cache
         for (const auto& gltfTexture : this->model.textures)
         {
             const tinygltf::Image& gltfImage = this->model.images[gltfTexture.source];
-            if (gltfImage.component == 3)
+            sources.push_back({ static_cast<uint32_t>(gltfImage.width), static_cast<uint32_t>(gltfImage.height), gltfTexture.sampler, gltfImage.image });
+
+            if (this->cacheWriter)
+            {
+                CachedTexture cached{};
+                cached.width      = static_cast<uint32_t>(gltfImage.width);
+                cached.height     = static_cast<uint32_t>(gltfImage.height);
+                cached.sampler    = gltfTexture.sampler;
+                cached.firstTexel = this->cacheWriter->append<uint8_t>(eCacheTexels, gltfImage.image);
+                cached.texelCount = gltfImage.image.size();
+                this->cacheWriter->append(eCacheTextures, cached);
+            }
+        }
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        WorkStealingPool pool{};
+
+        // while the device copies one batch the next one is filled; its staging is
+        // only released once its ticket completed
+        SubmissionQueue& submissions = SubmissionQueue::get(this->device, this->queue.graphics);
+        std::deque<std::pair<SubmissionQueue::Ticket, Application::Buffer>> inFlight{};
+
+        for (size_t first = 0; first < sources.size();)
+        {
+            if (inFlight.size() == 2)
+            {
+                inFlight.front().first.wait();
+                inFlight.pop_front();
+            }
+
+            // a batch takes textures until the budget is spent, but at least one
+            std::vector<vk::DeviceSize> offsets{ 0 };
+            size_t last = first;
+            while (last < sources.size() && (last == first || offsets.back() + sources[last].texels.size() <= STAGING_BUDGET))
             {
-                throw std::runtime_error("RGB (not RGBA) textures not allowed!");
+                offsets.push_back((offsets.back() + sources[last].texels.size() + 15) / 16 * 16);
+                ++last;
             }
 
-            Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, gltfImage.image.size(), usage, memoryProperty, gltfImage.image.data());
+            Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, offsets.back(), eTransferSrc, eHostVisible | eHostCoherent,
+                    nullptr, { MemoryAllocator::Category::eStaging, this->name });
+            uint8_t* mapped = static_cast<uint8_t*>(staging.memory.map());
 
-            vk::Extent3D extent{static_cast<uint32_t>(gltfImage.width), static_cast<uint32_t>(gltfImage.height), 1};
-            uint32_t mipLevels{static_cast<uint32_t>(floor(log2(std::min(gltfImage.width, gltfImage.height))) + 1.0)};
-            Application::Sampler sampler = gltfTexture.sampler == -1 ? Application::Sampler{} : this->samplers[gltfTexture.sampler];
+            pool.parallelFor(static_cast<uint32_t>(last - first), [&](uint32_t i, uint32_t)
+            {
+                const auto& texels = sources[first + i].texels;
+                memcpy(mapped + offsets[i], texels.data(), texels.size());
+            });
+
+            auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.graphics);
+            for (size_t t = first; t < last; ++t)
+            {
+                const Source& source = sources[t];
+                vk::Extent3D extent{source.width, source.height, 1};
+                uint32_t mipLevels{static_cast<uint32_t>(floor(log2(std::min(source.width, source.height))) + 1.0)};
+                Application::Sampler sampler = source.sampler == -1 ? Application::Sampler{} : this->samplers[source.sampler];
+
+                Application::Texture texture = Application::createTexture(this->device, this->physicalDevice, sampler, extent, mipLevels,
+                        { MemoryAllocator::Category::eTexture, this->name });
+                Application::recordTextureUpload(cmd, texture, staging.handle.get(), offsets[t - first], extent, mipLevels);
+                this->textures.push_back(std::move(texture));
+            }
+            inFlight.emplace_back(submissions.submit(this->commandPool.graphics, cmd), std::move(staging));
 
-            Application::Texture texture = Application::bufferToImage(this->device, this->physicalDevice, this->commandPool.graphics, this->queue.graphics,
-                    staging, sampler, extent, mipLevels);
+            first = last;
+        }
 
-            this->textures.push_back(std::move(texture));
+        for (auto& [ticket, staging] : inFlight)
+        {
+            ticket.wait();
         }
 
         std::array<float, 4> white1x1 = { 1.0f, 1.0f, 1.0f, 1.0f};
-        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, 4 * sizeof(float), usage, memoryProperty, white1x1.data());
+        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, 4 * sizeof(float), eTransferSrc, eHostVisible | eHostCoherent, white1x1.data(),
+                { MemoryAllocator::Category::eStaging, this->name });
         Application::Texture dummyTexture = Application::bufferToImage(this->device, this->physicalDevice, this->commandPool.graphics, this->queue.graphics,
-                staging, Application::Sampler{}, {1, 1, 1}, 1);
+                staging, Application::Sampler{}, {1, 1, 1}, 1, { MemoryAllocator::Category::eTexture, this->name });
         this->textures.push_back(std::move(dummyTexture));
 
         return shared_from_this();
     }
 
+    // Runs on every core after parsing; tinygltf only kept the encoded bytes of each image
+    void Scene_t::decodeImages()
+    {
+        Profiler::Scope scope{"decodeImages"};
+
+        WorkStealingPool pool{};
+        pool.parallelFor(static_cast<uint32_t>(this->model.images.size()), [&](uint32_t i, uint32_t)
+        {
+            tinygltf::Image& image = this->model.images[i];
+
+            // four channels are asked for, so RGB and grey images come out as RGBA too
+            int width{}, height{}, component{};
+            stbi_uc* pixels = stbi_load_from_memory(image.image.data(), static_cast<int>(image.image.size()), &width, &height, &component, 4);
+            if (!pixels)
+            {
+                throw std::runtime_error("failed to decode image " + std::to_string(i) + " " + image.uri + ": " + stbi_failure_reason());
+            }
+
+            image.image.assign(pixels, pixels + size_t(width) * height * 4);
+            stbi_image_free(pixels);
+
+            image.width      = width;
+            image.height     = height;
+            image.component  = 4;
+            image.bits       = 8;
+            image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+        });
+    }
+
     void SceneManager::pushScene(Scene_t::CreateInfo ci)
     {
-        Scene scene{new Scene_t(ci.path)};
-
-        scene->passVulkanResources(this->initInfo);
-        scene->loadSamplers();
-        scene->loadTextures();
-        scene->loadMaterials();
-        scene->loadNodes();
-        scene->loadBakedLight();
-        scene->buildAccelerationStructures();
-        scene->createDescriptorSetLayout();
-
-        // Instead of calling loadCameras() to fetch cameras from glTF file we load cameras from ci.
-        assert(ci.cameras.size());
-        for (auto& cameraInfo : ci.cameras)
-        {
-            Camera camera{new Camera_t()};
-            camera
-                ->setType(Camera_t::Type::eFirstPerson)
-                ->setRotationSpeed(cameraInfo.rotationSpeed)
-                ->setMovementSpeed(cameraInfo.movementSpeed)
-                ->setYaw(cameraInfo.yaw)
-                ->setPitch(cameraInfo.pitch)
-                ->setPosition(cameraInfo.position)
-                ->createCameraUBOs(initInfo.device, initInfo.physicalDevice, initInfo.swapchainImagesCount);
-
-            scene->pushCamera(camera);
-        }
-        scene->setCameraIndex(ci.cameraIndex);
-        scene->setViewingFrustumForCameras(this->frustum);
-
-        this->scenes.push_back(scene);
+        this->scenes.push_back(nullptr);
         this->sceneNames.push_back(ci.name);
+        this->sceneInfos.push_back(ci);
+    }
 
-        this->sceneChangedFlag = false;
+    const std::string& SceneLoad_t::getPath()
+    {
+        return this->path;
+    }
+
+    float SceneLoad_t::getProgress()
+    {
+        return this->progress;
+    }
+
+    SceneLoad_t::Status SceneLoad_t::getStatus()
+    {
+        return this->status;
     }
 
-    void SceneManager::pushScene(std::string& fileName)
+    std::string SceneLoad_t::getError()
     {
-        Scene scene{new Scene_t(fileName)};
+        return this->status == Status::eFailed ? this->error : std::string{};
+    }
 
-        scene->passVulkanResources(this->initInfo);
-        scene->loadSamplers();
-        scene->loadTextures();
-        scene->loadMaterials();
-        scene->loadNodes();
-        scene->buildAccelerationStructures();
-        scene->createDescriptorSetLayout();
-        scene->loadCameras();
-        scene->loadBakedLight();
-        scene->setCameraIndex(0);
-        scene->setViewingFrustumForCameras(this->frustum);
+    void SceneLoad_t::wait()
+    {
+        if (this->worker.valid())
+        {
+            this->worker.wait();
+        }
+    }
 
-        this->scenes.push_back(scene);
-        this->sceneNames.push_back(scene->name);
+    SceneLoad SceneManager::startLoading(const std::string& path, bool loadCameras)
+    {
+        SceneLoad load{new SceneLoad_t()};
+        load->path = path;
 
-        this->sceneIndex = getScenesCount() - 1;
-        this->sceneChangedFlag = true;
+        // The worker gets a raw pointer: the handle owns the future, and destroying
+        // the future waits for the worker, so the handle outlives it
+        load->worker = std::async(std::launch::async, [info = this->initInfo, load = load.get(), loadCameras]() mutable
+        {
+            // the render thread keeps using the manager's pools, the load records into its own
+            vk::UniqueCommandPool transferPool{}, graphicsPool{}, computePool{};
+            try
+            {
+                vk::CommandPoolCreateInfo poolInfo{};
+                poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+                transferPool = info.device.createCommandPoolUnique(poolInfo.setQueueFamilyIndex(info.transferQueueFamily));
+                graphicsPool = info.device.createCommandPoolUnique(poolInfo.setQueueFamilyIndex(info.graphicsQueueFamily));
+                computePool  = info.device.createCommandPoolUnique(poolInfo.setQueueFamilyIndex(info.computeQueueFamily));
+                info.transferCommandPool = transferPool.get();
+                info.graphicsCommandPool = graphicsPool.get();
+                info.computeCommandPool  = computePool.get();
+
+                Scene scene{new Scene_t(load->path)};
+                scene->passVulkanResources(info);
+
+                // names are the profiler scopes of the steps
+                std::vector<std::pair<const char*, Scene (Scene_t::*)()>> steps{
+                    { "loadSamplers",                &Scene_t::loadSamplers },
+                    { "loadTextures",                &Scene_t::loadTextures },
+                    { "loadMaterials",               &Scene_t::loadMaterials },
+                    { "loadNodes",                   &Scene_t::loadNodes },
+                    { "loadAnimations",              &Scene_t::loadAnimations },
+                    { "storeCache",                  &Scene_t::storeCache },
+                    { "buildAccelerationStructures", &Scene_t::buildAccelerationStructures },
+                    { "createDescriptorSetLayout",   &Scene_t::createDescriptorSetLayout },
+                    { "loadBakedLight",              &Scene_t::loadBakedLight },
+                    { "finishUploads",               &Scene_t::finishUploads }
+                };
+                if (loadCameras)
+                {
+                    steps.push_back({ "loadCameras", &Scene_t::loadCameras });
+                }
+
+                Profiler::Scope scope{"loadScene"};
+                for (size_t step = 0; step < steps.size(); ++step)
+                {
+                    {
+                        Profiler::Scope stepScope{steps[step].first};
+                        (scene.get()->*steps[step].second)();
+                    }
+                    load->progress = static_cast<float>(step + 1) / steps.size();
+                }
+
+                load->scene  = scene;
+                load->status = SceneLoad_t::Status::eReady;
+            }
+            catch (std::exception& error)
+            {
+                load->error  = error.what();
+                load->status = SceneLoad_t::Status::eFailed;
+            }
+
+            for (vk::CommandPool pool : { transferPool.get(), graphicsPool.get(), computePool.get() })
+            {
+                SubmissionQueue::forget(pool);
+            }
+        });
+
+        return load;
+    }
+
+    SceneLoad SceneManager::pushScene(std::string& fileName)
+    {
+        SceneLoad load = startLoading(fileName, true);
+        this->loads.push_back(load);
+        return load;
+    }
+
+    SceneLoad SceneManager::activateScene(int index, bool select)
+    {
+        if (this->scenes[index])
+        {
+            return nullptr;
+        }
+
+        for (auto& load : this->loads)
+        {
+            if (load->index == index)
+            {
+                load->select = load->select || select;
+                return load;
+            }
+        }
+
+        const Scene_t::CreateInfo& ci = this->sceneInfos[index];
+        SceneLoad load = startLoading(ci.path, ci.cameras.empty());
+        load->index  = index;
+        load->select = select;
+
+        this->loads.push_back(load);
+        return load;
+    }
+
+    void SceneManager::prefetchAround(int index)
+    {
+        const int distance = static_cast<int>(this->prefetchDistance);
+        for (int neighbour = index - distance; neighbour <= index + distance; ++neighbour)
+        {
+            if (neighbour != index && neighbour >= 0 && neighbour < static_cast<int>(getScenesCount()))
+            {
+                activateScene(neighbour, false);
+            }
+        }
+    }
+
+    void SceneManager::update()
+    {
+        for (auto it = this->loads.begin(); it != this->loads.end();)
+        {
+            SceneLoad load = *it;
+            if (load->getStatus() == SceneLoad_t::Status::eLoading)
+            {
+                ++it;
+                continue;
+            }
+
+            load->wait();
+            it = this->loads.erase(it);
+
+            if (!load->scene)
+            {
+                std::cerr << "failed to load " << load->path << ": " << load->error << "\n";
+                continue;
+            }
+
+            Scene scene = load->scene;
+            scene->passVulkanResources(this->initInfo); // the load's command pools are gone
+            scene->setCameraIndex(0);
+
+            int index = load->index;
+            if (index == -1)
+            {
+                this->scenes.push_back(scene);
+                this->sceneNames.push_back(scene->name);
+                this->sceneInfos.push_back(Scene_t::CreateInfo{ {}, 0, scene->name, scene->path });
+                index = static_cast<int>(getScenesCount()) - 1;
+            }
+            else
+            {
+                // Instead of calling loadCameras() to fetch cameras from glTF file we load cameras from ci.
+                const Scene_t::CreateInfo& ci = this->sceneInfos[index];
+                for (auto& cameraInfo : ci.cameras)
+                {
+                    Camera camera{new Camera_t()};
+                    camera
+                        ->setType(Camera_t::Type::eFirstPerson)
+                        ->setRotationSpeed(cameraInfo.rotationSpeed)
+                        ->setMovementSpeed(cameraInfo.movementSpeed)
+                        ->setYaw(cameraInfo.yaw)
+                        ->setPitch(cameraInfo.pitch)
+                        ->setPosition(cameraInfo.position)
+                        ->createCameraUBOs(initInfo.device, initInfo.physicalDevice, initInfo.swapchainImagesCount);
+
+                    scene->pushCamera(camera);
+                }
+                if (ci.cameras.size())
+                {
+                    scene->setCameraIndex(ci.cameraIndex);
+                }
+
+                this->scenes[index] = scene;
+            }
+            scene->setViewingFrustumForCameras(this->frustum);
+
+            if (load->select)
+            {
+                this->sceneIndex = index;
+                this->sceneChangedFlag = true;
+            }
+        }
+    }
+
+    void SceneManager::finishLoading()
+    {
+        for (auto& load : this->loads)
+        {
+            load->wait();
+        }
+
+        update();
+    }
+
+    std::vector<SceneLoad>& SceneManager::getLoads()
+    {
+        return this->loads;
+    }
+
+    bool SceneManager::isSceneResident(int index)
+    {
+        return this->scenes[index] != nullptr;
+    }
+
+    Scene_t::CreateInfo& SceneManager::getSceneInfo(int index)
+    {
+        return this->sceneInfos[index];
+    }
+
+    SceneManager& SceneManager::setPrefetchDistance(uint32_t distance)
+    {
+        this->prefetchDistance = distance;
+        return *this;
+    }
+
+    uint32_t SceneManager::getPrefetchDistance()
+    {
+        return this->prefetchDistance;
     }
 
     void SceneManager::popScene()
     {
-        this->initInfo.device.waitIdle();
+        Application::waitIdle(this->initInfo.device);
         this->scenes.erase(this->scenes.begin() + this->sceneIndex);
         this->sceneNames.erase(this->sceneNames.begin() + this->sceneIndex);
+        this->sceneInfos.erase(this->sceneInfos.begin() + this->sceneIndex);
+        MemoryAllocator::get(this->initInfo.device, this->initInfo.physicalDevice).trim();
+
+        for (auto& load : this->loads)
+        {
+            if (load->index > this->sceneIndex) --load->index;
+        }
+
+        // fall back to the closest resident scene below, then above; a placeholder
+        // is only shown once it is loaded
+        int index = std::max(0, this->sceneIndex - 1);
+        int resident = -1;
+        for (int i = index; i >= 0 && resident == -1; --i)
+        {
+            if (this->scenes[i]) resident = i;
+        }
+        for (int i = index + 1; i < static_cast<int>(getScenesCount()) && resident == -1; ++i)
+        {
+            if (this->scenes[i]) resident = i;
+        }
+
+        if (resident == -1)
+        {
+            activateScene(index, true)->wait();
+            update();
+
+            // the placeholder failed to load, something has to be on screen (same as UI::deserialize())
+            if (!isSceneResident(index))
+            {
+                std::string fileName{VLB_DEFAULT_SCENE_NAME};
+                pushScene(fileName);
+                finishLoading();
+            }
+            return;
+        }
 
-        this->sceneIndex = std::max(0, this->sceneIndex - 1);
+        this->sceneIndex = resident;
         this->sceneChangedFlag = true;
     }
 
@@ -1079,6 +2340,14 @@ namespace vlb {
 
     SceneManager& SceneManager::setSceneIndex(int sceneIndex)
     {
+        if (!this->scenes[sceneIndex])
+        {
+            // the current scene stays on screen until the selected one is loaded
+            activateScene(sceneIndex, true);
+            prefetchAround(sceneIndex);
+            return *this;
+        }
+
         this->sceneIndex = sceneIndex;
 
         static int oldSceneIndex = 0;
@@ -1086,6 +2355,7 @@ namespace vlb {
         {
             oldSceneIndex = this->sceneIndex;
             this->sceneChangedFlag = true;
+            prefetchAround(sceneIndex);
         }
 
         return *this;
@@ -1101,7 +2371,7 @@ namespace vlb {
         this->frustum = frustum;
         for (auto& scene : this->scenes)
         {
-            scene->setViewingFrustumForCameras(frustum);
+            if (scene) scene->setViewingFrustumForCameras(frustum);
         }
 
         return *this;
@@ -1116,9 +2386,20 @@ namespace vlb {
 
     SceneManager::~SceneManager()
     {
-        while (this->scenes.size())
+        for (auto& load : this->loads)
+        {
+            load->wait();
+        }
+        this->loads.clear();
+
+        // placeholders must not be loaded just to be popped
+        if (this->scenes.size())
         {
-            popScene();
+            Application::waitIdle(this->initInfo.device);
+            this->scenes.clear();
+            this->sceneNames.clear();
+            this->sceneInfos.clear();
+            MemoryAllocator::get(this->initInfo.device, this->initInfo.physicalDevice).trim();
         }
     };
 }
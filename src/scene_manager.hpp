@@ -12,6 +12,16 @@
 
 #include "application.hpp"
 #include "camera.hpp"
+#include "bvh.hpp"
+#include "scene_graph.hpp"
+#include "animation.hpp"
+#include "scene_cache.hpp"
+#include "work_stealing_pool.hpp"
+#include "upload_batcher.hpp"
+#include "structures.h"
+
+#include <atomic>
+#include <future>
 
 namespace vlb {
 
@@ -34,32 +44,30 @@ namespace vlb {
             typedef std::shared_ptr<Primitive_t> Primitive;
             struct Primitive_t
             {
-                AccelerationStructure blas;
                 uint64_t              materialIndex;
                 uint32_t              indexCount;
                 uint32_t              vertexCount;
                 Application::Buffer   vertexBuffer;
                 Application::Buffer   indexBuffer;
+                std::shared_ptr<MeshBVH> bvh; // CPU twin of the mesh blas geometry, made by buildBVH()
+                std::array<glm::vec3, 2> bounds{}; // object space
+
+                // headless scenes keep geometry here instead of the buffers above
+                std::vector<shader::Vertex> vertices;
+                std::vector<uint32_t>       indices;
 
                 auto getGeometry();
             };
 
             struct Mesh_t;
             typedef std::shared_ptr<Mesh_t> Mesh;
+            // Loaded once per glTF mesh and shared by every node that references it;
+            // each primitive is one geometry of the mesh blas
             struct Mesh_t
             {
                 std::vector<Primitive> primitives;
-            };
-
-            struct Node_t;
-            typedef std::shared_ptr<Node_t> Node;
-            struct Node_t {
-                Node parent;
-                uint32_t index;
-                std::vector<Node> children;
-                Mesh mesh;
-                glm::mat4 matrix;
-                VkTransformMatrixKHR getMatrix();
+                AccelerationStructure  blas;
+                uint32_t               firstGeometry = 0; // instanceInfoBuffer entry of primitives[0]
             };
 
         public:
@@ -75,6 +83,11 @@ namespace vlb {
                 vk::Queue computeQueue;
                 vk::CommandPool computeCommandPool;
                 uint32_t swapchainImagesCount;
+
+                // scenes loading in the background make their own command pools on these
+                uint32_t transferQueueFamily;
+                uint32_t graphicsQueueFamily;
+                uint32_t computeQueueFamily;
             };
 
             struct CreateInfo
@@ -99,21 +112,60 @@ namespace vlb {
 
             Scene passVulkanResources(VulkanResources& info);
 
+            // A scene that never got Vulkan resources is headless: loadSamplers(), loadMaterials(),
+            // loadNodes() and buildBVH() work on the CPU, everything else needs a device
+            bool isHeadless();
+
             // Labels TODO: MAKE PRIVATE
             std::string name;
             std::string path;
 
-            // load*(*); functions must be called in the same order as declared below
+            // load*(*); functions must be called in the same order as declared below.
+            // Scenes with Vulkan resources load from the processed copy next to the glTF
+            // (VLB_SCENE_CACHE_EXTENSION) when it matches the source; otherwise the glTF is
+            // parsed and storeCache() writes that copy from what the loaders produced.
             Scene loadSamplers();
             Scene loadTextures();
             Scene loadMaterials();
             Scene loadNodes();
+            Scene loadAnimations();
+            Scene storeCache();
             Scene buildAccelerationStructures();
             Scene createDescriptorSetLayout();
             Scene loadCameras();
             Scene loadBakedLight();
 
+            // Buffers made by the loaders above are filled through a staging ring in a few
+            // batched submissions; the ticket completes once all of them are on the device.
+            // finishUploads() waits for it and frees the ring.
+            UploadBatcher::Ticket getUploadTicket();
+            Scene                 finishUploads();
+
+            // CPU ray queries, instances are numbered like the TLAS; needs loadNodes()
+            Scene           buildBVH(uint32_t threadCount = 0);
+            const SceneBVH& getBVH();
+
+            // What the hit shaders read through InstanceInfo, for CPU shading of headless scenes
+            struct CpuInstance
+            {
+                const std::vector<shader::Vertex>* vertices;
+                const std::vector<uint32_t>*       indices;
+                const shader::Material*            material;
+                glm::mat3                          normalMatrix; // same as nrm * gl_WorldToObjectEXT
+            };
+            const CpuInstance&     getCpuInstance(uint32_t instance); // filled by buildBVH()
+            const tinygltf::Image& getTextureImage(int texture);
+            Application::Sampler   getTextureSampler(int texture);
+
             std::array<glm::vec3, 2> getBounds();
+            SceneGraph&              getGraph(); // glTF nodes of the default scene, filled by loadNodes()
+
+            // Playback: animate() samples every animation at time in seconds and rewrites the
+            // TLAS instances of the nodes that moved; recordTopLevelUpdate() writes those into the
+            // imageIndex copy of the instance buffer and refits the TLAS in cmd, before rays are traced
+            bool  isAnimated();
+            Scene animate(float time);
+            Scene recordTopLevelUpdate(vk::CommandBuffer cmd, uint32_t imageIndex);
 
             // Camera management
             Scene setCameraIndex(int cameraIndex);
@@ -128,11 +180,14 @@ namespace vlb {
             Scene                   updateSceneDescriptorSets(vk::DescriptorSet targetDS);
 
             // Lighting
-            glm::vec3 getGridStep();
-            unsigned  getLmax();
+            glm::vec3  getGridOrigin();
+            glm::uvec3 getGridDims();
+            glm::vec3  getGridStep();
+            unsigned   getLmax(); // highest SH band, (lmax + 1)^2 coefficients per probe
 
             // TODO MAKE PRIVATE
             AccelerationStructure tlas;
+            std::shared_ptr<SceneBVH> bvh;
             Application::Buffer   instanceInfoBuffer;
             Application::Buffer   materialBuffer;
             size_t materialsCount;
@@ -160,31 +215,102 @@ namespace vlb {
             tinygltf::Model    model;
             tinygltf::TinyGLTF loader;
 
+            std::unique_ptr<SceneCache>         cache;       // loaders read this instead of model when set
+            std::unique_ptr<SceneCache::Writer> cacheWriter; // loaders record into this when set
+
             vk::UniqueDescriptorSetLayout descriptorSetLayout;
 
+            std::unique_ptr<UploadBatcher> uploader;
+            UploadBatcher::Ticket          uploadTicket = 0;
+
             std::vector<Application::Sampler>  samplers;
-            std::vector<Node>     nodes;
-            std::vector<Node>     linearNodes;
+            SceneGraph            graph;
+            std::vector<Mesh>     meshes; // by glTF mesh index, null until a node references it
+            std::vector<Animation> animations;
             std::vector<Camera>   cameras;
 
+            std::vector<shader::Material> materials;
+            std::vector<CpuInstance>      cpuInstances;
+
             std::array<glm::vec3, 2> bounds{};
 
+            // Refits let the TLAS boxes grow loose, so it is rebuilt from scratch every so often
+            static constexpr uint32_t TLAS_REBUILD_INTERVAL = 120;
+
+            // TLAS inputs; the instance buffer is host visible, stays mapped and holds one copy of
+            // the instances per swapchain image, so a frame never writes what another one reads
+            struct
+            {
+                std::vector<vk::AccelerationStructureInstanceKHR> instances;
+                std::vector<uint32_t>                             nodeInstances; // by graph node, SceneGraph::NONE without a mesh
+                Application::Buffer                               instanceBuffer;
+                vk::DeviceSize                                    copySize;
+                std::vector<std::vector<uint32_t>>                pendingWrites; // by copy, instances changed since it was written
+                Application::Buffer                               scratch;
+                vk::BuildAccelerationStructureFlagsKHR            flags;
+                uint32_t                                          refits = 0;
+                bool                                              dirty  = false;
+            } topLevel;
+
             int cameraIndex;
 
             struct BakedLight
             {
+                glm::vec3           origin;
+                glm::uvec3          dims;
                 glm::vec3           gridStep;
                 unsigned            lmax;
                 Application::Buffer coeffs;
             } bakedLight;
 
-            void loadNode(const Node parent, const tinygltf::Node& node, const uint32_t nodeIndex);
-            glm::mat4 loadMatrix(const tinygltf::Node& gltfNode);
+            void loadSource();
+            void decodeImages();
+            bool isCacheCurrent(SceneCache& cache);
+            SceneCache::Key getCacheKey();
+            void loadNode(const uint32_t parent, const tinygltf::Node& node, const uint32_t nodeIndex);
+            Mesh loadMesh(int meshIndex);
+            SceneGraph::Transform loadTransform(const tinygltf::Node& gltfNode);
             auto fetchVertices(const tinygltf::Primitive& primitive);
             auto fetchIndices(const tinygltf::Primitive& primitive);
             auto loadVertexAttribute(const tinygltf::Primitive& primitive, std::string&& label);
-            template <class T> Application::Buffer toBuffer(T data, size_t size = -1);
-            AccelerationStructure buildAS(const vk::AccelerationStructureGeometryKHR& geometry, const vk::AccelerationStructureBuildRangeInfoKHR& range);
+            template <class T> Application::Buffer toBuffer(T data, MemoryAllocator::Category category, size_t size = -1);
+            void waitForUploads();
+            AccelerationStructure createAS(vk::AccelerationStructureTypeKHR level, vk::DeviceSize size);
+            void                  createTopLevel();
+            void                  buildTopLevel(vk::CommandBuffer cmd, uint32_t copy, bool update);
+            void                  buildBottomLevel(const std::vector<Mesh>& meshes);
+    };
+
+    class SceneLoad_t;
+    typedef std::shared_ptr<SceneLoad_t> SceneLoad;
+    // Handle of a scene that SceneManager::pushScene() loads on a worker thread
+    class SceneLoad_t
+    {
+        public:
+            enum class Status
+            {
+                eLoading,
+                eReady,
+                eFailed
+            };
+
+            const std::string& getPath();
+            float              getProgress(); // share of the loading steps done, 0 to 1
+            Status             getStatus();
+            std::string        getError();    // set once the load failed
+            void               wait();
+
+        private:
+            friend class SceneManager;
+
+            std::string         path;
+            std::atomic<float>  progress{0.0f};
+            std::atomic<Status> status{Status::eLoading};
+            std::string         error;
+            Scene               scene;
+            int                 index  = -1;   // placeholder slot, -1 appends
+            bool                select = true; // show the scene once loaded
+            std::future<void>   worker;
     };
 
     class SceneManager
@@ -196,8 +322,14 @@ namespace vlb {
             bool sceneShouldBeFreed;
             bool sceneChangedFlag;
             int  sceneIndex;
-            std::vector<Scene      > scenes;
-            std::vector<std::string> sceneNames;
+            std::vector<Scene              > scenes; // nullptr until a placeholder is loaded
+            std::vector<std::string        > sceneNames;
+            std::vector<Scene_t::CreateInfo> sceneInfos;
+            std::vector<SceneLoad          > loads;
+            uint32_t                         prefetchDistance = 0;
+
+            SceneLoad startLoading(const std::string& path, bool loadCameras);
+            void      prefetchAround(int index);
 
             Scene_t::VulkanResources initInfo;
 
@@ -214,11 +346,26 @@ namespace vlb {
 
             const bool                sceneChanged();
 
+            // Moves scenes that finished loading into the list and shows the ones that were
+            // selected; call at a frame boundary. finishLoading() waits for all loads first.
+            void                      update();
+            void                      finishLoading();
+            std::vector<SceneLoad>&   getLoads();
+
+            // Scenes restored from the session file stay placeholders (name, path, cameras)
+            // until they are first selected; selecting one loads it in the background and
+            // prefetches prefetchDistance neighbours on each side
+            SceneLoad                 activateScene(int index, bool select = true); // nullptr if already resident
+            bool                      isSceneResident(int index);
+            Scene_t::CreateInfo&      getSceneInfo(int index);
+            SceneManager&             setPrefetchDistance(uint32_t distance);
+            uint32_t                  getPrefetchDistance();
+
             SceneManager& setSceneIndex(int sceneIndex);
             SceneManager& setViewingFrustum(ViewingFrustum frustum);
 
-            void pushScene(std::string& fileName);  // hot push on run-time
-            void pushScene(Scene_t::CreateInfo ci); // load scene using deserialized ci
+            SceneLoad pushScene(std::string& fileName); // hot push on run-time, loads in the background
+            void pushScene(Scene_t::CreateInfo ci); // registers a placeholder from deserialized ci
             void popScene();
 
             ~SceneManager();
@@ -0,0 +1,375 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "sh_projector.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include <stb_image.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define VLB_SH_PROJECTOR_AVX2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VLB_SH_PROJECTOR_NEON
+#endif
+
+namespace vlb {
+
+    namespace {
+
+        constexpr double   pi           = 3.14159265358979323846;
+        constexpr uint32_t simdWidth    = 8u;  // rows are padded with zeros to this many floats
+        constexpr uint32_t rowsPerChunk = 16u; // chunks are summed in order, so thread count does not change the bits
+
+        void rowKernelScalar(const float* r, const float* g, const float* b,
+                const float* cosRow, const float* sinRow, uint32_t count, double out[6])
+        {
+            double acc[6]{};
+            for (uint32_t x = 0; x < count; ++x)
+            {
+                acc[0] += double(r[x]) * cosRow[x];
+                acc[1] += double(g[x]) * cosRow[x];
+                acc[2] += double(b[x]) * cosRow[x];
+                acc[3] += double(r[x]) * sinRow[x];
+                acc[4] += double(g[x]) * sinRow[x];
+                acc[5] += double(b[x]) * sinRow[x];
+            }
+            std::copy(acc, acc + 6, out);
+        }
+
+#ifdef VLB_SH_PROJECTOR_AVX2
+        __attribute__((target("avx2,fma")))
+        void rowKernelAvx2(const float* r, const float* g, const float* b,
+                const float* cosRow, const float* sinRow, uint32_t count, double out[6])
+        {
+            __m256 acc[6];
+            for (auto& a : acc) a = _mm256_setzero_ps();
+
+            for (uint32_t x = 0; x < count; x += 8)
+            {
+                __m256 c  = _mm256_loadu_ps(cosRow + x);
+                __m256 s  = _mm256_loadu_ps(sinRow + x);
+                __m256 vr = _mm256_loadu_ps(r + x);
+                __m256 vg = _mm256_loadu_ps(g + x);
+                __m256 vb = _mm256_loadu_ps(b + x);
+                acc[0] = _mm256_fmadd_ps(vr, c, acc[0]);
+                acc[1] = _mm256_fmadd_ps(vg, c, acc[1]);
+                acc[2] = _mm256_fmadd_ps(vb, c, acc[2]);
+                acc[3] = _mm256_fmadd_ps(vr, s, acc[3]);
+                acc[4] = _mm256_fmadd_ps(vg, s, acc[4]);
+                acc[5] = _mm256_fmadd_ps(vb, s, acc[5]);
+            }
+
+            for (int i = 0; i < 6; ++i)
+            {
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, acc[i]);
+                out[i] = 0.0;
+                for (float lane : lanes) out[i] += lane;
+            }
+        }
+#endif
+
+#ifdef VLB_SH_PROJECTOR_NEON
+        void rowKernelNeon(const float* r, const float* g, const float* b,
+                const float* cosRow, const float* sinRow, uint32_t count, double out[6])
+        {
+            float32x4_t acc[6];
+            for (auto& a : acc) a = vdupq_n_f32(0.0f);
+
+            for (uint32_t x = 0; x < count; x += 4)
+            {
+                float32x4_t c  = vld1q_f32(cosRow + x);
+                float32x4_t s  = vld1q_f32(sinRow + x);
+                float32x4_t vr = vld1q_f32(r + x);
+                float32x4_t vg = vld1q_f32(g + x);
+                float32x4_t vb = vld1q_f32(b + x);
+                acc[0] = vfmaq_f32(acc[0], vr, c);
+                acc[1] = vfmaq_f32(acc[1], vg, c);
+                acc[2] = vfmaq_f32(acc[2], vb, c);
+                acc[3] = vfmaq_f32(acc[3], vr, s);
+                acc[4] = vfmaq_f32(acc[4], vg, s);
+                acc[5] = vfmaq_f32(acc[5], vb, s);
+            }
+
+            for (int i = 0; i < 6; ++i)
+            {
+                float lanes[4];
+                vst1q_f32(lanes, acc[i]);
+                out[i] = double(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+            }
+        }
+#endif
+    }
+
+    SHProjector::SHProjector(const CreateInfo& ci)
+        : lmax(ci.lmax)
+        , threadCount(ci.threadCount ? ci.threadCount : std::max(std::thread::hardware_concurrency(), 1u))
+        , rowKernel(rowKernelScalar)
+        , instructionSet("scalar")
+    {
+#if defined(VLB_SH_PROJECTOR_AVX2)
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            this->rowKernel      = rowKernelAvx2;
+            this->instructionSet = "avx2";
+        }
+#elif defined(VLB_SH_PROJECTOR_NEON)
+        this->rowKernel      = rowKernelNeon;
+        this->instructionSet = "neon";
+#endif
+
+        this->normalization = computeNormalization(this->lmax);
+    }
+
+    // K(l, m) = sqrt((2l + 1) / 4pi * (l - |m|)! / (l + |m|)!)
+    std::vector<double> SHProjector::computeNormalization(uint32_t lmax)
+    {
+        std::vector<double> normalization((lmax + 1) * (lmax + 1));
+        for (int l = 0; l <= int(lmax); ++l)
+        {
+            for (int m = -l; m <= l; ++m)
+            {
+                double ratio = 1.0;
+                for (int k = l - std::abs(m) + 1; k <= l + std::abs(m); ++k)
+                {
+                    ratio /= k;
+                }
+
+                double K = std::sqrt((2.0 * l + 1.0) / (4.0 * pi) * ratio);
+                normalization[l * (l + 1) + m] = m == 0 ? K : std::sqrt(2.0) * K;
+            }
+        }
+        return normalization;
+    }
+
+    // Associated Legendre P(l, m)(z) with the Condon-Shortley phase, stored at l * (l + 1) + m, m >= 0
+    void SHProjector::computeLegendre(uint32_t lmax, double z, double s, double* out)
+    {
+        double pmm = 1.0;
+        for (int m = 0; m <= int(lmax); ++m)
+        {
+            if (m > 0) pmm *= -(2.0 * m - 1.0) * s;
+            out[m * (m + 1) + m] = pmm;
+
+            if (m < int(lmax))
+            {
+                out[(m + 1) * (m + 2) + m] = z * (2.0 * m + 1.0) * pmm;
+            }
+            for (int l = m + 2; l <= int(lmax); ++l)
+            {
+                out[l * (l + 1) + m] = ((2.0 * l - 1.0) * z * out[(l - 1) * l + m]
+                        - (l + m - 1.0) * out[(l - 2) * (l - 1) + m]) / (l - m);
+            }
+        }
+    }
+
+    void SHProjector::evaluate(uint32_t lmax, float x, float y, float z, float* out)
+    {
+        // the table is rebuilt per thread only when the band changes
+        thread_local uint32_t            cachedLmax = ~0u;
+        thread_local std::vector<double> normalization{};
+        thread_local std::vector<double> legendre{};
+        if (cachedLmax != lmax)
+        {
+            normalization = computeNormalization(lmax);
+            legendre      = std::vector<double>(normalization.size());
+            cachedLmax    = lmax;
+        }
+
+        const double s   = std::sqrt(double(x) * x + double(y) * y);
+        const double phi = std::atan2(double(y), double(x));
+        computeLegendre(lmax, z, s, legendre.data());
+
+        for (int m = 0; m <= int(lmax); ++m)
+        {
+            const double c  = std::cos(m * phi);
+            const double sn = std::sin(m * phi);
+            for (int l = m; l <= int(lmax); ++l)
+            {
+                const double P = legendre[l * (l + 1) + m];
+                out[l * (l + 1) + m] = float(normalization[l * (l + 1) + m] * P * c);
+                if (m) out[l * (l + 1) - m] = float(normalization[l * (l + 1) - m] * P * sn);
+            }
+        }
+    }
+
+    uint32_t SHProjector::getCoeffCount()
+    {
+        return (this->lmax + 1u) * (this->lmax + 1u);
+    }
+
+    const char* SHProjector::getInstructionSet()
+    {
+        return this->instructionSet;
+    }
+
+    // Along a row theta is fixed, so Y(l, m) splits into a per-row Legendre term
+    // and cos(m * phi) or sin(m * phi). Rows only need lmax + 1 dot products per
+    // channel instead of (lmax + 1)^2 SH evaluations per pixel.
+    template <class T>
+    std::vector<float> SHProjector::projectPixels(const T* pixels, uint32_t width, uint32_t height, uint32_t channels, float scale)
+    {
+        if (!pixels || !width || !height || !channels)
+        {
+            throw std::runtime_error("SHProjector: empty image");
+        }
+
+        const uint32_t coeffCount  = getCoeffCount();
+        const uint32_t bands       = this->lmax + 1u;
+        const uint32_t paddedWidth = (width + simdWidth - 1) / simdWidth * simdWidth;
+
+        // cos(m * phi) and sin(m * phi) are the same for every row
+        std::vector<float> cosTable(size_t(bands) * paddedWidth, 0.0f);
+        std::vector<float> sinTable(size_t(bands) * paddedWidth, 0.0f);
+        for (uint32_t m = 0; m < bands; ++m)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const double phi = 2.0 * pi * (x + 0.5) / width;
+                cosTable[m * paddedWidth + x] = float(std::cos(m * phi));
+                sinTable[m * paddedWidth + x] = float(std::sin(m * phi));
+            }
+        }
+
+        const uint32_t chunkCount = (height + rowsPerChunk - 1) / rowsPerChunk;
+        std::vector<double> chunkSums(size_t(chunkCount) * coeffCount * 3, 0.0);
+        std::atomic<uint32_t> nextChunk{0};
+
+        const double pixelArea = (2.0 * pi / width) * (pi / height);
+
+        auto work = [&]()
+        {
+            std::vector<float>  rgb(size_t(3) * paddedWidth, 0.0f);
+            std::vector<double> legendre(coeffCount);
+            float* r = rgb.data();
+            float* g = r + paddedWidth;
+            float* b = g + paddedWidth;
+
+            for (uint32_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+            {
+                double* sums = chunkSums.data() + size_t(chunk) * coeffCount * 3;
+
+                const uint32_t lastRow = std::min((chunk + 1) * rowsPerChunk, height);
+                for (uint32_t y = chunk * rowsPerChunk; y < lastRow; ++y)
+                {
+                    const T* row = pixels + size_t(y) * width * channels;
+                    for (uint32_t x = 0; x < width; ++x)
+                    {
+                        const T* texel = row + size_t(x) * channels;
+                        r[x] = float(texel[0]) * scale;
+                        g[x] = float(texel[channels >= 3 ? 1 : 0]) * scale;
+                        b[x] = float(texel[channels >= 3 ? 2 : 0]) * scale;
+                    }
+
+                    const double theta  = pi * (y + 0.5) / height;
+                    const double z      = std::cos(theta);
+                    const double s      = std::sin(theta);
+                    const double weight = pixelArea * s;
+
+                    computeLegendre(this->lmax, z, s, legendre.data());
+
+                    for (int m = 0; m <= int(this->lmax); ++m)
+                    {
+                        double dots[6];
+                        this->rowKernel(r, g, b, &cosTable[m * paddedWidth], &sinTable[m * paddedWidth], paddedWidth, dots);
+
+                        for (int l = m; l <= int(this->lmax); ++l)
+                        {
+                            const double P = weight * legendre[l * (l + 1) + m];
+
+                            double* positive = sums + (l * (l + 1) + m) * 3;
+                            for (int c = 0; c < 3; ++c)
+                            {
+                                positive[c] += P * this->normalization[l * (l + 1) + m] * dots[c];
+                            }
+
+                            if (m == 0) continue;
+
+                            double* negative = sums + (l * (l + 1) - m) * 3;
+                            for (int c = 0; c < 3; ++c)
+                            {
+                                negative[c] += P * this->normalization[l * (l + 1) - m] * dots[3 + c];
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> workers{};
+        for (uint32_t i = 1; i < std::min(this->threadCount, chunkCount); ++i)
+        {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        std::vector<double> total(size_t(coeffCount) * 3, 0.0);
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            for (size_t i = 0; i < total.size(); ++i)
+            {
+                total[i] += chunkSums[chunk * total.size() + i];
+            }
+        }
+
+        return std::vector<float>(total.begin(), total.end());
+    }
+
+    std::vector<float> SHProjector::project(const float* pixels, uint32_t width, uint32_t height, uint32_t channels)
+    {
+        return projectPixels(pixels, width, height, channels, 1.0f);
+    }
+
+    std::vector<float> SHProjector::project(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t channels)
+    {
+        return projectPixels(pixels, width, height, channels, 1.0f / 255.0f);
+    }
+
+    std::vector<float> SHProjector::project(const uint16_t* pixels, uint32_t width, uint32_t height, uint32_t channels)
+    {
+        return projectPixels(pixels, width, height, channels, 1.0f / 65535.0f);
+    }
+
+    std::vector<float> SHProjector::project(const std::string& imagePath)
+    {
+        const char* path = imagePath.c_str();
+        int width{}, height{}, channels{};
+        std::vector<float> coeffs{};
+
+        // LDR stays as stored, like the rgba8 image sh.comp reads; no sRGB decode
+        if (stbi_is_hdr(path))
+        {
+            float* texels = stbi_loadf(path, &width, &height, &channels, STBI_rgb);
+            if (!texels) throw std::runtime_error("Could not load image: " + imagePath);
+            coeffs = project(texels, width, height, STBI_rgb);
+            stbi_image_free(texels);
+        }
+        else if (stbi_is_16_bit(path))
+        {
+            stbi_us* texels = stbi_load_16(path, &width, &height, &channels, STBI_rgb);
+            if (!texels) throw std::runtime_error("Could not load image: " + imagePath);
+            coeffs = project(texels, width, height, STBI_rgb);
+            stbi_image_free(texels);
+        }
+        else
+        {
+            stbi_uc* texels = stbi_load(path, &width, &height, &channels, STBI_rgb);
+            if (!texels) throw std::runtime_error("Could not load image: " + imagePath);
+            coeffs = project(texels, width, height, STBI_rgb);
+            stbi_image_free(texels);
+        }
+
+        return coeffs;
+    }
+}
+
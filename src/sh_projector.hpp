@@ -0,0 +1,62 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SH_PROJECTOR_HPP
+#define SH_PROJECTOR_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vlb {
+
+    // Projects equirectangular images to SH on the CPU, no Vulkan device needed.
+    // Pixel directions and solid-angle weights match shaders/sh.comp, so the
+    // result can serve as a reference for the GPU kernels. Output is RGB floats,
+    // (lmax + 1)^2 coefficients indexed l * (l + 1) + m, same as a .vlbprobe probe.
+    class SHProjector
+    {
+        public:
+            struct CreateInfo
+            {
+                uint32_t lmax        = 3u; // any band, not limited to the hardcoded shader SH
+                uint32_t threadCount = 0u; // 0 uses every hardware thread
+            };
+
+            // sums RGB of three planar rows against cos(m * phi) and sin(m * phi)
+            typedef void (*RowKernel)(const float* r, const float* g, const float* b,
+                    const float* cosRow, const float* sinRow, uint32_t count, double out[6]);
+
+        private:
+            uint32_t  lmax;
+            uint32_t  threadCount;
+            RowKernel rowKernel;
+            const char* instructionSet;
+
+            std::vector<double> normalization; // K(l, m), sqrt(2) folded in for m != 0
+
+            static std::vector<double> computeNormalization(uint32_t lmax);
+            static void                computeLegendre(uint32_t lmax, double z, double s, double* out);
+
+            template <class T> std::vector<float> projectPixels(const T* pixels, uint32_t width, uint32_t height,
+                    uint32_t channels, float scale);
+
+        public:
+            SHProjector(const CreateInfo& ci);
+
+            // Rows go top to bottom (theta grows with y), phi grows with x.
+            // 8 and 16 bit channels are normalized like UNORM image formats.
+            std::vector<float> project(const float* pixels, uint32_t width, uint32_t height, uint32_t channels);
+            std::vector<float> project(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t channels);
+            std::vector<float> project(const uint16_t* pixels, uint32_t width, uint32_t height, uint32_t channels);
+            std::vector<float> project(const std::string& imagePath); // LDR, 16 bit or HDR, whatever stb_image reads
+
+            // Real SH of every band up to lmax in direction (x, y, z), same basis as SH() in sh_common.h
+            static void evaluate(uint32_t lmax, float x, float y, float z, float* out);
+
+            uint32_t    getCoeffCount();
+            const char* getInstructionSet(); // "avx2", "neon" or "scalar"
+    };
+}
+
+#endif // ifndef SH_PROJECTOR_HPP
+
@@ -52,12 +52,13 @@ namespace vlb {
 
         vk::BufferUsageFlags usage             = vk::BufferUsageFlagBits::eTransferSrc;
         vk::MemoryPropertyFlags memoryProperty = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usage, memoryProperty, texels);
+        Application::Buffer staging = Application::createBuffer(this->device, this->physicalDevice, size, usage, memoryProperty, texels,
+                { MemoryAllocator::Category::eStaging, "skybox " + this->name });
 
         vk::Extent3D extent{static_cast<uint32_t>(this->width), static_cast<uint32_t>(this->height), 1};
 
         this->texture = Application::bufferToImage(this->device, this->physicalDevice, this->commandPool.graphics, this->queue.graphics,
-                staging, Application::Sampler{}, extent, 1);
+                staging, Application::Sampler{}, extent, 1, { MemoryAllocator::Category::eTexture, "skybox " + this->name });
 
         return shared_from_this();
     }
@@ -69,8 +70,13 @@ namespace vlb {
         vk::BufferUsageFlags    usg{ eStorageBuffer };
         vk::MemoryPropertyFlags mem{ eHostVisible | eHostCoherent };
 
-        float init[16 * 3] = {0.f};
-        this->SHCoeffs = Application::createBuffer(this->device, this->physicalDevice, 16 * 3 * sizeof(float), usg, mem, init);
+        float init[VLB_SKYBOX_SH_COEFFS * 3] = {0.f};
+        this->SHCoeffs = Application::createBuffer(this->device, this->physicalDevice, VLB_SKYBOX_SH_COEFFS * 3 * sizeof(float), usg, mem, init,
+                { MemoryAllocator::Category::eSHProbes, "skybox " + this->name });
+
+        size_t groupCount = static_cast<size_t>(ceil(this->width / float(WORKGROUP_SIZE)) * ceil(this->height / float(WORKGROUP_SIZE)));
+        this->SHPartials = Application::createBuffer(this->device, this->physicalDevice, groupCount * VLB_SKYBOX_SH_COEFFS * 3 * sizeof(float),
+                usg, eDeviceLocal, nullptr, { MemoryAllocator::Category::eSHProbes, "skybox " + this->name });
 
         return shared_from_this();
     }
@@ -86,28 +92,30 @@ namespace vlb {
 
         this->device.updateDescriptorSets(writeImage, nullptr);
 
-        vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo
-            .setBuffer(SHCoeffs.handle.get())
-            .setOffset(0)
-            .setRange(SHCoeffs.size);
+        std::array<vk::DescriptorBufferInfo, 2> bufferInfos{
+            vk::DescriptorBufferInfo{ SHCoeffs.handle.get(), 0, SHCoeffs.size },
+            vk::DescriptorBufferInfo{ SHPartials.handle.get(), 0, SHPartials.size }
+        };
 
-        vk::WriteDescriptorSet writeBuffer{};
-        writeBuffer
-            .setDstSet(targetDS)
-            .setDstBinding(1)
-            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
-            .setBufferInfo(bufferInfo);
+        for (uint32_t i = 0; i < bufferInfos.size(); ++i)
+        {
+            vk::WriteDescriptorSet writeBuffer{};
+            writeBuffer
+                .setDstSet(targetDS)
+                .setDstBinding(i + 1)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setBufferInfo(bufferInfos[i]);
 
-        this->device.updateDescriptorSets(writeBuffer, nullptr);
+            this->device.updateDescriptorSets(writeBuffer, nullptr);
+        }
 
         return shared_from_this();
     }
 
-    Skybox Skybox_t::computeSH(vk::Pipeline computePipeline, vk::PipelineLayout layout, vk::DescriptorSet ds)
+    Skybox Skybox_t::computeSH(vk::Pipeline projectPipeline, vk::Pipeline reducePipeline, vk::PipelineLayout layout, vk::DescriptorSet ds)
     {
         auto cmd = Application::recordCommandBuffer(this->device, this->commandPool.compute);
-        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, computePipeline);
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, projectPipeline);
         cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
                 layout,
                 0,
@@ -123,7 +131,25 @@ namespace vlb {
                 vk::ShaderStageFlagBits::eCompute,
                 0, sizeof(PushConstants), &pushConstants
                 );
-        cmd.dispatch((uint32_t)ceil(this->width / float(WORKGROUP_SIZE)), (uint32_t)ceil(this->height / float(WORKGROUP_SIZE)), 1);
+        uint32_t groupCountX = (uint32_t)ceil(this->width / float(WORKGROUP_SIZE));
+        uint32_t groupCountY = (uint32_t)ceil(this->height / float(WORKGROUP_SIZE));
+        cmd.dispatch(groupCountX, groupCountY, 1);
+
+        vk::MemoryBarrier barrier{};
+        barrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+
+        // per-workgroup partials are summed in a fixed order (see sh_reduce.comp)
+        std::array<uint32_t, 3> reduceConstants{ groupCountX * groupCountY, 0u, VLB_SKYBOX_SH_COEFFS }; // groupCount, layerOffset, coeffCount
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, reducePipeline);
+        cmd.pushConstants(
+                layout,
+                vk::ShaderStageFlagBits::eCompute,
+                0, sizeof(reduceConstants), reduceConstants.data()
+                );
+        cmd.dispatch(VLB_SKYBOX_SH_COEFFS, 1, 1);
         Application::flushCommandBuffer(this->device, this->commandPool.compute, cmd, this->queue.compute);
 
         return shared_from_this();
@@ -147,7 +173,13 @@ namespace vlb {
             .setBinding(1)
                 .setDescriptorType(vk::DescriptorType::eStorageBuffer)
                 .setDescriptorCount(1)
-                .setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eMissKHR)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eMissKHR),
+
+                vk::DescriptorSetLayoutBinding{}
+            .setBinding(2)
+                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                .setDescriptorCount(1)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute)
         };
 
         this->descriptorSetLayout = context.device.createDescriptorSetLayoutUnique(
@@ -169,7 +201,7 @@ namespace vlb {
     void SkyboxManager::createDescriptorSets()
     {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
-            {vk::DescriptorType::eStorageBuffer, 1},
+            {vk::DescriptorType::eStorageBuffer, 2},
             {vk::DescriptorType::eCombinedImageSampler, 1}
         };
 
@@ -196,7 +228,7 @@ namespace vlb {
         pcRange
             .setStageFlags(vk::ShaderStageFlagBits::eCompute)
             .setOffset(0)
-            .setSize(sizeof(uint32_t) * 2);
+            .setSize(sizeof(uint32_t) * 3);
 
         this->pipelineLayout = context.device.createPipelineLayoutUnique(
                 vk::PipelineLayoutCreateInfo{}
@@ -204,18 +236,28 @@ namespace vlb {
                 .setPushConstantRanges(pcRange)
                 );
 
-        vk::UniqueShaderModule shaderModule = Application::createShaderModule(context.device, "shaders/skybox_sh.comp.spv");
+        this->pipeline       = createComputePipeline("shaders/skybox_sh.comp.spv");
+        this->reducePipeline = createComputePipeline("shaders/sh_reduce.comp.spv");
+    }
+
+    vk::UniquePipeline SkyboxManager::createComputePipeline(const std::string& shaderPath)
+    {
+        vk::UniqueShaderModule shaderModule = Application::createShaderModule(context.device, shaderPath);
+
+        // SH_LMAX in sh_common.h; sh_reduce.comp ignores it
+        const uint32_t                   lmax = VLB_SKYBOX_SH_LMAX;
+        const vk::SpecializationMapEntry lmaxEntry{ 0, 0, sizeof(uint32_t) };
+        const vk::SpecializationInfo     specialization{ 1, &lmaxEntry, sizeof(lmax), &lmax };
 
         vk::PipelineShaderStageCreateInfo shaderStageCreateInfo{};
         shaderStageCreateInfo
             .setStage(vk::ShaderStageFlagBits::eCompute)
             .setModule(shaderModule.get())
-            .setPName("main");
-
-        this->pipelineCache = context.device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo());
+            .setPName("main")
+            .setPSpecializationInfo(&specialization);
 
         auto[result, p] = context.device.createComputePipelineUnique(
-                pipelineCache.get(),
+                PipelineCache::get(context.device, context.physicalDevice),
                 vk::ComputePipelineCreateInfo{}
                 .setStage(shaderStageCreateInfo)
                 .setLayout(this->pipelineLayout.get()));
@@ -224,10 +266,8 @@ namespace vlb {
         {
             throw std::runtime_error("failed to create compute pipeline");
         }
-        else
-        {
-            this->pipeline = std::move(p);
-        }
+
+        return std::move(p);
     }
 
     void SkyboxManager::passVulkanContext(Skybox_t::VulkanContext& context)
@@ -288,7 +328,7 @@ namespace vlb {
         skybox->createTexture();
         skybox->createSHBuffer();
         skybox->updateDescriptorSets(this->descriptorSet.get());
-        skybox->computeSH(this->pipeline.get(), this->pipelineLayout.get(), this->descriptorSet.get());
+        skybox->computeSH(this->pipeline.get(), this->reducePipeline.get(), this->pipelineLayout.get(), this->descriptorSet.get());
 
         this->skyboxes.push_back(skybox);
         this->skyboxNames.push_back(skybox->getName());
@@ -304,7 +344,7 @@ namespace vlb {
         skybox->createTexture();
         skybox->createSHBuffer();
         skybox->updateDescriptorSets(this->descriptorSet.get());
-        skybox->computeSH(this->pipeline.get(), this->pipelineLayout.get(), this->descriptorSet.get());
+        skybox->computeSH(this->pipeline.get(), this->reducePipeline.get(), this->pipelineLayout.get(), this->descriptorSet.get());
 
         this->skyboxes.push_back(skybox);
         this->skyboxNames.push_back(ci.name);
@@ -314,7 +354,7 @@ namespace vlb {
 
     void SkyboxManager::popSkybox()
     {
-        this->context.device.waitIdle();
+        Application::waitIdle(this->context.device);
         this->skyboxes.erase(this->skyboxes.begin() + this->skyboxIndex);
         this->skyboxNames.erase(this->skyboxNames.begin() + this->skyboxIndex);
 
@@ -5,6 +5,8 @@
 
 #define VLB_DEFAULT_SKYBOX_NAME "default_skybox.jpg"
 #define WORKGROUP_SIZE 16
+#define VLB_SKYBOX_SH_LMAX 3 // skybox_sh.comp and skybox_sh.rmiss are specialized for it
+#define VLB_SKYBOX_SH_COEFFS ((VLB_SKYBOX_SH_LMAX + 1) * (VLB_SKYBOX_SH_LMAX + 1))
 
 #include "application.hpp"
 
@@ -34,6 +36,7 @@ namespace vlb {
             unsigned char* texels;
             Application::Texture texture;
             Application::Buffer SHCoeffs;
+            Application::Buffer SHPartials;
             vk::UniqueDescriptorSetLayout descriptorSetLayout;
 
             // Vulkan resourses
@@ -81,7 +84,7 @@ namespace vlb {
             Skybox createTexture();
             Skybox createSHBuffer();
             Skybox updateDescriptorSets(vk::DescriptorSet targetDS);
-            Skybox computeSH(vk::Pipeline computePipeline, vk::PipelineLayout layout, vk::DescriptorSet ds);
+            Skybox computeSH(vk::Pipeline projectPipeline, vk::Pipeline reducePipeline, vk::PipelineLayout layout, vk::DescriptorSet ds);
 
             std::string getName();
     };
@@ -103,10 +106,11 @@ namespace vlb {
             vk::UniqueDescriptorSet       descriptorSet;
             vk::UniqueDescriptorSetLayout descriptorSetLayout;
             vk::UniquePipeline            pipeline;
-            vk::UniquePipelineCache       pipelineCache;
+            vk::UniquePipeline            reducePipeline;
             vk::UniquePipelineLayout      pipelineLayout;
 
             void createSHComputePipeline();
+            vk::UniquePipeline createComputePipeline(const std::string& shaderPath);
             void createDescriptorSetLayout();
             void createDescriptorSets();
 
@@ -0,0 +1,247 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "sub_allocator.hpp"
+
+#include <bit>
+#include <stdexcept>
+
+namespace vlb {
+
+    SubAllocator::SubAllocator(uint64_t size)
+        : size(size)
+    {
+        this->heads.fill(INVALID);
+
+        uint32_t node = createNode();
+        this->nodes[node].size = size;
+        insertFree(node);
+    }
+
+    // Sizes below SL_COUNT get a class each; above that, fl is the power of two
+    // and sl splits it into SL_COUNT linear steps
+    void SubAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+    {
+        if (size < SL_COUNT)
+        {
+            fl = 0;
+            sl = static_cast<uint32_t>(size);
+            return;
+        }
+
+        uint32_t msb = 63 - std::countl_zero(size);
+        fl = msb - SL_BITS + 1;
+        sl = static_cast<uint32_t>(size >> (msb - SL_BITS)) - SL_COUNT;
+    }
+
+    uint32_t SubAllocator::createNode()
+    {
+        if (!this->unusedNodes.empty())
+        {
+            uint32_t node = this->unusedNodes.back();
+            this->unusedNodes.pop_back();
+            this->nodes[node] = Node{};
+            return node;
+        }
+
+        this->nodes.push_back(Node{});
+        return static_cast<uint32_t>(this->nodes.size() - 1);
+    }
+
+    void SubAllocator::insertFree(uint32_t node)
+    {
+        uint32_t fl{}, sl{};
+        mapping(this->nodes[node].size, fl, sl);
+
+        uint32_t& head = this->heads[fl * SL_COUNT + sl];
+
+        Node& n = this->nodes[node];
+        n.free     = true;
+        n.prevFree = INVALID;
+        n.nextFree = head;
+        if (head != INVALID)
+        {
+            this->nodes[head].prevFree = node;
+        }
+        head = node;
+
+        this->flBitmap     |= 1ull << fl;
+        this->slBitmap[fl] |= 1u << sl;
+    }
+
+    void SubAllocator::removeFree(uint32_t node)
+    {
+        uint32_t fl{}, sl{};
+        mapping(this->nodes[node].size, fl, sl);
+
+        Node& n = this->nodes[node];
+        if (n.prevFree != INVALID)
+        {
+            this->nodes[n.prevFree].nextFree = n.nextFree;
+        }
+        else
+        {
+            this->heads[fl * SL_COUNT + sl] = n.nextFree;
+        }
+        if (n.nextFree != INVALID)
+        {
+            this->nodes[n.nextFree].prevFree = n.prevFree;
+        }
+        n.free = false;
+
+        if (this->heads[fl * SL_COUNT + sl] == INVALID)
+        {
+            this->slBitmap[fl] &= ~(1u << sl);
+            if (!this->slBitmap[fl])
+            {
+                this->flBitmap &= ~(1ull << fl);
+            }
+        }
+    }
+
+    // Rounds size up to the next class boundary, so any node of the found class fits
+    uint32_t SubAllocator::findFree(uint64_t size)
+    {
+        if (size >= SL_COUNT)
+        {
+            uint32_t msb  = 63 - std::countl_zero(size);
+            uint64_t step = 1ull << (msb - SL_BITS);
+            if (size > ~0ull - step) return INVALID;
+            size += step - 1;
+        }
+
+        uint32_t fl{}, sl{};
+        mapping(size, fl, sl);
+        if (fl >= FL_COUNT) return INVALID;
+
+        uint32_t slMap = this->slBitmap[fl] & (~0u << sl);
+        if (!slMap)
+        {
+            uint64_t flMap = fl + 1 < 64 ? this->flBitmap & (~0ull << (fl + 1)) : 0;
+            if (!flMap) return INVALID;
+
+            fl    = static_cast<uint32_t>(std::countr_zero(flMap));
+            slMap = this->slBitmap[fl];
+        }
+
+        sl = static_cast<uint32_t>(std::countr_zero(slMap));
+        return this->heads[fl * SL_COUNT + sl];
+    }
+
+    void SubAllocator::split(uint32_t node, uint64_t size)
+    {
+        uint32_t rest = createNode();
+
+        Node& n = this->nodes[node];
+        Node& r = this->nodes[rest];
+        r.offset       = n.offset + size;
+        r.size         = n.size - size;
+        r.prevPhysical = node;
+        r.nextPhysical = n.nextPhysical;
+        if (n.nextPhysical != INVALID)
+        {
+            this->nodes[n.nextPhysical].prevPhysical = rest;
+        }
+        n.nextPhysical = rest;
+        n.size         = size;
+
+        insertFree(rest);
+    }
+
+    bool SubAllocator::allocate(uint64_t size, uint64_t alignment, Allocation& allocation)
+    {
+        if (!size || size > this->size - this->used) return false;
+        if (alignment & (alignment - 1))
+        {
+            throw std::runtime_error("alignment must be a power of two");
+        }
+
+        // worst case padding is searched for, so the found node fits at any alignment
+        alignment = std::max<uint64_t>(alignment, 1);
+        uint64_t padded = size + alignment - 1;
+        if (padded < size) return false;
+
+        uint32_t node = findFree(padded);
+        if (node == INVALID) return false;
+
+        removeFree(node);
+
+        uint64_t offset  = this->nodes[node].offset;
+        uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+        if (aligned != offset)
+        {
+            // the padding in front stays free on its own
+            split(node, aligned - offset);
+            removeFree(this->nodes[node].nextPhysical);
+            insertFree(node);
+            node = this->nodes[node].nextPhysical;
+        }
+
+        if (this->nodes[node].size > size)
+        {
+            split(node, size);
+        }
+
+        this->used += size;
+
+        allocation.offset = this->nodes[node].offset;
+        allocation.size   = size;
+        allocation.node   = node;
+        return true;
+    }
+
+    void SubAllocator::free(const Allocation& allocation)
+    {
+        uint32_t node = allocation.node;
+        if (node >= this->nodes.size() || this->nodes[node].free)
+        {
+            throw std::runtime_error("freeing a range that is not allocated");
+        }
+
+        this->used -= this->nodes[node].size;
+
+        uint32_t prev = this->nodes[node].prevPhysical;
+        if (prev != INVALID && this->nodes[prev].free)
+        {
+            removeFree(prev);
+            this->nodes[prev].size        += this->nodes[node].size;
+            this->nodes[prev].nextPhysical = this->nodes[node].nextPhysical;
+            if (this->nodes[node].nextPhysical != INVALID)
+            {
+                this->nodes[this->nodes[node].nextPhysical].prevPhysical = prev;
+            }
+            this->unusedNodes.push_back(node);
+            node = prev;
+        }
+
+        uint32_t next = this->nodes[node].nextPhysical;
+        if (next != INVALID && this->nodes[next].free)
+        {
+            removeFree(next);
+            this->nodes[node].size        += this->nodes[next].size;
+            this->nodes[node].nextPhysical = this->nodes[next].nextPhysical;
+            if (this->nodes[next].nextPhysical != INVALID)
+            {
+                this->nodes[this->nodes[next].nextPhysical].prevPhysical = node;
+            }
+            this->unusedNodes.push_back(next);
+        }
+
+        insertFree(node);
+    }
+
+    uint64_t SubAllocator::getSize()
+    {
+        return this->size;
+    }
+
+    uint64_t SubAllocator::getUsedSize()
+    {
+        return this->used;
+    }
+
+    bool SubAllocator::isEmpty()
+    {
+        return this->used == 0;
+    }
+}
+
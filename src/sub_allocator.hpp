@@ -0,0 +1,76 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SUB_ALLOCATOR_HPP
+#define SUB_ALLOCATOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace vlb {
+
+    // Two-level segregated fit (TLSF) bookkeeping for one memory block. Free ranges
+    // sit in size-class lists found through two bitmaps, so allocate() and free()
+    // take constant time; freed ranges merge with free neighbours right away.
+    // Knows nothing about Vulkan: MemoryAllocator owns the device memory.
+    class SubAllocator
+    {
+        public:
+            static constexpr uint32_t INVALID = ~0u;
+
+            struct Allocation
+            {
+                uint64_t offset = 0;
+                uint64_t size   = 0;
+                uint32_t node   = INVALID;
+            };
+
+        private:
+            static constexpr uint32_t SL_BITS  = 4;
+            static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+            static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+            struct Node
+            {
+                uint64_t offset       = 0;
+                uint64_t size         = 0;
+                uint32_t prevPhysical = INVALID;
+                uint32_t nextPhysical = INVALID;
+                uint32_t prevFree     = INVALID;
+                uint32_t nextFree     = INVALID;
+                bool     free         = false;
+            };
+
+            std::vector<Node>     nodes;
+            std::vector<uint32_t> unusedNodes;
+
+            uint64_t                                  flBitmap = 0;
+            std::array<uint32_t, FL_COUNT>            slBitmap{};
+            std::array<uint32_t, FL_COUNT * SL_COUNT> heads{};
+
+            uint64_t size;
+            uint64_t used = 0;
+
+            static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+            uint32_t createNode();
+            void     insertFree(uint32_t node);
+            void     removeFree(uint32_t node);
+            uint32_t findFree(uint64_t size);
+            void     split(uint32_t node, uint64_t size); // keeps the first size bytes in node
+
+        public:
+            SubAllocator(uint64_t size);
+
+            // alignment must be a power of two
+            bool allocate(uint64_t size, uint64_t alignment, Allocation& allocation);
+            void free(const Allocation& allocation);
+
+            uint64_t getSize();
+            uint64_t getUsedSize();
+            bool     isEmpty();
+    };
+}
+
+#endif // ifndef SUB_ALLOCATOR_HPP
+
@@ -0,0 +1,205 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "application.hpp"
+#include "submission_queue.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace vlb {
+
+    namespace {
+        struct CommandPoolState
+        {
+            vk::Device                                                          device;
+            std::vector<vk::CommandBuffer>                                      free;
+            std::vector<std::pair<SubmissionQueue::Ticket, vk::CommandBuffer>> inFlight;
+        };
+
+        std::mutex                                          queueRegistryMutex;
+        std::map<VkQueue, std::unique_ptr<SubmissionQueue>> queueRegistry;
+
+        std::mutex                                poolRegistryMutex;
+        std::map<VkCommandPool, CommandPoolState> poolRegistry;
+    }
+
+    bool SubmissionQueue::Ticket::isComplete() const
+    {
+        return !this->timeline || this->device.getSemaphoreCounterValue(this->timeline) >= this->value;
+    }
+
+    void SubmissionQueue::Ticket::wait() const
+    {
+        if (!this->timeline) return;
+
+        auto result = this->device.waitSemaphores(
+                vk::SemaphoreWaitInfo{}
+                .setSemaphores(this->timeline)
+                .setValues(this->value),
+                std::numeric_limits<uint64_t>::max());
+
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to wait for submission");
+        }
+    }
+
+    SubmissionQueue::Ticket::operator bool() const
+    {
+        return static_cast<bool>(this->timeline);
+    }
+
+    SubmissionQueue::SubmissionQueue(vk::Device device, vk::Queue queue)
+        : device(device)
+        , queue(queue)
+    {
+        vk::SemaphoreTypeCreateInfo timelineInfo{ vk::SemaphoreType::eTimeline, 0 };
+        this->timeline = this->device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&timelineInfo));
+    }
+
+    SubmissionQueue& SubmissionQueue::get(vk::Device device, vk::Queue queue)
+    {
+        std::lock_guard<std::mutex> lock{queueRegistryMutex};
+
+        auto& submissionQueue = queueRegistry[static_cast<VkQueue>(queue)];
+        if (!submissionQueue)
+        {
+            submissionQueue = std::make_unique<SubmissionQueue>(device, queue);
+        }
+        return *submissionQueue;
+    }
+
+    void SubmissionQueue::release(vk::Device device)
+    {
+        {
+            std::lock_guard<std::mutex> lock{queueRegistryMutex};
+            std::erase_if(queueRegistry, [&](const auto& entry) { return entry.second->device == device; });
+        }
+
+        // command buffers go with their pools
+        std::lock_guard<std::mutex> lock{poolRegistryMutex};
+        std::erase_if(poolRegistry, [&](const auto& entry) { return entry.second.device == device; });
+    }
+
+    vk::CommandBuffer SubmissionQueue::begin(vk::Device device, vk::CommandPool commandPool)
+    {
+        vk::CommandBuffer cmdBuffer{};
+        {
+            std::lock_guard<std::mutex> lock{poolRegistryMutex};
+
+            CommandPoolState& state = poolRegistry[static_cast<VkCommandPool>(commandPool)];
+            state.device = device;
+
+            std::erase_if(state.inFlight, [&](const auto& entry)
+            {
+                if (!entry.first.isComplete()) return false;
+                state.free.push_back(entry.second);
+                return true;
+            });
+
+            if (!state.free.empty())
+            {
+                cmdBuffer = state.free.back();
+                state.free.pop_back();
+            }
+        }
+
+        if (!cmdBuffer)
+        {
+            cmdBuffer = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(commandPool, vk::CommandBufferLevel::ePrimary, 1)).front();
+        }
+
+        // resets a recycled buffer too, every pool is made with eResetCommandBuffer
+        cmdBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        return cmdBuffer;
+    }
+
+    void SubmissionQueue::forget(vk::CommandPool commandPool)
+    {
+        CommandPoolState state{};
+        {
+            std::lock_guard<std::mutex> lock{poolRegistryMutex};
+
+            auto it = poolRegistry.find(static_cast<VkCommandPool>(commandPool));
+            if (it == poolRegistry.end()) return;
+
+            state = std::move(it->second);
+            poolRegistry.erase(it);
+        }
+
+        for (const auto& [ticket, cmdBuffer] : state.inFlight)
+        {
+            ticket.wait();
+        }
+    }
+
+    SubmissionQueue::Ticket SubmissionQueue::submit(vk::CommandPool commandPool, std::span<const vk::CommandBuffer> cmdBuffers, std::span<const Ticket> waits)
+    {
+        for (vk::CommandBuffer cmdBuffer : cmdBuffers)
+        {
+            cmdBuffer.end();
+        }
+
+        std::vector<vk::Semaphore>          waitSemaphores{};
+        std::vector<uint64_t>               waitValues{};
+        std::vector<vk::PipelineStageFlags> waitStages{};
+        for (const Ticket& wait : waits)
+        {
+            if (!wait) continue;
+
+            waitSemaphores.push_back(wait.timeline);
+            waitValues.push_back(wait.value);
+            waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+        }
+
+        Ticket ticket{ this->device, this->timeline.get(), 0 };
+        {
+            // values have to reach the queue in the order they are handed out
+            std::lock_guard<std::mutex> lock{this->mutex};
+            ticket.value = ++this->submitted;
+
+            vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo
+                .setWaitSemaphoreValues(waitValues)
+                .setSignalSemaphoreValues(ticket.value);
+
+            auto queueLock = Application::lockQueue(this->queue);
+            this->queue.submit(
+                    vk::SubmitInfo{}
+                    .setWaitSemaphores(waitSemaphores)
+                    .setWaitDstStageMask(waitStages)
+                    .setCommandBufferCount(static_cast<uint32_t>(cmdBuffers.size()))
+                    .setPCommandBuffers(cmdBuffers.data())
+                    .setSignalSemaphores(ticket.timeline)
+                    .setPNext(&timelineInfo),
+                    nullptr);
+        }
+
+        std::lock_guard<std::mutex> lock{poolRegistryMutex};
+        CommandPoolState& state = poolRegistry[static_cast<VkCommandPool>(commandPool)];
+        state.device = this->device;
+        for (vk::CommandBuffer cmdBuffer : cmdBuffers)
+        {
+            state.inFlight.emplace_back(ticket, cmdBuffer);
+        }
+
+        return ticket;
+    }
+
+    SubmissionQueue::Ticket SubmissionQueue::submit(vk::CommandPool commandPool, vk::CommandBuffer cmdBuffer, std::span<const Ticket> waits)
+    {
+        return submit(commandPool, std::span<const vk::CommandBuffer>(&cmdBuffer, 1), waits);
+    }
+
+    SubmissionQueue::Ticket SubmissionQueue::getLastTicket()
+    {
+        std::lock_guard<std::mutex> lock{this->mutex};
+        return Ticket{ this->device, this->timeline.get(), this->submitted };
+    }
+}
+
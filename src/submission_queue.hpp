@@ -0,0 +1,67 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SUBMISSION_QUEUE_HPP
+#define SUBMISSION_QUEUE_HPP
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+
+namespace vlb {
+
+    // Submissions to one queue, tracked on a timeline semaphore instead of a fence
+    // created and destroyed per call. Command buffers come from the caller's pool
+    // and go back to a per-pool free list once their submission completed, so the
+    // next begin() on that pool does not allocate.
+    class SubmissionQueue
+    {
+        public:
+            // Completion of a submit(): poll it, wait on it later, or pass it to another
+            // submit(), on any queue, which then starts only after it
+            struct Ticket
+            {
+                vk::Device    device;
+                vk::Semaphore timeline;
+                uint64_t      value = 0;
+
+                bool isComplete() const;
+                void wait() const;
+
+                explicit operator bool() const; // false for a default constructed ticket
+            };
+
+        private:
+            vk::Device          device;
+            vk::Queue           queue;
+            vk::UniqueSemaphore timeline;
+            uint64_t            submitted = 0;
+            std::mutex          mutex;
+
+        public:
+            SubmissionQueue(vk::Device device, vk::Queue queue);
+
+            SubmissionQueue(const SubmissionQueue& other) = delete;
+
+            // One per queue, made on first use
+            static SubmissionQueue& get(vk::Device device, vk::Queue queue);
+            static void             release(vk::Device device);
+
+            // A begun one-time-submit primary command buffer of commandPool. Pools are
+            // externally synchronized, only the thread recording into one may call this.
+            static vk::CommandBuffer begin(vk::Device device, vk::CommandPool commandPool);
+
+            // Waits for the pool's command buffers and drops them; call before destroying the pool
+            static void forget(vk::CommandPool commandPool);
+
+            // Ends cmdBuffers and submits them as one batch, after everything in waits
+            Ticket submit(vk::CommandPool commandPool, std::span<const vk::CommandBuffer> cmdBuffers, std::span<const Ticket> waits = {});
+            Ticket submit(vk::CommandPool commandPool, vk::CommandBuffer cmdBuffer, std::span<const Ticket> waits = {});
+
+            Ticket getLastTicket();
+    };
+}
+
+#endif // ifndef SUBMISSION_QUEUE_HPP
+
@@ -0,0 +1,174 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "upload_batcher.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace vlb {
+
+    namespace {
+        constexpr vk::DeviceSize ALIGNMENT = 16;
+    }
+
+    UploadBatcher::UploadBatcher(CreateInfo& ci)
+        : device(ci.device)
+        , queue(ci.queue)
+        , commandPool(ci.commandPool)
+        , capacity(std::max(ci.capacity, ALIGNMENT) / ALIGNMENT * ALIGNMENT)
+    {
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+
+        this->staging = Application::createBuffer(this->device, ci.physicalDevice, this->capacity, eTransferSrc, eHostVisible | eHostCoherent, nullptr,
+                { MemoryAllocator::Category::eStaging, ci.owner });
+        this->mapped  = static_cast<uint8_t*>(this->staging.memory.map());
+
+        vk::SemaphoreTypeCreateInfo timelineInfo{ vk::SemaphoreType::eTimeline, 0 };
+        this->timeline = this->device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}.setPNext(&timelineInfo));
+    }
+
+    UploadBatcher::~UploadBatcher()
+    {
+        // never leave the device copying from memory about to be freed
+        waitIdle();
+    }
+
+    vk::DeviceSize UploadBatcher::allocate(vk::DeviceSize size)
+    {
+        size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+        while (true)
+        {
+            if (this->used == 0)
+            {
+                this->head = 0;
+            }
+
+            // a copy never wraps: the tail end of the ring is skipped and held by this batch instead
+            vk::DeviceSize padding = this->head + size > this->capacity ? this->capacity - this->head : 0;
+            if (this->used + padding + size <= this->capacity)
+            {
+                vk::DeviceSize offset = padding ? 0 : this->head;
+                this->head            = offset + size;
+                this->used           += padding + size;
+                this->pending.bytes  += padding + size;
+                return offset;
+            }
+
+            if (this->pending.copies)
+            {
+                flush();
+            }
+            retire();
+        }
+    }
+
+    void UploadBatcher::retire()
+    {
+        Batch& oldest = this->inFlight.front();
+        wait(oldest.ticket);
+
+        this->used -= oldest.bytes;
+        this->inFlight.pop_front();
+    }
+
+    UploadBatcher::Ticket UploadBatcher::upload(vk::Buffer dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset)
+    {
+        const uint8_t* src = static_cast<const uint8_t*>(data);
+
+        // anything bigger than the ring goes through it in pieces
+        while (size)
+        {
+            vk::DeviceSize chunk  = std::min(size, this->capacity);
+            vk::DeviceSize offset = allocate(chunk);
+
+            memcpy(this->mapped + offset, src, static_cast<size_t>(chunk));
+
+            if (!this->pending.cmd)
+            {
+                this->pending.cmd = std::move(this->device.allocateCommandBuffersUnique(
+                            vk::CommandBufferAllocateInfo(this->commandPool, vk::CommandBufferLevel::ePrimary, 1)).front());
+                this->pending.cmd->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            }
+
+            vk::BufferCopy region{};
+            region
+                .setSrcOffset(offset)
+                .setDstOffset(dstOffset)
+                .setSize(chunk);
+            this->pending.cmd->copyBuffer(this->staging.handle.get(), dst, region);
+            this->pending.copies++;
+
+            src       += chunk;
+            dstOffset += chunk;
+            size      -= chunk;
+        }
+
+        return this->pending.copies ? this->submitted + 1 : this->submitted;
+    }
+
+    UploadBatcher::Ticket UploadBatcher::flush()
+    {
+        if (!this->pending.copies)
+        {
+            return this->submitted;
+        }
+
+        this->pending.cmd->end();
+        this->pending.ticket = ++this->submitted;
+
+        vk::Semaphore timeline = this->timeline.get();
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.setSignalSemaphoreValues(this->pending.ticket);
+
+        vk::CommandBuffer cmd = this->pending.cmd.get();
+        auto lock = Application::lockQueue(this->queue);
+        this->queue.submit(
+                vk::SubmitInfo{}
+                .setCommandBuffers(cmd)
+                .setSignalSemaphores(timeline)
+                .setPNext(&timelineInfo),
+                nullptr);
+
+        this->inFlight.push_back(std::move(this->pending));
+        this->pending = Batch{};
+
+        return this->submitted;
+    }
+
+    bool UploadBatcher::isComplete(Ticket ticket)
+    {
+        return ticket <= this->submitted && this->device.getSemaphoreCounterValue(this->timeline.get()) >= ticket;
+    }
+
+    void UploadBatcher::wait(Ticket ticket)
+    {
+        if (ticket > this->submitted)
+        {
+            flush();
+        }
+
+        vk::Semaphore timeline = this->timeline.get();
+        auto result = this->device.waitSemaphores(
+                vk::SemaphoreWaitInfo{}
+                .setSemaphores(timeline)
+                .setValues(ticket),
+                std::numeric_limits<uint64_t>::max());
+
+        if (result != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("failed to wait for uploads");
+        }
+    }
+
+    void UploadBatcher::waitIdle()
+    {
+        wait(flush());
+
+        this->inFlight.clear();
+        this->used = 0;
+    }
+}
+
@@ -0,0 +1,76 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef UPLOAD_BATCHER_HPP
+#define UPLOAD_BATCHER_HPP
+
+#include <deque>
+
+#include "application.hpp"
+
+namespace vlb {
+
+    // Host to device copies through one staging ring that stays mapped. upload()
+    // only memcpy's into the ring and records a copy; copies go out in batches when
+    // the ring runs full or on flush(), each batch signalling a timeline semaphore.
+    // The returned Ticket is that timeline value: wait on it before reading the
+    // destination on the device, instead of stalling on every single buffer.
+    class UploadBatcher
+    {
+        public:
+            typedef uint64_t Ticket;
+
+            struct CreateInfo
+            {
+                vk::PhysicalDevice physicalDevice;
+                vk::Device         device;
+                vk::Queue          queue;
+                vk::CommandPool    commandPool;
+                vk::DeviceSize     capacity = 64ull << 20; // staging ring size in bytes
+                std::string        owner{};                // accounted as MemoryAllocator::Tag::owner
+            };
+
+        private:
+            struct Batch
+            {
+                vk::UniqueCommandBuffer cmd;
+                Ticket                  ticket = 0;
+                vk::DeviceSize          bytes  = 0; // ring space held until the batch retires, padding included
+                uint32_t                copies = 0;
+            };
+
+            vk::Device          device;
+            vk::Queue           queue;
+            vk::CommandPool     commandPool;
+            Application::Buffer staging;
+            uint8_t*            mapped = nullptr;
+            vk::DeviceSize      capacity;
+            vk::DeviceSize      head = 0;
+            vk::DeviceSize      used = 0;
+
+            vk::UniqueSemaphore timeline;
+            Ticket              submitted = 0;
+
+            Batch             pending;
+            std::deque<Batch> inFlight;
+
+            vk::DeviceSize allocate(vk::DeviceSize size);
+            void           retire();
+
+        public:
+            UploadBatcher(CreateInfo& ci);
+            ~UploadBatcher();
+
+            UploadBatcher(const UploadBatcher& other) = delete;
+
+            // Copies size bytes of data into dst at dstOffset; data may be freed on return
+            Ticket upload(vk::Buffer dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset = 0);
+
+            Ticket flush();              // submits pending copies, returns the ticket of the last one
+            bool   isComplete(Ticket ticket);
+            void   wait(Ticket ticket);  // flushes first if the ticket is still pending
+            void   waitIdle();
+    };
+}
+
+#endif // ifndef UPLOAD_BATCHER_HPP
+
@@ -0,0 +1,140 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+namespace vlb {
+
+    WorkStealingPool::WorkStealingPool(uint32_t threadCount)
+    {
+        threadCount = threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            this->queues.push_back(std::make_unique<Queue>());
+        }
+
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            this->workers.emplace_back(&WorkStealingPool::work, this, i);
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->mutex};
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+
+        for (auto& worker : this->workers)
+        {
+            worker.join();
+        }
+    }
+
+    uint32_t WorkStealingPool::getThreadCount()
+    {
+        return static_cast<uint32_t>(this->workers.size());
+    }
+
+    bool WorkStealingPool::pop(uint32_t worker, uint32_t& index)
+    {
+        Queue& queue = *this->queues[worker];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if (queue.indices.empty()) return false;
+
+        index = queue.indices.back();
+        queue.indices.pop_back();
+        return true;
+    }
+
+    bool WorkStealingPool::steal(uint32_t worker, uint32_t& index)
+    {
+        const uint32_t count = static_cast<uint32_t>(this->queues.size());
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            Queue& victim = *this->queues[(worker + i) % count];
+            std::lock_guard<std::mutex> lock{victim.mutex};
+            if (victim.indices.empty()) continue;
+
+            index = victim.indices.front();
+            victim.indices.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void WorkStealingPool::work(uint32_t worker)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock{this->mutex};
+                this->wake.wait(lock, [&]() { return this->stopping || this->generation != seen; });
+                if (this->stopping) return;
+                seen = this->generation;
+            }
+
+            // the queue locks order the reads of task after parallelFor() published it
+            uint32_t index{};
+            while (pop(worker, index) || steal(worker, index))
+            {
+                try
+                {
+                    (*this->task)(index, worker);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock{this->mutex};
+                    if (!this->error) this->error = std::current_exception();
+                }
+
+                if (--this->remaining == 0)
+                {
+                    std::lock_guard<std::mutex> lock{this->mutex};
+                    this->done.notify_all();
+                }
+            }
+        }
+    }
+
+    void WorkStealingPool::parallelFor(uint32_t count, const Task& task)
+    {
+        if (!count) return;
+
+        std::unique_lock<std::mutex> lock{this->mutex};
+
+        this->task      = &task;
+        this->error     = nullptr;
+        this->remaining = count;
+
+        const uint32_t queueCount = static_cast<uint32_t>(this->queues.size());
+        for (uint32_t q = 0; q < queueCount; ++q)
+        {
+            const uint32_t first = static_cast<uint32_t>(uint64_t(count) * q / queueCount);
+            const uint32_t last  = static_cast<uint32_t>(uint64_t(count) * (q + 1) / queueCount);
+
+            // reversed, so the owner walks its block front to back
+            std::lock_guard<std::mutex> queueLock{this->queues[q]->mutex};
+            for (uint32_t i = last; i > first; --i)
+            {
+                this->queues[q]->indices.push_back(i - 1);
+            }
+        }
+
+        this->generation++;
+        this->wake.notify_all();
+
+        this->done.wait(lock, [&]() { return this->remaining == 0; });
+
+        if (this->error)
+        {
+            std::rethrow_exception(this->error);
+        }
+    }
+}
+
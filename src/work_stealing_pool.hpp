@@ -0,0 +1,67 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vlb {
+
+    // Persistent workers with one deque each. A parallelFor() hands every worker
+    // a contiguous block of indices; owners pop from the back of their own deque
+    // and idle workers steal from the front of someone else's, so uneven tasks
+    // (probes in open space vs. inside dense geometry) still keep every core busy.
+    class WorkStealingPool
+    {
+        public:
+            typedef std::function<void(uint32_t index, uint32_t worker)> Task;
+
+        private:
+            struct Queue
+            {
+                std::mutex           mutex;
+                std::deque<uint32_t> indices;
+            };
+
+            std::vector<std::unique_ptr<Queue>> queues;
+            std::vector<std::thread>            workers;
+
+            const Task*           task = nullptr;
+            std::atomic<uint32_t> remaining{0};
+            std::exception_ptr    error;
+            uint64_t              generation = 0;
+            bool                  stopping   = false;
+
+            std::mutex              mutex;
+            std::condition_variable wake;
+            std::condition_variable done;
+
+            bool pop(uint32_t worker, uint32_t& index);
+            bool steal(uint32_t worker, uint32_t& index);
+            void work(uint32_t worker);
+
+        public:
+            WorkStealingPool(uint32_t threadCount = 0); // 0 uses every hardware thread
+            ~WorkStealingPool();
+
+            WorkStealingPool(const WorkStealingPool& other) = delete;
+
+            uint32_t getThreadCount();
+
+            // Runs task(index, worker) for every index in [0, count), returns once all are done.
+            // The first exception thrown by a task is rethrown here.
+            void parallelFor(uint32_t count, const Task& task);
+    };
+}
+
+#endif // ifndef WORK_STEALING_POOL_HPP
+
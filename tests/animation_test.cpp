@@ -0,0 +1,211 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// Animation::apply for each glTF interpolation: values on and between keys,
+// clamping outside a channel's keys, looping, Hermite splines against a value
+// worked out by hand, rotations taking the short way, and the per-channel key
+// cursor against a binary search whichever way time moves.
+
+#include "animation.hpp"
+#include "check.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+    constexpr float TOLERANCE = 1e-5f;
+
+    using Path          = vlb::Animation::Path;
+    using Interpolation = vlb::Animation::Interpolation;
+
+    bool nearlyEqual(float a, float b)
+    {
+        return std::abs(a - b) <= TOLERANCE * (1.0f + std::abs(b));
+    }
+
+    bool nearlyEqual(const glm::vec3& a, const glm::vec3& b)
+    {
+        return nearlyEqual(a.x, b.x) && nearlyEqual(a.y, b.y) && nearlyEqual(a.z, b.z);
+    }
+
+    // q and -q are the same rotation
+    bool sameRotation(const glm::quat& a, const glm::quat& b)
+    {
+        return std::abs(std::abs(glm::dot(a, b)) - 1.0f) <= TOLERANCE;
+    }
+
+    glm::vec4 xyzw(const glm::quat& q)
+    {
+        return glm::vec4(q.x, q.y, q.z, q.w);
+    }
+
+    glm::vec3 translationAt(vlb::Animation& animation, vlb::SceneGraph& graph, float time, uint32_t node = 0)
+    {
+        animation.apply(time, graph);
+        return graph.getTransform(node).translation;
+    }
+
+    // Linear interpolation found by binary search, nothing cached
+    float referenceLinear(const std::vector<float>& times, const std::vector<glm::vec4>& values, float time)
+    {
+        if (time <= times.front()) return values.front().x;
+        if (time >= times.back()) return values.back().x;
+
+        const size_t key = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+        const float  t   = (time - times[key]) / (times[key + 1] - times[key]);
+        return (1.0f - t) * values[key].x + t * values[key + 1].x;
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+
+    vlb::SceneGraph graph{};
+    for (uint32_t source = 0; source < 3; ++source)
+    {
+        graph.push(vlb::SceneGraph::NONE, {}, -1, source);
+    }
+
+    // step holds each value until the next key time
+    {
+        vlb::Animation animation{};
+        const std::vector<float>     times{ 0.0f, 1.0f, 2.0f };
+        const std::vector<glm::vec4> values{ glm::vec4(1.0f), glm::vec4(2.0f), glm::vec4(3.0f) };
+        animation.addChannel(0, Path::eTranslation, Interpolation::eStep, times, values);
+
+        check(nearlyEqual(translationAt(animation, graph, 0.0f), glm::vec3(1.0f)), "step: first key");
+        check(nearlyEqual(translationAt(animation, graph, 0.99f), glm::vec3(1.0f)), "step: just before a key");
+        check(nearlyEqual(translationAt(animation, graph, 1.0f), glm::vec3(2.0f)), "step: on a key");
+        check(nearlyEqual(translationAt(animation, graph, 1.5f), glm::vec3(2.0f)), "step: between keys");
+    }
+
+    // linear is exact on keys and blends in between
+    {
+        vlb::Animation animation{};
+        const std::vector<float>     times{ 0.0f, 1.0f, 3.0f };
+        const std::vector<glm::vec4> values{ glm::vec4(0.0f), glm::vec4(2.0f, 4.0f, 6.0f, 0.0f), glm::vec4(-2.0f, 0.0f, 2.0f, 0.0f) };
+        animation.addChannel(0, Path::eTranslation, Interpolation::eLinear, times, values);
+
+        check(nearlyEqual(animation.getDuration(), 3.0f), "linear: duration");
+        check(nearlyEqual(translationAt(animation, graph, 1.0f), glm::vec3(2.0f, 4.0f, 6.0f)), "linear: on a key");
+        check(nearlyEqual(translationAt(animation, graph, 0.25f), glm::vec3(0.5f, 1.0f, 1.5f)), "linear: first segment");
+        check(nearlyEqual(translationAt(animation, graph, 2.5f), glm::vec3(-1.0f, 1.0f, 3.0f)), "linear: second segment");
+
+        // playback loops over the animation's time range
+        check(nearlyEqual(translationAt(animation, graph, 3.25f), glm::vec3(0.5f, 1.0f, 1.5f)), "linear: second loop");
+        check(nearlyEqual(translationAt(animation, graph, -1.0f), glm::vec3(0.0f)), "linear: negative time");
+    }
+
+    // a channel keeps its end values outside its own keys
+    {
+        vlb::Animation animation{};
+        const std::vector<float>     longTimes{ 0.0f, 4.0f };
+        const std::vector<glm::vec4> longValues{ glm::vec4(0.0f), glm::vec4(4.0f) };
+        const std::vector<float>     shortTimes{ 1.0f, 2.0f };
+        const std::vector<glm::vec4> shortValues{ glm::vec4(10.0f), glm::vec4(20.0f) };
+        const std::vector<float>     onlyTime{ 1.5f };
+        const std::vector<glm::vec4> onlyKey{ glm::vec4(-1.0f), glm::vec4(7.0f), glm::vec4(-1.0f) }; // in tangent, value, out tangent
+        animation.addChannel(0, Path::eTranslation, Interpolation::eLinear, longTimes, longValues);
+        animation.addChannel(1, Path::eTranslation, Interpolation::eLinear, shortTimes, shortValues);
+        animation.addChannel(2, Path::eScale, Interpolation::eCubicSpline, onlyTime, onlyKey);
+
+        check(animation.getChannelCount() == 3 && nearlyEqual(animation.getDuration(), 4.0f), "clamp: channel count and duration");
+        check(nearlyEqual(translationAt(animation, graph, 0.5f, 1), glm::vec3(10.0f)), "clamp: before the first key");
+        check(nearlyEqual(translationAt(animation, graph, 3.0f, 1), glm::vec3(20.0f)), "clamp: after the last key");
+        check(nearlyEqual(translationAt(animation, graph, 3.0f, 0), glm::vec3(3.0f)), "clamp: longer channel still moves");
+        check(nearlyEqual(graph.getTransform(2).scale, glm::vec3(7.0f)), "clamp: single cubic key is its value, not a tangent");
+    }
+
+    // Hermite, p(t) = h00 p0 + h10 dt m0 + h01 p1 + h11 dt m1 with m0 the out tangent
+    // of the first key and m1 the in tangent of the second. At t = 0.5, dt = 2:
+    // h00 = h01 = 0.5, h10 = 0.125, h11 = -0.125, so x = 0.5 + 0.5 + 1.5 + 1 = 3.5
+    // and y = 0.5 * 2 - 0.25 * 3 + 0 = 0.25; at t = 0.75 the weights are 0.15625,
+    // 0.84375, 0.046875 and -0.140625
+    {
+        vlb::Animation animation{};
+        const std::vector<float>     times{ 0.0f, 2.0f };
+        const std::vector<glm::vec4> values{
+            glm::vec4(100.0f),                       // in tangent of the first key, unused
+            glm::vec4(1.0f, 2.0f, 5.0f, 0.0f),       // p0
+            glm::vec4(2.0f, -3.0f, 0.0f, 0.0f),      // m0
+            glm::vec4(-4.0f, 0.0f, 0.0f, 0.0f),      // m1
+            glm::vec4(3.0f, 0.0f, 5.0f, 0.0f),       // p1
+            glm::vec4(100.0f),                       // out tangent of the last key, unused
+        };
+        animation.addChannel(0, Path::eTranslation, Interpolation::eCubicSpline, times, values);
+
+        check(nearlyEqual(translationAt(animation, graph, 0.0f), glm::vec3(1.0f, 2.0f, 5.0f)), "cubic: first key");
+        check(nearlyEqual(translationAt(animation, graph, 1.0f), glm::vec3(3.5f, 0.25f, 5.0f)), "cubic: Hermite midpoint");
+        check(nearlyEqual(translationAt(animation, graph, 1.5f), glm::vec3(4.0f, 0.03125f, 5.0f)), "cubic: three quarters");
+    }
+
+    // linear rotations take the short way even when the file stores the far hemisphere
+    {
+        vlb::Animation animation{};
+        const glm::vec3 axis{ 0.0f, 0.0f, 1.0f };
+        const std::vector<float>     times{ 0.0f, 1.0f };
+        const std::vector<glm::vec4> values{ xyzw(glm::angleAxis(0.0f, axis)), -xyzw(glm::angleAxis(glm::radians(170.0f), axis)) };
+        animation.addChannel(0, Path::eRotation, Interpolation::eLinear, times, values);
+
+        animation.apply(0.5f, graph);
+        const glm::quat rotation = graph.getTransform(0).rotation;
+        check(sameRotation(rotation, glm::angleAxis(glm::radians(85.0f), axis)), "rotation: midpoint takes the short way");
+        check(nearlyEqual(glm::dot(rotation, rotation), 1.0f), "rotation: result is normalized");
+
+        animation.apply(1.0f - 1e-4f, graph);
+        check(sameRotation(graph.getTransform(0).rotation, glm::angleAxis(glm::radians(170.0f), axis)), "rotation: last key");
+    }
+
+    // The key cursor has to agree with a binary search for forward steps that skip
+    // keys, loops back to the start and random jumps
+    {
+        std::mt19937 random{ 2022u };
+        std::uniform_real_distribution<float> gap{ 0.05f, 0.5f };
+        std::uniform_real_distribution<float> value{ -5.0f, 5.0f };
+
+        std::vector<float>     times{ 0.0f };
+        std::vector<glm::vec4> values{ glm::vec4(value(random)) };
+        for (uint32_t key = 1; key < 64; ++key)
+        {
+            times.push_back(times.back() + gap(random));
+            values.push_back(glm::vec4(value(random)));
+        }
+
+        vlb::Animation animation{};
+        animation.addChannel(0, Path::eTranslation, Interpolation::eLinear, times, values);
+        const float duration = animation.getDuration();
+
+        std::vector<float> sequence{};
+        for (float time = 0.0f; time < 2.5f * duration; time += 0.37f) sequence.push_back(time); // forward, looping twice
+        for (float time = duration; time > 0.0f; time -= 0.61f) sequence.push_back(time);        // backward
+        std::uniform_real_distribution<float> anywhere{ 0.0f, duration };
+        for (uint32_t i = 0; i < 500; ++i) sequence.push_back(anywhere(random));
+        sequence.insert(sequence.end(), times.begin(), times.end() - 1);                          // exactly on keys
+
+        uint32_t mismatches = 0;
+        for (float time : sequence)
+        {
+            const float expected = referenceLinear(times, values, std::fmod(time, duration));
+            mismatches += !nearlyEqual(translationAt(animation, graph, time).x, expected);
+        }
+        check(!mismatches, "cursor: " + std::to_string(mismatches) + " of " + std::to_string(sequence.size()) + " samples differ from a binary search");
+    }
+
+    // malformed channels are rejected
+    {
+        vlb::Animation animation{};
+        const std::vector<float>     times{ 0.0f, 1.0f };
+        const std::vector<glm::vec4> values{ glm::vec4(0.0f), glm::vec4(1.0f) };
+
+        bool threw = false;
+        try { animation.addChannel(0, Path::eScale, Interpolation::eCubicSpline, times, values); } catch (const std::runtime_error&) { threw = true; }
+        check(threw && animation.getChannelCount() == 0, "cubic channel without tangents");
+    }
+
+    return vlb::test::finish();
+}
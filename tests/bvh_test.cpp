@@ -0,0 +1,272 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// MeshBVH and SceneBVH against intersecting every triangle of every instance.
+
+#include "bvh.hpp"
+#include "check.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+    constexpr uint32_t TRIANGLE_COUNT = 3000u;
+    constexpr uint32_t RAY_COUNT      = 2000u;
+    constexpr float    TOLERANCE      = 1e-4f; // relative, both sides may contract differently
+
+    struct Soup
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t>  indices;
+    };
+
+    // Small triangles scattered over [-1, 1]^3, some sharing vertices
+    Soup createSoup(std::mt19937& random, uint32_t triangleCount)
+    {
+        std::uniform_real_distribution<float> position{ -1.0f, 1.0f };
+        std::uniform_real_distribution<float> offset{ -0.15f, 0.15f };
+
+        Soup soup{};
+        for (uint32_t i = 0; i < triangleCount; ++i)
+        {
+            const glm::vec3 center{ position(random), position(random), position(random) };
+            for (uint32_t v = 0; v < 3; ++v)
+            {
+                if (v == 0 && i && random() % 4 == 0)
+                {
+                    soup.indices.push_back(soup.indices[3 * (i - 1)]);
+                    continue;
+                }
+                soup.indices.push_back(static_cast<uint32_t>(soup.positions.size()));
+                soup.positions.push_back(center + glm::vec3(offset(random), offset(random), offset(random)));
+            }
+        }
+        return soup;
+    }
+
+    // Same test as MeshBVH::intersect, no culling
+    bool intersectTriangle(const vlb::Ray& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float tMax, float& t)
+    {
+        const glm::vec3 e1 = v1 - v0;
+        const glm::vec3 e2 = v2 - v0;
+
+        const glm::vec3 h = glm::cross(ray.direction, e2);
+        const float     a = glm::dot(e1, h);
+        if (a == 0.0f) return false;
+
+        const float     f = 1.0f / a;
+        const glm::vec3 s = ray.origin - v0;
+        const float     u = f * glm::dot(s, h);
+        if (u < 0.0f || u > 1.0f) return false;
+
+        const glm::vec3 q = glm::cross(s, e1);
+        const float     v = f * glm::dot(ray.direction, q);
+        if (v < 0.0f || u + v > 1.0f) return false;
+
+        t = f * glm::dot(e2, q);
+        return t >= ray.tMin && t < tMax;
+    }
+
+    vlb::Hit bruteForce(const vlb::Ray& ray, const Soup& soup, const std::vector<glm::mat4>& transforms)
+    {
+        vlb::Hit hit{};
+        hit.t = ray.tMax;
+
+        for (uint32_t instance = 0; instance < transforms.size(); ++instance)
+        {
+            const glm::mat4 worldToObject = glm::inverse(transforms[instance]);
+
+            vlb::Ray local = ray;
+            local.origin    = glm::vec3(worldToObject * glm::vec4(ray.origin, 1.0f));
+            local.direction = glm::vec3(worldToObject * glm::vec4(ray.direction, 0.0f));
+
+            for (uint32_t primitive = 0; primitive < soup.indices.size() / 3; ++primitive)
+            {
+                float t = 0.0f;
+                if (intersectTriangle(local, soup.positions[soup.indices[3 * primitive]], soup.positions[soup.indices[3 * primitive + 1]],
+                            soup.positions[soup.indices[3 * primitive + 2]], hit.t, t))
+                {
+                    hit.t         = t;
+                    hit.instance  = instance;
+                    hit.primitive = primitive;
+                }
+            }
+        }
+
+        if (!hit.valid()) hit.t = std::numeric_limits<float>::max();
+        return hit;
+    }
+
+    std::vector<vlb::Ray> createRays(std::mt19937& random, float extent)
+    {
+        std::uniform_real_distribution<float> position{ -extent, extent };
+        std::normal_distribution<float>       direction{ 0.0f, 1.0f };
+        std::uniform_real_distribution<float> tMax{ 0.5f, 3.0f * extent };
+
+        std::vector<vlb::Ray> rays(RAY_COUNT);
+        for (uint32_t i = 0; i < RAY_COUNT; ++i)
+        {
+            rays[i].origin    = glm::vec3(position(random), position(random), position(random));
+            rays[i].direction = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)));
+            rays[i].tMin      = i % 3 == 0 ? 0.05f : 0.0f;
+            rays[i].tMax      = i % 2 == 0 ? tMax(random) : std::numeric_limits<float>::max(); // short rays for shadow queries
+        }
+        return rays;
+    }
+
+    bool sameHit(const vlb::Hit& hit, const vlb::Hit& reference)
+    {
+        if (hit.valid() != reference.valid()) return false;
+        if (!hit.valid()) return true;
+
+        return hit.primitive == reference.primitive
+            && hit.instance  == reference.instance
+            && std::abs(hit.t - reference.t) <= TOLERANCE * (1.0f + reference.t);
+    }
+
+    // Every node contains its children or its leaf primitives, and every box is in exactly one leaf
+    void checkStructure(const vlb::BVH& bvh, const std::vector<vlb::AABB>& boxes, const std::string& name)
+    {
+        using vlb::test::check;
+
+        const auto& nodes   = bvh.getNodes();
+        const auto& indices = bvh.getPrimitiveIndices();
+
+        std::vector<uint32_t> sorted = indices;
+        std::sort(sorted.begin(), sorted.end());
+        bool permutation = sorted.size() == boxes.size();
+        for (uint32_t i = 0; permutation && i < sorted.size(); ++i) permutation = sorted[i] == i;
+        check(permutation, name + ": primitive indices are not a permutation of the input");
+
+        auto contains = [](const vlb::BVH::Node& node, const glm::vec3& min, const glm::vec3& max)
+        {
+            return glm::all(glm::lessThanEqual(node.min, min)) && glm::all(glm::greaterThanEqual(node.max, max));
+        };
+
+        uint32_t leafPrimitives = 0;
+        for (const vlb::BVH::Node& node : nodes)
+        {
+            if (node.count)
+            {
+                leafPrimitives += node.count;
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+                {
+                    check(contains(node, boxes[indices[i]].min, boxes[indices[i]].max), name + ": leaf does not contain its primitive");
+                }
+            }
+            else
+            {
+                check(node.leftFirst + 1 < nodes.size(), name + ": child index out of range");
+                check(contains(node, nodes[node.leftFirst].min, nodes[node.leftFirst].max)
+                        && contains(node, nodes[node.leftFirst + 1].min, nodes[node.leftFirst + 1].max),
+                        name + ": node does not contain its children");
+            }
+        }
+        check(leafPrimitives == boxes.size(), name + ": leaves hold " + std::to_string(leafPrimitives) + " primitives");
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+
+    std::mt19937 random{ 2022u };
+
+    const Soup soup = createSoup(random, TRIANGLE_COUNT);
+
+    std::vector<vlb::AABB> boxes(TRIANGLE_COUNT);
+    for (uint32_t i = 0; i < TRIANGLE_COUNT; ++i)
+    {
+        for (uint32_t v = 0; v < 3; ++v) boxes[i].grow(soup.positions[soup.indices[3 * i + v]]);
+    }
+
+    // one thread and several must both give a valid tree
+    for (uint32_t threadCount : { 1u, 4u })
+    {
+        vlb::BVH::CreateInfo ci{};
+        ci.threadCount = threadCount;
+        checkStructure(vlb::BVH(boxes, ci), boxes, std::to_string(threadCount) + " thread BVH");
+    }
+
+    // bottom level
+    {
+        const vlb::MeshBVH mesh(soup.positions, soup.indices);
+        const std::vector<glm::mat4> identity{ glm::mat4(1.0f) };
+
+        uint32_t hits = 0, mismatches = 0, anyMismatches = 0;
+        for (const vlb::Ray& ray : createRays(random, 1.2f))
+        {
+            const vlb::Hit reference = bruteForce(ray, soup, identity);
+
+            vlb::Hit hit{};
+            mesh.intersect(ray, hit, false);
+            hit.instance = reference.valid() ? 0u : ~0u;
+            if (!hit.valid()) hit.t = std::numeric_limits<float>::max();
+
+            vlb::Hit any{};
+            anyMismatches += mesh.intersect(ray, any, true) != reference.valid();
+            mismatches    += !sameHit(hit, reference);
+            hits          += reference.valid();
+        }
+        check(hits > RAY_COUNT / 4 && hits < RAY_COUNT, "MeshBVH: rays should both hit and miss, " + std::to_string(hits) + " hit");
+        check(!mismatches, "MeshBVH: " + std::to_string(mismatches) + " closest hits differ from brute force");
+        check(!anyMismatches, "MeshBVH: " + std::to_string(anyMismatches) + " any-hit results differ from brute force");
+    }
+
+    // top level, rotated and scaled instances of one mesh with an empty one in between
+    {
+        auto mesh  = std::make_shared<const vlb::MeshBVH>(soup.positions, soup.indices);
+        auto empty = std::make_shared<const vlb::MeshBVH>(std::vector<glm::vec3>{}, std::vector<uint32_t>{});
+
+        std::uniform_real_distribution<float> position{ -3.0f, 3.0f };
+        std::uniform_real_distribution<float> angle{ 0.0f, 6.2831853f };
+        std::uniform_real_distribution<float> scale{ 0.5f, 1.5f };
+
+        std::vector<glm::mat4>               transforms{};
+        std::vector<vlb::SceneBVH::Instance> instances{};
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+            transform = glm::rotate(transform, angle(random), glm::normalize(glm::vec3(position(random), position(random), 1.0f)));
+            transform = glm::scale(transform, glm::vec3(scale(random), scale(random), scale(random)));
+
+            transforms.push_back(transform);
+            instances.push_back({ mesh, transform });
+        }
+
+        // it must not shift the indices of the instances after it
+        constexpr uint32_t EMPTY_INDEX = 3u;
+        instances.insert(instances.begin() + EMPTY_INDEX, { empty, glm::mat4(1.0f) });
+        const vlb::SceneBVH scene(std::move(instances));
+
+        uint32_t hits = 0, mismatches = 0, anyMismatches = 0;
+        for (const vlb::Ray& ray : createRays(random, 4.0f))
+        {
+            const vlb::Hit reference = bruteForce(ray, soup, transforms);
+
+            vlb::Hit hit = scene.closestHit(ray);
+            if (hit.valid() && hit.instance > EMPTY_INDEX) --hit.instance;
+            else if (hit.valid() && hit.instance == EMPTY_INDEX) hit.instance = ~0u; // the empty mesh was hit
+
+            mismatches    += !sameHit(hit, reference);
+            anyMismatches += scene.anyHit(ray) != reference.valid();
+            hits          += reference.valid();
+        }
+        check(hits > RAY_COUNT / 8 && hits < RAY_COUNT, "SceneBVH: rays should both hit and miss, " + std::to_string(hits) + " hit");
+        check(!mismatches, "SceneBVH: " + std::to_string(mismatches) + " closest hits differ from brute force");
+        check(!anyMismatches, "SceneBVH: " + std::to_string(anyMismatches) + " any-hit results differ from brute force");
+    }
+
+    // nothing to hit at all
+    {
+        const vlb::SceneBVH scene({});
+        vlb::Ray ray{};
+        ray.direction = glm::vec3(0.0f, 0.0f, 1.0f);
+        check(!scene.closestHit(ray).valid() && !scene.anyHit(ray), "empty SceneBVH reports a hit");
+    }
+
+    return vlb::test::finish();
+}
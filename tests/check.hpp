@@ -0,0 +1,45 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Tests are plain executables: main() returns finish(), CTest reads the exit code.
+// A test that has nothing to run on (no Vulkan device, no compiled shaders) returns
+// SKIPPED, which CMakeLists.txt maps to SKIP_RETURN_CODE.
+namespace vlb::test {
+
+    constexpr int SKIPPED = 77;
+
+    inline int failures = 0;
+
+    inline void check(bool condition, const std::string& what)
+    {
+        if (!condition)
+        {
+            std::cerr << "FAILED: " << what << "\n";
+            failures++;
+        }
+    }
+
+    inline int skip(const std::string& reason)
+    {
+        std::cout << "skipped: " << reason << "\n";
+        return SKIPPED;
+    }
+
+    inline int finish()
+    {
+        if (failures)
+        {
+            std::cerr << failures << " check(s) failed\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+#endif // ifndef CHECK_HPP
@@ -0,0 +1,166 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// SceneCache::Writer round trips, and the reader refusing damaged files: short
+// ones, foreign ones and section tables pointing outside the file, including
+// offsets picked so that offset + size wraps around.
+
+#include "scene_cache.hpp"
+#include "check.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+    enum SectionIds : uint32_t
+    {
+        eRecords = 1,
+        eNames,
+        eEmpty,
+        eBytes
+    };
+
+    struct Record
+    {
+        uint32_t id;
+        float    weight;
+        uint64_t offset;
+    };
+
+    std::vector<uint8_t> readFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    }
+
+    void writeFile(const std::filesystem::path& path, const std::vector<uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    template <class T>
+    void poke(std::vector<uint8_t>& bytes, size_t offset, T value)
+    {
+        memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    // A copy of the good file with one thing broken has to be refused on open
+    void checkRejected(const std::filesystem::path& good, const std::filesystem::path& broken, const std::string& name,
+            const std::function<void(std::vector<uint8_t>&)>& damage)
+    {
+        std::vector<uint8_t> bytes = readFile(good);
+        damage(bytes);
+        writeFile(broken, bytes);
+
+        bool threw = false;
+        try { vlb::SceneCache cache{broken.string()}; } catch (const std::runtime_error&) { threw = true; }
+        vlb::test::check(threw, name + " is accepted");
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+    using vlb::SceneCache;
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::filesystem::path path      = directory / "vlb_scene_cache_test.vlbscene";
+    const std::filesystem::path broken    = directory / "vlb_scene_cache_test_broken.vlbscene";
+
+    const SceneCache::Key key{ 0x0123456789abcdefull, 4096u, 7u, 0u };
+
+    std::vector<Record> records{};
+    for (uint32_t i = 0; i < 100; ++i) records.push_back({ i, 0.5f * i, 1000ull * i });
+    const std::string names = "buffer.bin" "texture.png";
+
+    {
+        SceneCache::Writer writer{};
+        check(writer.append<Record>(eRecords, std::span<const Record>(records).first(60)) == 0, "first append starts at record 0");
+        check(writer.append<Record>(eRecords, std::span<const Record>(records).subspan(60)) == 60, "second append continues the section");
+        check(writer.append<char>(eNames, std::span<const char>(names.data(), 10)) == 0
+                && writer.append<char>(eNames, std::span<const char>(names.data() + 10, names.size() - 10)) == 10, "char sections count chars");
+        writer.append<uint8_t>(eEmpty, std::span<const uint8_t>{});
+        writer.append<uint8_t>(eBytes, uint8_t(42));
+
+        // loaders patch records in place before writing
+        writer.get<Record>(eRecords)[3].weight = -1.0f;
+        records[3].weight = -1.0f;
+
+        writer.write(path.string(), key);
+    }
+    check(!std::filesystem::exists(path.string() + ".tmp"), "temporary file left behind");
+
+    {
+        SceneCache cache{path.string()};
+
+        const SceneCache::Key& read = cache.getKey();
+        check(read.sourceHash == key.sourceHash && read.sourceSize == key.sourceSize && read.loaderVersion == key.loaderVersion, "key round trip");
+
+        const auto readRecords = cache.getSection<Record>(eRecords);
+        check(readRecords.size() == records.size() && !memcmp(readRecords.data(), records.data(), records.size() * sizeof(Record)),
+                "record section round trip");
+
+        const auto readNames = cache.getSection<char>(eNames);
+        check(std::string(readNames.data(), readNames.size()) == names, "char section round trip");
+
+        check(cache.getSection<uint8_t>(eEmpty).empty(), "empty section");
+        check(cache.getSection<uint8_t>(eBytes).size() == 1 && cache.getSection<uint8_t>(eBytes)[0] == 42, "single record section");
+        check(cache.getSection<Record>(99).empty(), "missing section is empty");
+
+        for (uint32_t id : { eRecords, eNames, eBytes })
+        {
+            const auto bytes = cache.getSection<uint8_t>(id);
+            check(reinterpret_cast<uintptr_t>(bytes.data()) % SceneCache::sectionAlignment == 0,
+                    "section " + std::to_string(id) + " is not aligned");
+        }
+
+        bool threw = false;
+        try { cache.getSection<uint64_t>(eNames); } catch (const std::runtime_error&) { threw = true; }
+        check(threw, "section read as records that do not divide it");
+    }
+
+    // Header: magic 0, version 4, key 8, sectionCount 32, sectionsOffset 40;
+    // the table follows at 48, 24 bytes per section: id, reserved, offset, size
+    constexpr size_t COUNT   = 32;
+    constexpr size_t TABLE   = 40;
+    constexpr size_t OFFSET0 = sizeof(SceneCache::Header) + 8;
+    constexpr size_t SIZE0   = sizeof(SceneCache::Header) + 16;
+    constexpr uint64_t MAX   = std::numeric_limits<uint64_t>::max();
+
+    const size_t fileSize = readFile(path).size();
+
+    checkRejected(path, broken, "an empty file", [](std::vector<uint8_t>& bytes) { bytes.clear(); });
+    checkRejected(path, broken, "a file shorter than its header", [](std::vector<uint8_t>& bytes) { bytes.resize(sizeof(SceneCache::Header) - 1); });
+    checkRejected(path, broken, "a file cut inside its section table", [](std::vector<uint8_t>& bytes) { bytes.resize(sizeof(SceneCache::Header) + 30); });
+    checkRejected(path, broken, "a file cut inside its last section", [](std::vector<uint8_t>& bytes) { bytes.resize(bytes.size() - 1); });
+    checkRejected(path, broken, "a bad magic", [](std::vector<uint8_t>& bytes) { poke<uint32_t>(bytes, 0, 0x46544c67); });
+    checkRejected(path, broken, "a newer version", [](std::vector<uint8_t>& bytes) { poke<uint32_t>(bytes, 4, SceneCache::version + 1); });
+    checkRejected(path, broken, "a table inside the header", [](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, TABLE, 8); });
+    checkRejected(path, broken, "a misaligned table", [](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, TABLE, sizeof(SceneCache::Header) + 4); });
+    checkRejected(path, broken, "a table past the end", [&](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, TABLE, fileSize); });
+    checkRejected(path, broken, "a table offset that wraps", [](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, TABLE, MAX - 7); });
+    checkRejected(path, broken, "more sections than the file holds", [](std::vector<uint8_t>& bytes) { poke<uint32_t>(bytes, COUNT, 0xffffffffu); });
+    checkRejected(path, broken, "a misaligned section", [](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, OFFSET0, SceneCache::sectionAlignment + 1); });
+    checkRejected(path, broken, "a section past the end", [&](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, SIZE0, fileSize); });
+    checkRejected(path, broken, "a section offset that wraps", [](std::vector<uint8_t>& bytes)
+    {
+        poke<uint64_t>(bytes, OFFSET0, MAX - SceneCache::sectionAlignment + 1);
+        poke<uint64_t>(bytes, SIZE0, SceneCache::sectionAlignment);
+    });
+    checkRejected(path, broken, "a section size that wraps", [](std::vector<uint8_t>& bytes) { poke<uint64_t>(bytes, SIZE0, MAX - 63); });
+
+    // FNV-1a test vectors
+    writeFile(broken, {});
+    check(SceneCache::hashFile(broken.string()) == 0xcbf29ce484222325ull, "hash of an empty file");
+    writeFile(broken, { 'a' });
+    check(SceneCache::hashFile(broken.string()) == 0xaf63dc4c8601ec8cull, "hash of \"a\"");
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(broken);
+
+    return vlb::test::finish();
+}
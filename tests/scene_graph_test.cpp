@@ -0,0 +1,164 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// SceneGraph::update against multiplying every parent chain from scratch: world
+// matrices and mesh bounds after each edit, and that update() only walks the
+// subtrees under dirty nodes, each node once.
+
+#include "scene_graph.hpp"
+#include "check.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+    constexpr float TOLERANCE = 1e-5f;
+
+    using Bounds = std::array<glm::vec3, 2>;
+
+    // parent chain multiplied per node, no caching
+    glm::mat4 referenceWorld(vlb::SceneGraph& graph, uint32_t node)
+    {
+        glm::mat4 world = graph.getLocalMatrix(node);
+        for (uint32_t p = graph.getParent(node); p != vlb::SceneGraph::NONE; p = graph.getParent(p))
+        {
+            world = graph.getLocalMatrix(p) * world;
+        }
+        return world;
+    }
+
+    bool nearlyEqual(const glm::mat4& a, const glm::mat4& b)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            for (uint32_t r = 0; r < 4; ++r)
+            {
+                if (std::abs(a[c][r] - b[c][r]) > TOLERANCE * (1.0f + std::abs(b[c][r]))) return false;
+            }
+        }
+        return true;
+    }
+
+    bool nearlyEqual(const Bounds& a, const Bounds& b)
+    {
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                if (std::abs(a[i][axis] - b[i][axis]) > TOLERANCE * (1.0f + std::abs(b[i][axis]))) return false;
+            }
+        }
+        return true;
+    }
+
+    // World box of the unit cube a mesh node instances, the way Scene_t grows its bounds
+    Bounds worldBounds(vlb::SceneGraph& graph, uint32_t node)
+    {
+        Bounds bounds{ glm::vec3(INFINITY), glm::vec3(-INFINITY) };
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            const glm::vec4 point{ float(corner & 1), float((corner >> 1) & 1), float((corner >> 2) & 1), 1.0f };
+            const glm::vec3 world{ graph.getWorldMatrix(node) * point };
+            bounds[0] = glm::min(bounds[0], world);
+            bounds[1] = glm::max(bounds[1], world);
+        }
+        return bounds;
+    }
+
+    void checkWorldMatrices(vlb::SceneGraph& graph, const std::string& name)
+    {
+        for (uint32_t node = 0; node < graph.getCount(); ++node)
+        {
+            vlb::test::check(nearlyEqual(graph.getWorldMatrix(node), referenceWorld(graph, node)),
+                    name + ": world matrix of node " + std::to_string(node));
+        }
+    }
+
+    void checkUpdated(std::span<const uint32_t> updated, const std::vector<uint32_t>& expected, const std::string& name)
+    {
+        vlb::test::check(std::equal(updated.begin(), updated.end(), expected.begin(), expected.end()),
+                name + ": update() walked " + std::to_string(updated.size()) + " nodes, expected " + std::to_string(expected.size()));
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+    using vlb::SceneGraph;
+
+    //  0 root, translated by (1, 0, 0)
+    //  1 +- turned 90 degrees about z
+    //  2 |  +- mesh, scaled by 2 and translated by (0, 1, 0)
+    //  3 +- mesh, node matrix only
+    //  4 second root, mesh
+    SceneGraph graph{};
+
+    SceneGraph::Transform root{};
+    root.translation = glm::vec3(1.0f, 0.0f, 0.0f);
+    SceneGraph::Transform turned{};
+    turned.rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    SceneGraph::Transform scaled{};
+    scaled.translation = glm::vec3(0.0f, 1.0f, 0.0f);
+    scaled.scale       = glm::vec3(2.0f);
+    SceneGraph::Transform matrix{};
+    matrix.matrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+
+    const uint32_t r = graph.push(SceneGraph::NONE, root, -1, 10);
+    const uint32_t t = graph.push(r, turned, -1, 11);
+    const uint32_t s = graph.push(t, scaled, 0, 12);
+    const uint32_t m = graph.push(r, matrix, 0, 13);
+    const uint32_t e = graph.push(SceneGraph::NONE, {}, 1, 14);
+
+    check(graph.getSubtreeEnd(r) == 4 && graph.getSubtreeEnd(t) == 3 && graph.getSubtreeEnd(s) == 3
+            && graph.getSubtreeEnd(m) == 4 && graph.getSubtreeEnd(e) == 5, "subtree ranges");
+    check(graph.getSource(s) == 12 && graph.getMesh(s) == 0 && graph.getMesh(t) == -1, "per-node glTF data");
+
+    // a parent whose subtree is already closed cannot take children
+    bool threw = false;
+    try { graph.push(t, {}, -1, 15); } catch (const std::runtime_error&) { threw = true; }
+    check(threw && graph.getCount() == 5, "push() after a closed subtree");
+
+    check(graph.isDirty(), "new nodes are dirty");
+    checkUpdated(graph.update(), { r, t, s, m, e }, "first update");
+    checkWorldMatrices(graph, "first update");
+    check(!graph.isDirty() && graph.update().empty(), "nothing to do after update()");
+
+    // unit cube: scaled to [0, 2], up to y [1, 3], turned to x [-3, -1] y [0, 2], then x + 1
+    check(nearlyEqual(worldBounds(graph, s), { glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(0.0f, 2.0f, 2.0f) }), "bounds under two parents");
+    check(nearlyEqual(worldBounds(graph, m), { glm::vec3(1.0f, 0.0f, -3.0f), glm::vec3(2.0f, 1.0f, -2.0f) }), "bounds with a node matrix");
+
+    // a leaf and the other root are separate dirty roots
+    const glm::mat4 turnedWorld = graph.getWorldMatrix(t);
+    graph.setScale(s, glm::vec3(1.0f));
+    graph.setMatrix(e, glm::scale(glm::mat4(1.0f), glm::vec3(4.0f)));
+    checkUpdated(graph.update(), { s, e }, "two dirty leaves");
+    checkWorldMatrices(graph, "two dirty leaves");
+    check(graph.getWorldMatrix(t) == turnedWorld, "clean parent kept its world matrix");
+    check(nearlyEqual(worldBounds(graph, e), { glm::vec3(0.0f), glm::vec3(4.0f) }), "bounds of a scaled root");
+
+    // nested dirty nodes: the subtree is walked once from its top
+    graph.setTranslation(s, glm::vec3(0.0f, 2.0f, 0.0f));
+    graph.setRotation(t, glm::angleAxis(glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    graph.setTranslation(s, glm::vec3(0.0f, 1.0f, 0.0f));
+    checkUpdated(graph.update(), { t, s }, "nested dirty nodes");
+    checkWorldMatrices(graph, "nested dirty nodes");
+    check(nearlyEqual(worldBounds(graph, s), { glm::vec3(2.0f, -1.0f, 0.0f), glm::vec3(3.0f, 0.0f, 1.0f) }), "bounds after turning the parent");
+
+    // moving a root moves its whole subtree and nothing else
+    const glm::mat4 otherRoot = graph.getWorldMatrix(e);
+    graph.setTranslation(r, glm::vec3(0.0f, 0.0f, 5.0f));
+    checkUpdated(graph.update(), { r, t, s, m }, "dirty root");
+    checkWorldMatrices(graph, "dirty root");
+    check(graph.getWorldMatrix(e) == otherRoot, "other root kept its world matrix");
+    check(nearlyEqual(worldBounds(graph, s), { glm::vec3(1.0f, -1.0f, 5.0f), glm::vec3(2.0f, 0.0f, 6.0f) }), "bounds after moving the root");
+    check(nearlyEqual(worldBounds(graph, m), { glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(1.0f, 1.0f, 3.0f) }), "sibling bounds after moving the root");
+
+    graph.clear();
+    check(graph.getCount() == 0 && !graph.isDirty(), "clear()");
+
+    return vlb::test::finish();
+}
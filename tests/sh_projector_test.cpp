@@ -0,0 +1,118 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// SHProjector against a brute-force sum that evaluates every basis function
+// per pixel, for each pixel type, several bands and thread counts.
+
+#include "sh_projector.hpp"
+#include "check.hpp"
+#include "sh_reference.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace {
+
+    constexpr double TOLERANCE = 1e-4; // relative, float rows against double sums
+
+    template <class T>
+    void checkProjection(const std::string& name, const std::vector<T>& pixels, uint32_t width, uint32_t height,
+            uint32_t channels, double scale)
+    {
+        using vlb::test::check;
+
+        for (uint32_t lmax : { 0u, 1u, 3u, 4u, 7u })
+        {
+            const std::string band = name + ", lmax " + std::to_string(lmax);
+
+            vlb::SHProjector single{ { lmax, 1u } };
+            std::vector<float> coeffs = single.project(pixels.data(), width, height, channels);
+            check(single.getCoeffCount() == (lmax + 1) * (lmax + 1), band + ": getCoeffCount()");
+
+            const double error = vlb::test::maxError(coeffs, vlb::test::projectSH(pixels.data(), width, height, channels, lmax, scale));
+            check(error <= TOLERANCE, band + ": brute-force sum differs by " + std::to_string(error));
+
+            // rows are summed in fixed chunks, threads must not change the bits
+            for (uint32_t threadCount : { 3u, 8u })
+            {
+                vlb::SHProjector threaded{ { lmax, threadCount } };
+                std::vector<float> threadedCoeffs = threaded.project(pixels.data(), width, height, channels);
+                check(threadedCoeffs.size() == coeffs.size()
+                        && !memcmp(threadedCoeffs.data(), coeffs.data(), coeffs.size() * sizeof(float)),
+                        band + ": " + std::to_string(threadCount) + " threads differ from one");
+            }
+        }
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+
+    std::mt19937 random{ 2022u };
+
+    {
+        vlb::SHProjector projector{ {} };
+        std::cout << "row kernel: " << projector.getInstructionSet() << "\n";
+    }
+
+    // odd sizes leave SIMD tails and a partial last chunk of rows
+    {
+        constexpr uint32_t width = 61u, height = 37u, channels = 3u;
+        std::uniform_real_distribution<float> radiance{ 0.0f, 8.0f };
+        std::vector<float> pixels(width * height * channels);
+        std::generate(pixels.begin(), pixels.end(), [&]() { return radiance(random); });
+        checkProjection("float rgb", pixels, width, height, channels, 1.0);
+    }
+    {
+        constexpr uint32_t width = 64u, height = 32u, channels = 4u;
+        std::vector<uint8_t> pixels(width * height * channels);
+        std::generate(pixels.begin(), pixels.end(), [&]() { return uint8_t(random() % 256); });
+        checkProjection("uint8 rgba", pixels, width, height, channels, 1.0 / 255.0);
+    }
+    {
+        constexpr uint32_t width = 45u, height = 23u, channels = 1u;
+        std::vector<uint16_t> pixels(width * height * channels);
+        std::generate(pixels.begin(), pixels.end(), [&]() { return uint16_t(random() % 65536); });
+        checkProjection("uint16 grey", pixels, width, height, channels, 1.0 / 65535.0);
+    }
+
+    // evaluate() is what CpuBackend projects radiance with
+    {
+        constexpr uint32_t lmax = 6u;
+        std::uniform_real_distribution<double> angle{ 0.0, 1.0 };
+
+        double error = 0.0;
+        std::vector<float>  basis((lmax + 1) * (lmax + 1));
+        std::vector<double> reference(basis.size());
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            const double theta = vlb::test::PI * angle(random);
+            const double phi   = 2.0 * vlb::test::PI * angle(random);
+            vlb::SHProjector::evaluate(lmax, float(std::sin(theta) * std::cos(phi)), float(std::sin(theta) * std::sin(phi)),
+                    float(std::cos(theta)), basis.data());
+            vlb::test::evaluateSH(lmax, theta, phi, reference.data());
+            error = std::max(error, vlb::test::maxError(basis, reference));
+        }
+        check(error <= TOLERANCE, "evaluate() differs from the reference basis by " + std::to_string(error));
+    }
+
+    // A constant white sphere only has the DC term, Y(0, 0) * 4 pi
+    {
+        constexpr uint32_t width = 128u, height = 64u;
+        std::vector<float> white(width * height * 3, 1.0f);
+        std::vector<float> coeffs = vlb::SHProjector{ { 2u, 0u } }.project(white.data(), width, height, 3u);
+
+        const double dc = std::sqrt(4.0 * vlb::test::PI); // 0.5 / sqrt(pi) * 4 pi
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            check(std::abs(coeffs[c] - dc) < 1e-3, "white sphere: DC term " + std::to_string(coeffs[c]));
+        }
+        for (size_t i = 3; i < coeffs.size(); ++i)
+        {
+            check(std::abs(coeffs[i]) < 1e-3, "white sphere: coefficient " + std::to_string(i / 3) + " is not zero");
+        }
+    }
+
+    return vlb::test::finish();
+}
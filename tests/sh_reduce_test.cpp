@@ -0,0 +1,316 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// sh.comp followed by sh_reduce.comp against a brute-force CPU sum over the same
+// pixels and against SHProjector. A second run has to give the same bits.
+// Runs on any Vulkan 1.2 device with a compute queue (lavapipe will do) and
+// reports itself skipped when there is none.
+
+#include "application.hpp"
+#include "probe_volume.hpp"
+#include "sh_projector.hpp"
+#include "check.hpp"
+#include "sh_reference.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+namespace {
+
+    constexpr uint32_t WORKGROUP_SIZE = 16u;   // sh.comp
+    constexpr uint32_t WIDTH          = 67u;   // not a multiple of WORKGROUP_SIZE, edge groups are partly outside
+    constexpr uint32_t HEIGHT         = 35u;
+    constexpr uint32_t LAYERS         = 2u;
+    constexpr double   TOLERANCE      = 1e-4;  // relative, float kernels against double sums
+
+    const char* PROJECT_SHADER = "shaders/sh.comp.spv";
+    const char* REDUCE_SHADER  = "shaders/sh_reduce.comp.spv";
+
+    struct Context
+    {
+        vk::DynamicLoader     dl;
+        vk::UniqueInstance    instance;
+        vk::PhysicalDevice    physicalDevice;
+        vk::UniqueDevice      device;
+        vk::Queue             queue;
+        vk::UniqueCommandPool commandPool;
+
+        ~Context()
+        {
+            if (!this->device) return;
+
+            this->device->waitIdle();
+            if (this->commandPool)
+            {
+                vlb::SubmissionQueue::forget(this->commandPool.get());
+            }
+            vlb::SubmissionQueue::release(this->device.get());
+            vlb::MemoryAllocator::release(this->device.get());
+        }
+    };
+
+    // nullptr when there is no device to run the kernels on
+    std::unique_ptr<Context> createContext()
+    {
+        std::unique_ptr<Context> context{};
+        try
+        {
+            context = std::make_unique<Context>();
+            VULKAN_HPP_DEFAULT_DISPATCHER.init(context->dl.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
+
+            vk::ApplicationInfo applicationInfo("sh_reduce_test", 1, "Asama", 1, VK_API_VERSION_1_2);
+            context->instance = vk::createInstanceUnique(vk::InstanceCreateInfo{}.setPApplicationInfo(&applicationInfo));
+            VULKAN_HPP_DEFAULT_DISPATCHER.init(context->instance.get());
+        }
+        catch (std::exception& error)
+        {
+            std::cout << error.what() << "\n";
+            return nullptr;
+        }
+
+        for (vk::PhysicalDevice physicalDevice : context->instance->enumeratePhysicalDevices())
+        {
+            if (physicalDevice.getProperties().apiVersion < VK_API_VERSION_1_2) continue;
+
+            // scalar blocks for the kernels, the rest for MemoryAllocator and SubmissionQueue
+            auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+            const auto& supported = features.get<vk::PhysicalDeviceVulkan12Features>();
+            if (!supported.scalarBlockLayout || !supported.bufferDeviceAddress || !supported.timelineSemaphore) continue;
+
+            auto families = physicalDevice.getQueueFamilyProperties();
+            auto family   = std::find_if(families.begin(), families.end(), [](const vk::QueueFamilyProperties& properties)
+            {
+                return static_cast<bool>(properties.queueFlags & vk::QueueFlagBits::eCompute);
+            });
+            if (family == families.end()) continue;
+
+            const uint32_t familyIndex = static_cast<uint32_t>(std::distance(families.begin(), family));
+            const float    priority    = 1.0f;
+            vk::DeviceQueueCreateInfo queueInfo{ {}, familyIndex, 1, &priority };
+
+            vk::PhysicalDeviceVulkan12Features enabled{};
+            enabled
+                .setScalarBlockLayout(true)
+                .setBufferDeviceAddress(true)
+                .setTimelineSemaphore(true);
+
+            context->device = physicalDevice.createDeviceUnique(
+                    vk::DeviceCreateInfo{}
+                    .setQueueCreateInfos(queueInfo)
+                    .setPNext(&enabled));
+            VULKAN_HPP_DEFAULT_DISPATCHER.init(context->device.get());
+
+            context->physicalDevice = physicalDevice;
+            context->queue          = context->device->getQueue(familyIndex, 0);
+            context->commandPool    = context->device->createCommandPoolUnique(
+                    vk::CommandPoolCreateInfo{ vk::CommandPoolCreateFlagBits::eResetCommandBuffer, familyIndex });
+
+            std::cout << "running on " << physicalDevice.getProperties().deviceName << "\n";
+            return context;
+        }
+
+        return nullptr;
+    }
+
+    // LAYERS rgba8 layers, in the layout sh.comp reads the baker's env maps in
+    vlb::Application::Image createEnvMaps(Context& context, const std::vector<uint8_t>& texels)
+    {
+        vk::Device         device         = context.device.get();
+        vk::PhysicalDevice physicalDevice = context.physicalDevice;
+        vk::CommandPool    commandPool    = context.commandPool.get();
+
+        vlb::Application::Image image = vlb::Application::createImage(device, physicalDevice, vk::Format::eR8G8B8A8Unorm, { WIDTH, HEIGHT, 1 },
+                commandPool, context.queue, LAYERS, vk::ImageViewType::e2DArray);
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        vlb::Application::Buffer staging = vlb::Application::createBuffer(device, physicalDevice, texels.size(), eTransferSrc,
+                eHostVisible | eHostCoherent, texels.data());
+
+        vk::CommandBuffer cmd = vlb::Application::recordCommandBuffer(device, commandPool);
+        cmd.copyBufferToImage(staging.handle.get(), image.handle.get(), vk::ImageLayout::eGeneral,
+                vk::BufferImageCopy{}
+                .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, LAYERS })
+                .setImageExtent({ WIDTH, HEIGHT, 1 }));
+
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+        vlb::Application::flushCommandBuffer(device, commandPool, cmd, context.queue);
+
+        return image;
+    }
+
+    // What GpuBackend does with one batch of LAYERS probes
+    std::vector<float> projectOnDevice(Context& context, vlb::Application::Image& envMaps, uint32_t lmax)
+    {
+        vk::Device         device         = context.device.get();
+        vk::PhysicalDevice physicalDevice = context.physicalDevice;
+        vk::CommandPool    commandPool    = context.commandPool.get();
+
+        const uint32_t coeffCount = (lmax + 1) * (lmax + 1);
+        const uint32_t groupsX    = (WIDTH + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+        const uint32_t groupsY    = (HEIGHT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+        const uint32_t groupCount = groupsX * groupsY;
+
+        using enum vk::BufferUsageFlagBits;
+        using enum vk::MemoryPropertyFlagBits;
+        vlb::Application::Buffer coeffs   = vlb::Application::createBuffer(device, physicalDevice, LAYERS * coeffCount * 3 * sizeof(float),
+                eStorageBuffer, eHostVisible | eHostCoherent);
+        vlb::Application::Buffer partials = vlb::Application::createBuffer(device, physicalDevice, LAYERS * groupCount * coeffCount * 3 * sizeof(float),
+                eStorageBuffer, eDeviceLocal);
+
+        std::array<vk::DescriptorSetLayoutBinding, 3> bindings{
+            vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eStorageImage,  1, vk::ShaderStageFlagBits::eCompute },
+            vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            vk::DescriptorSetLayoutBinding{ 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute }
+        };
+        vk::UniqueDescriptorSetLayout setLayout = device.createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{}.setBindings(bindings));
+
+        std::array<vk::DescriptorPoolSize, 2> poolSizes{
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageImage, 1 }
+        };
+        vk::UniqueDescriptorPool descriptorPool = device.createDescriptorPoolUnique(
+                vk::DescriptorPoolCreateInfo{}
+                .setMaxSets(1)
+                .setPoolSizes(poolSizes));
+
+        vk::DescriptorSet descriptorSet = device.allocateDescriptorSets(
+                vk::DescriptorSetAllocateInfo{}
+                .setDescriptorPool(descriptorPool.get())
+                .setSetLayouts(setLayout.get())).front();
+
+        vk::DescriptorImageInfo  imageInfo{ {}, envMaps.imageView.get(), vk::ImageLayout::eGeneral };
+        vk::DescriptorBufferInfo coeffsInfo{ coeffs.handle.get(), 0, coeffs.size };
+        vk::DescriptorBufferInfo partialsInfo{ partials.handle.get(), 0, partials.size };
+        std::array<vk::WriteDescriptorSet, 3> writes{
+            vk::WriteDescriptorSet{}.setDstSet(descriptorSet).setDstBinding(0).setDescriptorType(vk::DescriptorType::eStorageImage).setImageInfo(imageInfo),
+            vk::WriteDescriptorSet{}.setDstSet(descriptorSet).setDstBinding(1).setDescriptorType(vk::DescriptorType::eStorageBuffer).setBufferInfo(coeffsInfo),
+            vk::WriteDescriptorSet{}.setDstSet(descriptorSet).setDstBinding(2).setDescriptorType(vk::DescriptorType::eStorageBuffer).setBufferInfo(partialsInfo)
+        };
+        device.updateDescriptorSets(writes, nullptr);
+
+        // the whole image array is one in-flight slot starting at layer 0
+        std::array<uint32_t, 3> projectConstants{ WIDTH, HEIGHT, 0u };
+        std::array<uint32_t, 3> reduceConstants{ groupCount, 0u, coeffCount };
+
+        vk::PushConstantRange pcRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(projectConstants) };
+        vk::UniquePipelineLayout pipelineLayout = device.createPipelineLayoutUnique(
+                vk::PipelineLayoutCreateInfo{}
+                .setSetLayouts(setLayout.get())
+                .setPushConstantRanges(pcRange));
+
+        auto createPipeline = [&](const char* shaderPath)
+        {
+            vk::UniqueShaderModule shaderModule = vlb::Application::createShaderModule(device, shaderPath);
+
+            // SH_LMAX, constant_id 0 in sh_common.h
+            const vk::SpecializationMapEntry lmaxEntry{ 0, 0, sizeof(uint32_t) };
+            const vk::SpecializationInfo     specialization{ 1, &lmaxEntry, sizeof(lmax), &lmax };
+
+            auto [result, pipeline] = device.createComputePipelineUnique(nullptr,
+                    vk::ComputePipelineCreateInfo{}
+                    .setStage(vk::PipelineShaderStageCreateInfo{}
+                        .setStage(vk::ShaderStageFlagBits::eCompute)
+                        .setModule(shaderModule.get())
+                        .setPName("main")
+                        .setPSpecializationInfo(&specialization))
+                    .setLayout(pipelineLayout.get()));
+
+            if (result != vk::Result::eSuccess)
+            {
+                throw std::runtime_error(std::string("failed to create a pipeline of ") + shaderPath);
+            }
+            return std::move(pipeline);
+        };
+
+        vk::UniquePipeline project = createPipeline(PROJECT_SHADER);
+        vk::UniquePipeline reduce  = createPipeline(REDUCE_SHADER);
+
+        vk::CommandBuffer cmd = vlb::Application::recordCommandBuffer(device, commandPool);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout.get(), 0, descriptorSet, {});
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, project.get());
+        cmd.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(projectConstants), projectConstants.data());
+        cmd.dispatch(groupsX, groupsY, LAYERS);
+
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, {}, {});
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, reduce.get());
+        cmd.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(reduceConstants), reduceConstants.data());
+        cmd.dispatch(coeffCount, LAYERS, 1u);
+
+        barrier
+            .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+
+        vlb::Application::flushCommandBuffer(device, commandPool, cmd, context.queue);
+
+        const float* mapped = static_cast<const float*>(coeffs.memory.map());
+        return std::vector<float>(mapped, mapped + LAYERS * coeffCount * 3);
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+
+    if (!std::filesystem::exists(PROJECT_SHADER) || !std::filesystem::exists(REDUCE_SHADER))
+    {
+        return vlb::test::skip("compiled shaders not found, run from the build directory after building the shaders target");
+    }
+
+    std::unique_ptr<Context> context = createContext();
+    if (!context)
+    {
+        return vlb::test::skip("no Vulkan 1.2 device with a compute queue");
+    }
+
+    try
+    {
+        // noise on top of a gradient, so every band gets something to sum
+        std::mt19937 random{ 2022u };
+        std::vector<uint8_t> texels(size_t(LAYERS) * WIDTH * HEIGHT * 4);
+        for (size_t i = 0; i < texels.size(); ++i)
+        {
+            const size_t y = i / 4 / WIDTH % HEIGHT;
+            texels[i] = static_cast<uint8_t>(std::min<size_t>(255, y * 255 / HEIGHT / 2 + random() % 128));
+        }
+
+        vlb::Application::Image envMaps = createEnvMaps(*context, texels);
+
+        for (uint32_t lmax = 0; lmax <= VLB_SH_MAX_LMAX; ++lmax)
+        {
+            const std::string band       = "lmax " + std::to_string(lmax);
+            const uint32_t    coeffCount = (lmax + 1) * (lmax + 1);
+
+            std::vector<float> first  = projectOnDevice(*context, envMaps, lmax);
+            std::vector<float> second = projectOnDevice(*context, envMaps, lmax);
+            check(first.size() == second.size() && !memcmp(first.data(), second.data(), first.size() * sizeof(float)), band + ": two runs differ");
+
+            for (uint32_t layer = 0; layer < LAYERS; ++layer)
+            {
+                const std::string where       = band + ", layer " + std::to_string(layer);
+                const uint8_t*    layerTexels = texels.data() + size_t(layer) * WIDTH * HEIGHT * 4;
+                std::vector<float> layerCoeffs(first.begin() + layer * coeffCount * 3, first.begin() + (layer + 1) * coeffCount * 3);
+
+                const double error = vlb::test::maxError(layerCoeffs, vlb::test::projectSH(layerTexels, WIDTH, HEIGHT, 4, lmax, 1.0 / 255.0));
+                check(error <= TOLERANCE, where + ": brute-force sum differs by " + std::to_string(error));
+
+                vlb::SHProjector projector{ { lmax, 1u } };
+                const double projectorError = vlb::test::maxError(layerCoeffs, projector.project(layerTexels, WIDTH, HEIGHT, 4));
+                check(projectorError <= TOLERANCE, where + ": SHProjector differs by " + std::to_string(projectorError));
+            }
+        }
+    }
+    catch (std::exception& error)
+    {
+        std::cerr << "std::exception: " << error.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return vlb::test::finish();
+}
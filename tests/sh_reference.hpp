@@ -0,0 +1,79 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+#ifndef SH_REFERENCE_HPP
+#define SH_REFERENCE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Slow but plainly correct SH to check the fast paths against: std::sph_legendre for
+// every basis function of every pixel, the pixel directions and weights of
+// shaders/sh.comp, sums in double.
+namespace vlb::test {
+
+    constexpr double PI = 3.14159265358979323846;
+
+    // Real SH of every band up to lmax, indexed l * (l + 1) + m, signs of SH() in sh_common.h
+    inline void evaluateSH(uint32_t lmax, double theta, double phi, double* out)
+    {
+        for (int l = 0; l <= int(lmax); ++l)
+        {
+            out[l * (l + 1)] = std::sph_legendre(l, 0, theta);
+            for (int m = 1; m <= l; ++m)
+            {
+                const double Y = std::sqrt(2.0) * std::sph_legendre(l, m, theta);
+                out[l * (l + 1) + m] = Y * std::cos(m * phi);
+                out[l * (l + 1) - m] = Y * std::sin(m * phi);
+            }
+        }
+    }
+
+    // RGB coefficients of an equirect image, fewer than 3 channels count as grey
+    template <class T>
+    std::vector<double> projectSH(const T* pixels, uint32_t width, uint32_t height, uint32_t channels, uint32_t lmax, double scale)
+    {
+        const uint32_t coeffCount = (lmax + 1) * (lmax + 1);
+        const double   pixelArea  = (2.0 * PI / width) * (PI / height);
+
+        std::vector<double> sums(coeffCount * 3, 0.0);
+        std::vector<double> basis(coeffCount);
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const double theta  = PI * (y + 0.5) / height;
+            const double weight = pixelArea * std::sin(theta);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                evaluateSH(lmax, theta, 2.0 * PI * (x + 0.5) / width, basis.data());
+
+                const T* texel = pixels + (size_t(y) * width + x) * channels;
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const double value = double(texel[channels >= 3 ? c : 0]) * scale * weight;
+                    for (uint32_t i = 0; i < coeffCount; ++i)
+                    {
+                        sums[i * 3 + c] += basis[i] * value;
+                    }
+                }
+            }
+        }
+
+        return sums;
+    }
+
+    // largest difference relative to 1 + |reference|
+    template <class T, class U>
+    double maxError(const std::vector<T>& values, const std::vector<U>& reference)
+    {
+        double error = 0.0;
+        for (size_t i = 0; i < values.size() && i < reference.size(); ++i)
+        {
+            error = std::max(error, std::abs(double(values[i]) - double(reference[i])) / (1.0 + std::abs(double(reference[i]))));
+        }
+        return values.size() == reference.size() ? error : HUGE_VAL;
+    }
+}
+
+#endif // ifndef SH_REFERENCE_HPP
@@ -0,0 +1,130 @@
+// created in 2022 by Andrey Treefonov https://github.com/Reefufui
+
+// Random allocate/free sequences against SubAllocator: live ranges never overlap,
+// stay inside the block and honour their alignment, and freeing everything merges
+// the block back into one range.
+
+#include "sub_allocator.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+    constexpr uint64_t BLOCK_SIZE      = 64ull << 20;
+    constexpr uint32_t OPERATION_COUNT = 200000u;
+
+    // Allocation sizes spread over the size classes the way buffers and images do
+    uint64_t randomSize(std::mt19937_64& random)
+    {
+        const uint32_t log2 = static_cast<uint32_t>(random() % 21); // 1 byte .. 1 MiB
+        return 1 + random() % (1ull << log2);
+    }
+
+    uint64_t randomAlignment(std::mt19937_64& random)
+    {
+        static const uint64_t alignments[] = { 1, 4, 16, 64, 256, 4096, 65536 };
+        return alignments[random() % std::size(alignments)];
+    }
+
+    // offset -> end of every live range
+    bool overlaps(const std::map<uint64_t, uint64_t>& ranges, uint64_t offset, uint64_t end)
+    {
+        auto next = ranges.lower_bound(offset);
+        if (next != ranges.end() && next->first < end) return true;
+        if (next != ranges.begin() && std::prev(next)->second > offset) return true;
+        return false;
+    }
+}
+
+int main()
+{
+    using vlb::test::check;
+
+    std::mt19937_64 random{ 2022u };
+
+    vlb::SubAllocator allocator{ BLOCK_SIZE };
+    check(allocator.getSize() == BLOCK_SIZE && allocator.isEmpty(), "fresh allocator is not empty");
+
+    std::vector<vlb::SubAllocator::Allocation> live{};
+    std::map<uint64_t, uint64_t>               ranges{};
+    uint64_t used = 0, failedAllocations = 0, badRanges = 0;
+
+    for (uint32_t i = 0; i < OPERATION_COUNT; ++i)
+    {
+        // mostly allocate until the block is busy, then mostly free
+        const bool busy = used > BLOCK_SIZE / 2;
+        if (!live.empty() && random() % 100 < (busy ? 70u : 35u))
+        {
+            const size_t index = random() % live.size();
+            allocator.free(live[index]);
+            used -= live[index].size;
+            ranges.erase(live[index].offset);
+            live[index] = live.back();
+            live.pop_back();
+        }
+        else
+        {
+            const uint64_t size      = randomSize(random);
+            const uint64_t alignment = randomAlignment(random);
+
+            vlb::SubAllocator::Allocation allocation{};
+            if (!allocator.allocate(size, alignment, allocation))
+            {
+                failedAllocations++;
+                continue;
+            }
+
+            const uint64_t end = allocation.offset + allocation.size;
+            if (allocation.size != size || allocation.offset % alignment || end > BLOCK_SIZE || overlaps(ranges, allocation.offset, end))
+            {
+                badRanges++;
+            }
+
+            used += size;
+            ranges[allocation.offset] = end;
+            live.push_back(allocation);
+        }
+
+        if (allocator.getUsedSize() != used)
+        {
+            check(false, "used size " + std::to_string(allocator.getUsedSize()) + " after operation " + std::to_string(i)
+                    + ", expected " + std::to_string(used));
+            break;
+        }
+    }
+
+    check(!badRanges, std::to_string(badRanges) + " allocations were misaligned, out of bounds or overlapping");
+    check(failedAllocations < OPERATION_COUNT / 10, std::to_string(failedAllocations) + " allocations failed");
+
+    for (const auto& allocation : live)
+    {
+        allocator.free(allocation);
+    }
+    check(allocator.isEmpty() && !allocator.getUsedSize(), "allocator is not empty after freeing everything");
+
+    // every free range merged back, so the whole block fits again
+    vlb::SubAllocator::Allocation whole{};
+    check(allocator.allocate(BLOCK_SIZE, 1, whole) && whole.offset == 0, "block did not merge back into one range");
+    vlb::SubAllocator::Allocation extra{};
+    check(!allocator.allocate(1, 1, extra), "allocated from a full block");
+    allocator.free(whole);
+
+    // misuse is reported, not silently accepted
+    bool threw = false;
+    try { allocator.free(whole); } catch (std::runtime_error&) { threw = true; }
+    check(threw, "double free was accepted");
+
+    threw = false;
+    try { allocator.allocate(16, 3, whole); } catch (std::runtime_error&) { threw = true; }
+    check(threw, "alignment that is not a power of two was accepted");
+
+    check(!allocator.allocate(0, 1, whole), "zero sized allocation succeeded");
+    check(!allocator.allocate(BLOCK_SIZE + 1, 1, whole), "allocation larger than the block succeeded");
+
+    return vlb::test::finish();
+}